@@ -29,9 +29,16 @@
 #include <algorithm>
 #include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
 
 namespace mc {
 
@@ -179,6 +186,348 @@ public:
 
 
 /*************************************************************************//**
+ *
+ * @brief score and end position (in query and subject) of the best
+ *        semi-global alignment
+ *
+ *****************************************************************************/
+template<class Score, class Index>
+struct alignment_end
+{
+    Score score = Score(0);
+    Index query = Index(0);
+    Index subject = Index(0);
+};
+
+
+
+namespace detail {
+
+
+/*************************************************************************//**
+ *
+ * @brief read-only view of a sequence starting at an offset
+ *
+ *****************************************************************************/
+template<class Sequence>
+class offset_sequence_view
+{
+public:
+    using value_type = typename Sequence::value_type;
+    using size_type  = typename Sequence::size_type;
+
+    offset_sequence_view(const Sequence& seq, size_type offset) noexcept :
+        seq_{seq}, offset_{offset}
+    {}
+
+    value_type operator [] (size_type i) const noexcept {
+        return seq_[offset_ + i];
+    }
+
+private:
+    const Sequence& seq_;
+    size_type offset_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief selects the best alignment end in the last column and row
+ *        (same tie breaking as the quadratic backtracking alignment:
+ *        bottom-right corner first, then last column, then last row)
+ *
+ *****************************************************************************/
+template<class Score, class Index>
+alignment_end<Score,Index>
+best_alignment_end(Index lenQ, Index lenS, Score corner,
+                   const alignment_end<Score,Index>& bestInLastCol,
+                   const alignment_end<Score,Index>& bestInLastRow)
+{
+    auto res = alignment_end<Score,Index>{corner, lenQ, lenS};
+    if (bestInLastCol.query > 0 && bestInLastCol.score > res.score) {
+        res = bestInLastCol;
+    }
+    if (bestInLastRow.subject > 0 && bestInLastRow.score > res.score) {
+        res = bestInLastRow;
+    }
+    return res;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief semi-global alignment score kernel with linear memory;
+ *        processes score matrix column by column
+ *
+ *****************************************************************************/
+template<
+    class QuerySequence, class SubjectSequence,
+    class ScoringScheme
+>
+alignment_end<typename ScoringScheme::score_type,
+              typename QuerySequence::size_type>
+semi_global_end_scalar(const QuerySequence& query,
+                       const SubjectSequence& subject,
+                       const ScoringScheme& scoring)
+{
+    using index_t = typename QuerySequence::size_type;
+    using score_t = typename ScoringScheme::score_type;
+    using end_t   = alignment_end<score_t,index_t>;
+
+    const index_t lenQ = query.size();
+    const index_t lenS = subject.size();
+    const score_t gap  = scoring.gap();
+
+    // current column of the score matrix
+    std::vector<score_t> col(lenQ+1, 0);
+
+    end_t bestInLastRow;
+
+    for (index_t s = 1; s < lenS+1; ++s) {
+        const auto vsubject = subject[s-1];
+        score_t diag = 0;
+        for (index_t q = 1; q < lenQ+1; ++q) {
+            const score_t left = col[q];
+            score_t h = diag + scoring.score(vsubject, query[q-1]);
+            h = std::max(h, score_t(col[q-1] + gap));
+            h = std::max(h, score_t(left + gap));
+            col[q] = h;
+            diag = left;
+        }
+        if (s < lenS && (bestInLastRow.subject == 0 ||
+                         col[lenQ] > bestInLastRow.score))
+        {
+            bestInLastRow = end_t{col[lenQ], lenQ, s};
+        }
+    }
+
+    end_t bestInLastCol;
+    for (index_t q = 1; q < lenQ; ++q) {
+        if (bestInLastCol.query == 0 || col[q] > bestInLastCol.score) {
+            bestInLastCol = end_t{col[q], q, lenS};
+        }
+    }
+
+    return best_alignment_end(lenQ, lenS, col[lenQ],
+                              bestInLastCol, bestInLastRow);
+}
+
+
+
+#ifdef __SSE2__
+
+/// 8 x 16 bit lanes (wrapped so that it can be stored in std::vector)
+struct simd_int16x8 { __m128i v; };
+
+
+/*************************************************************************//**
+ *
+ * @brief striped (Farrar) semi-global alignment score kernel with
+ *        8 x 16 bit lanes and linear memory;
+ *        query profiles are built lazily for each subject symbol
+ *
+ * @return false, if scores don't fit into 16 bits
+ *
+ *****************************************************************************/
+template<
+    class QuerySequence, class SubjectSequence,
+    class ScoringScheme
+>
+bool
+semi_global_end_striped(const QuerySequence& query,
+                        const SubjectSequence& subject,
+                        const ScoringScheme& scoring,
+                        alignment_end<typename ScoringScheme::score_type,
+                                      typename QuerySequence::size_type>& res)
+{
+    using index_t = typename QuerySequence::size_type;
+    using score_t = typename ScoringScheme::score_type;
+    using end_t   = alignment_end<score_t,index_t>;
+
+    constexpr index_t lanes = 8;
+    constexpr score_t maxValue = std::numeric_limits<std::int16_t>::max();
+    constexpr score_t minValue = std::numeric_limits<std::int16_t>::min();
+
+    const index_t lenQ = query.size();
+    const index_t lenS = subject.size();
+    const score_t gap  = scoring.gap();
+
+    if (lenQ < 1 || gap <= minValue || gap >= maxValue) return false;
+
+    const index_t segLen = (lenQ + lanes - 1) / lanes;
+
+    // query profiles; profileIndex[symbol] = offset or -1
+    std::vector<simd_int16x8> profiles;
+    std::int_least64_t profileIndex[256];
+    std::fill(std::begin(profileIndex), std::end(profileIndex), -1);
+
+    std::vector<simd_int16x8> hLoad (segLen, simd_int16x8{_mm_setzero_si128()});
+    std::vector<simd_int16x8> hStore(segLen, simd_int16x8{_mm_setzero_si128()});
+
+    const __m128i vGap = _mm_set1_epi16(std::int16_t(gap));
+    // -inf in lane 0, 0 otherwise
+    const __m128i vNegInf0 = _mm_set_epi16(0,0,0,0,0,0,0,std::int16_t(minValue));
+    // F for the first row: gap in lane 0, -inf otherwise
+    const __m128i vInitF = _mm_set_epi16(
+        std::int16_t(minValue), std::int16_t(minValue),
+        std::int16_t(minValue), std::int16_t(minValue),
+        std::int16_t(minValue), std::int16_t(minValue),
+        std::int16_t(minValue), std::int16_t(gap));
+
+    __m128i vMax = _mm_set1_epi16(std::int16_t(minValue + 1));
+    __m128i vMin = _mm_set1_epi16(std::int16_t(maxValue));
+
+    // position of last query symbol in striped layout
+    const index_t lastSeg  = (lenQ-1) % segLen;
+    const index_t lastLane = (lenQ-1) / segLen;
+
+    alignas(16) std::int16_t buf[lanes];
+
+    end_t bestInLastRow;
+
+    for (index_t s = 0; s < lenS; ++s) {
+        const auto vsubject = subject[s];
+        auto& pidx = profileIndex[static_cast<unsigned char>(vsubject)];
+        if (pidx < 0) {
+            pidx = std::int_least64_t(profiles.size());
+            for (index_t i = 0; i < segLen; ++i) {
+                for (index_t l = 0; l < lanes; ++l) {
+                    const index_t q = l * segLen + i;
+                    const score_t v = (q < lenQ)
+                                    ? scoring.score(vsubject, query[q]) : 0;
+                    if (v <= minValue || v >= maxValue) return false;
+                    buf[l] = std::int16_t(v);
+                }
+                profiles.push_back(simd_int16x8{_mm_load_si128(
+                    reinterpret_cast<const __m128i*>(buf))});
+            }
+        }
+        const simd_int16x8* profile = profiles.data() + pidx;
+
+        std::swap(hLoad, hStore);
+
+        // diagonal of first row: H[0][s] = 0
+        __m128i vH = _mm_slli_si128(hLoad[segLen-1].v, 2);
+        __m128i vF = vInitF;
+
+        for (index_t i = 0; i < segLen; ++i) {
+            vH = _mm_adds_epi16(vH, profile[i].v);
+            vH = _mm_max_epi16(vH, _mm_adds_epi16(hLoad[i].v, vGap));
+            vH = _mm_max_epi16(vH, vF);
+            vMin = _mm_min_epi16(vMin, vH);
+            vMax = _mm_max_epi16(vMax, vH);
+            hStore[i].v = vH;
+            vF = _mm_adds_epi16(vH, vGap);
+            vH = hLoad[i].v;
+        }
+
+        // lazy F loop: propagate vertical gaps across segment boundaries
+        vF = _mm_or_si128(_mm_slli_si128(vF, 2), vNegInf0);
+        for (index_t i = 0;
+             _mm_movemask_epi8(_mm_cmpgt_epi16(vF, hStore[i].v)) != 0; )
+        {
+            hStore[i].v = _mm_max_epi16(hStore[i].v, vF);
+            vMax = _mm_max_epi16(vMax, hStore[i].v);
+            vF = _mm_adds_epi16(vF, vGap);
+            if (++i >= segLen) {
+                i = 0;
+                vF = _mm_or_si128(_mm_slli_si128(vF, 2), vNegInf0);
+            }
+        }
+
+        if (s+1 < lenS) {
+            _mm_store_si128(reinterpret_cast<__m128i*>(buf), hStore[lastSeg].v);
+            const score_t v = buf[lastLane];
+            if (bestInLastRow.subject == 0 || v > bestInLastRow.score) {
+                bestInLastRow = end_t{v, lenQ, s+1};
+            }
+        }
+    }
+
+    // saturation check
+    _mm_store_si128(reinterpret_cast<__m128i*>(buf), vMax);
+    if (*std::max_element(buf, buf + lanes) >= maxValue) return false;
+    _mm_store_si128(reinterpret_cast<__m128i*>(buf), vMin);
+    if (*std::min_element(buf, buf + lanes) <= minValue) return false;
+
+    // last column
+    const auto& lastCol = (lenS > 0) ? hStore : hLoad;
+    std::vector<std::int16_t> col(segLen * lanes);
+    for (index_t i = 0; i < segLen; ++i) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(buf), lastCol[i].v);
+        for (index_t l = 0; l < lanes; ++l) col[l * segLen + i] = buf[l];
+    }
+
+    end_t bestInLastCol;
+    for (index_t q = 1; q < lenQ; ++q) {
+        if (bestInLastCol.query == 0 || col[q-1] > bestInLastCol.score) {
+            bestInLastCol = end_t{col[q-1], q, lenS};
+        }
+    }
+
+    res = best_alignment_end(lenQ, lenS, score_t(col[lenQ-1]),
+                             bestInLastCol, bestInLastRow);
+    return true;
+}
+
+#endif
+
+
+} // namespace detail
+
+
+
+/*************************************************************************//**
+ *
+ * @brief computes score and end position of the best semi-global alignment
+ *        (free end gaps for query and subject) in linear memory
+ *
+ *        Uses a striped SIMD kernel for byte-sized symbols if available
+ *        and falls back to a scalar kernel if scores exceed 16 bits.
+ *
+ *        The scoring scheme must provide 'score(subject,query)' for
+ *        pairs of symbols and a (linear) 'gap()' penalty.
+ *
+ *****************************************************************************/
+template<
+    class QuerySequence, class SubjectSequence,
+    class ScoringScheme
+>
+alignment_end<typename ScoringScheme::score_type,
+              typename QuerySequence::size_type>
+semi_global_alignment_end(const QuerySequence& query,
+                          const SubjectSequence& subject,
+                          const ScoringScheme& scoring)
+{
+    static_assert(std::is_same<typename QuerySequence::value_type,
+                               typename SubjectSequence::value_type>::value,
+                  "query and subject value type must be identical");
+
+#ifdef __SSE2__
+    if (sizeof(typename QuerySequence::value_type) == 1) {
+        alignment_end<typename ScoringScheme::score_type,
+                      typename QuerySequence::size_type> res;
+
+        if (detail::semi_global_end_striped(query, subject, scoring, res)) {
+            return res;
+        }
+    }
+#endif
+    return detail::semi_global_end_scalar(query, subject, scoring);
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief semi-global alignment (free end gaps for query and subject)
+ *
+ *        The best score and its end position are determined with the
+ *        linear memory kernel first. Backtracking data is only computed
+ *        (if requested) for the band of subject positions that an
+ *        alignment with that score can span.
  *
  *****************************************************************************/
 template<
@@ -191,24 +540,52 @@ align_semi_global(const QuerySequence& query,
                   const ScoringScheme& scoring,
                   const alignment_mode mode = alignment_mode::backtrace)
 {
-    static_assert(std::is_same<typename QuerySequence::value_type,
-                               typename SubjectSequence::value_type>::value,
-                  "query and subject value type must be identical");
-
     // datatypes from scoring scheme
     using value_t = typename QuerySequence::value_type;
     using index_t = typename QuerySequence::size_type;
     using score_t = typename ScoringScheme::score_type;
     using predc_t = typename ScoringScheme::predecessor;
 
-    // get lengths from sequence containers
-    const index_t len_q = query.size();
-    const index_t len_s = subject.size();
+    const auto end = semi_global_alignment_end(query, subject, scoring);
 
-    // quadratic memory solution for relaxing and backtracking
+    auto res = alignment<score_t,value_t>{};
+    res.score = end.score;
+
+    if (mode != alignment_mode::backtrace ||
+        end.query < 1 || end.subject < 1)
+    {
+        return res;
+    }
+
+    // The alignment starts in the first row (or in the first column).
+    // Every gap in the query costs at least 'gap()' so the number of
+    // subject symbols spanned by the alignment is limited by
+    // end.query + (max_score() * end.query - score) / -gap().
+    index_t beg_s = 0;
+    const score_t gap = scoring.gap();
+    if (gap < 0) {
+        const score_t slack = scoring.max_score() * score_t(end.query) - end.score;
+        const index_t span = end.query + index_t(std::max(score_t(0), slack) / -gap);
+        if (end.subject > span) beg_s = end.subject - span;
+    }
+
+    const index_t len_q = end.query;
+    const index_t len_s = end.subject - beg_s;
+    const auto band = detail::offset_sequence_view<SubjectSequence>{subject, beg_s};
+
+    // quadratic memory solution for relaxing and backtracking (band only)
     std::vector<score_t> score((len_q+1)*(len_s+1), 0);
     std::vector<predc_t> predc((len_q+1)*(len_s+1), predc_t(0));
 
+    // alignments must not start in the first column of the band
+    // unless it is the first column of the subject
+    if (beg_s > 0) {
+        const score_t minScore = std::numeric_limits<score_t>::min() / 2;
+        for (index_t q = 1; q < len_q+1; q++) {
+            score[q*(len_s+1)] = minScore;
+        }
+    }
+
     for (index_t q = 1; q < len_q+1; q++) {
 
         // cache the query at position q
@@ -216,7 +593,7 @@ align_semi_global(const QuerySequence& query,
 
         for (index_t s = 1; s < len_s+1; s++) {
             // cache the subject at position s
-            auto vsubject = subject[s-1];
+            auto vsubject = band[s-1];
             // cache diagonal, above and left entry of score matrix
             score_t diag  = score[(q-1)*(len_s+1)+(s-1)];
             score_t above = score[(q-1)*(len_s+1)+(s-0)];
@@ -231,52 +608,25 @@ align_semi_global(const QuerySequence& query,
         }
     }
 
-    // searching the best score
     auto bsf_q = len_q;
     auto bsfS = len_s;
-    auto bsf_v = score[len_q*(len_s+1)+len_s];
-
-    for (index_t q = 1; q < len_q; q++) {
-        auto value = score[q*(len_s+1)+len_s];
-        if (value > bsf_v) {
-            bsf_q = q;
-            bsfS = len_s;
-            bsf_v = value;
-        }
-    }
+    auto pred = predc[bsf_q*(len_s+1)+bsfS];
+    // backtracing predecessor information
+    do {
+        // caution, encode changes the values of bsf_q and bsfS
+        auto symbol = scoring.encode(bsf_q, bsfS, pred, query, band);
 
-    for (index_t s = 1; s < len_s; s++) {
-        auto value = score[len_q*(len_s+1)+s];
-        if (value > bsf_v) {
-            bsf_q = len_q;
-            bsfS = s;
-            bsf_v = value;
-        }
-    }
+        // write down the aligment
+        res.query.push_back(std::get<0>(symbol));
+        res.subject.push_back(std::get<1>(symbol));
 
-    // construct the alignment
-    auto res = alignment<score_t,value_t>{};
-    res.score = bsf_v;
-
-    if (mode == alignment_mode::backtrace) {
-        auto pred = predc[bsf_q*(len_s+1)+bsfS];
-        // backtracing predecessor information
-        do {
-            // caution, encode changes the values of bsf_q and bsfS
-            auto symbol = scoring.encode(bsf_q, bsfS, pred, query, subject);
-
-            // write down the aligment
-            res.query.push_back(std::get<0>(symbol));
-            res.subject.push_back(std::get<1>(symbol));
-
-            // update pred
-            pred = predc[bsf_q*(len_s+1)+bsfS];
-        } while (bool(pred));
-
-        // reverse the alignment
-        std::reverse(res.query.begin(), res.query.end());
-        std::reverse(res.subject.begin(), res.subject.end());
-    }
+        // update pred
+        pred = predc[bsf_q*(len_s+1)+bsfS];
+    } while (bool(pred));
+
+    // reverse the alignment
+    std::reverse(res.query.begin(), res.query.end());
+    std::reverse(res.subject.begin(), res.subject.end());
 
     return res;
 }
@@ -295,8 +645,7 @@ align_semi_global_score(const QuerySequence& query,
                         const SubjectSequence& subject,
                         const ScoringScheme& scoring)
 {
-    return align_semi_global(query, subject, scoring,
-                             alignment_mode::score_only).score;
+    return semi_global_alignment_end(query, subject, scoring).score;
 }
 
 
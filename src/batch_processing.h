@@ -4,9 +4,18 @@
 
 #include "../dep/queue/concurrentqueue.h"
 
+#include <algorithm>
 #include <atomic>
-#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
 #include <vector>
 
 
@@ -34,6 +43,8 @@ public:
         numConsumers_{1},
         queueSize_{1},
         batchSize_{1},
+        spinCount_{64},
+        minSplitSize_{0},
         handleErrors_{[](std::exception&){}},
         finalize_{[](int){}},
         measureWorkItem_{[](const WorkItem&){ return 1; }}
@@ -43,6 +54,8 @@ public:
     int num_consumers()      const noexcept { return numConsumers_; }
     std::size_t batch_size() const noexcept { return batchSize_; }
     std::size_t queue_size() const noexcept { return queueSize_; }
+    int spin_count()         const noexcept { return spinCount_; }
+    std::size_t min_split_size() const noexcept { return minSplitSize_; }
 
     void concurrency(int p, int c) noexcept {
         numProducers_ = p >= 0 ? p : 1;
@@ -50,6 +63,12 @@ public:
     }
     void batch_size(std::size_t n) noexcept { batchSize_  = n > 0 ? n : 1; }
     void queue_size(std::size_t n) noexcept { queueSize_  = n > 0 ? n : 1; }
+    /** @brief max. number of non-blocking attempts to get a batch
+     *         before a waiting thread blocks; 0: block immediately */
+    void spin_count(int n)         noexcept { spinCount_  = n > 0 ? n : 0; }
+    /** @brief batches with at least 2*n items are split in halves
+     *         if other workers are idle; 0: never split batches */
+    void min_split_size(std::size_t n) noexcept { minSplitSize_ = n; }
 
     void on_work_done(finalizer f)   { finalize_ = std::move(f); }
     void on_error(error_handler f)   { handleErrors_ = std::move(f); }
@@ -60,6 +79,8 @@ private:
     int numConsumers_;
     std::size_t queueSize_;
     std::size_t batchSize_;
+    int spinCount_;
+    std::size_t minSplitSize_;
     error_handler handleErrors_;
     finalizer finalize_;
     item_measure measureWorkItem_;
@@ -71,6 +92,11 @@ private:
  *
  * @brief  single producer, multiple consumer parallel batch processing;
  *         uses batch storage recycling strategy to avoid frequent allocations;
+ *         each worker has its own batch queue; producers distribute
+ *         batches round-robin, idle workers steal batches from other
+ *         workers and busy workers split batches for idle ones;
+ *         threads waiting for work or batch storage spin for a short
+ *         (adaptive) time and then block until notified;
  *         runs sequentially if concurrency is set to 0
  *
  * @tparam WorkItem
@@ -87,11 +113,21 @@ public:
     using finalizer       = typename batch_processing_options<WorkItem>::finalizer;
 
 private:
+    using batch_queue = moodycamel::ConcurrentQueue<batch_type>;
+
     struct batch_handler {
         std::size_t workCount_{0};
         std::size_t workSize_{0};
         batch_type batch_{};
         bool finalized_{false};
+        int spin_{0};
+    };
+
+    /** @brief batches of one worker;
+     *         owner takes from front, other workers steal from back */
+    struct worker_queue {
+        std::mutex mtx_;
+        std::deque<batch_type> batches_;
     };
 
 public:
@@ -107,13 +143,18 @@ public:
         param_{std::move(opt)},
         keepWorking_{param_.num_consumers()},
         storageQueue_{param_.queue_size()},
-        workQueue_{param_.queue_size()},
+        workerQueues_(std::max(1, param_.num_consumers())),
+        pending_{0},
+        idle_{0},
+        nextQueue_{0},
         producerBatches_(param_.num_producers()),
         consumers_{},
         consume_{std::move(consume)}
     {
-        for (auto& handler : producerBatches_)
+        for (auto& handler : producerBatches_) {
             handler.batch_.resize(param_.batch_size());
+            handler.spin_ = param_.spin_count();
+        }
 
         // fill batch storage queue with initial batches
         // we want to re-use the individual batches and all their members
@@ -130,23 +171,23 @@ public:
             consumers_.emplace_back(std::async(std::launch::async, [&,consumerId] {
                 try {
                     batch_type batch;
-                    while (valid() || workQueue_.size_approx() > 0) {
-                        if (workQueue_.try_dequeue(batch)) {
-                            if (consume_(consumerId, batch)) {
-                                // batch processed completely
-                                // put batch storage back
-                                storageQueue_.enqueue(std::move(batch));
-                            }
-                            else {
-                                // work remaining in batch
-                                // put batch back
-                                workQueue_.enqueue(std::move(batch));
-                                keepWorking_.fetch_sub(1);
-                                break;
-                            }
+                    int spin = param_.spin_count();
+
+                    while (wait_for_work(consumerId, batch, spin)) {
+                        split_if_workers_idle(consumerId, batch);
+
+                        if (consume_(consumerId, batch)) {
+                            // batch processed completely
+                            // put batch storage back
+                            storageQueue_.enqueue(std::move(batch));
+                            notify_one(storageAvailable_);
                         }
                         else {
-                            std::this_thread::sleep_for (std::chrono::milliseconds{1});
+                            // work remaining in batch
+                            // put batch back
+                            push_work(consumerId, std::move(batch));
+                            keepWorking_.fetch_sub(1);
+                            break;
                         }
                     }
                     param_.finalize_(consumerId);
@@ -168,7 +209,7 @@ public:
             }
 
             // signal all consumers to finish as soon as no work is left
-            keepWorking_.store(0);
+            invalidate();
             // wait until consumers are finished
             for (auto& consumer : consumers_) {
                 if (consumer.valid()) consumer.get();
@@ -196,7 +237,13 @@ public:
 
     // -----------------------------------------------------------------------
     void invalidate() noexcept {
-        return keepWorking_.store(0);
+        {
+            std::lock_guard<std::mutex> lock(waitMtx_);
+            keepWorking_.store(0);
+        }
+        // wake up all waiting threads
+        workAvailable_.notify_all();
+        storageAvailable_.notify_all();
     }
 
 
@@ -214,20 +261,28 @@ public:
     }
 
 
+    // -----------------------------------------------------------------------
+    /** @brief  consume current batch if not empty;
+     *          producer can continue to add items afterwards */
+    void flush_producer(int producerId = 0) {
+        auto& handler = producerBatches_[producerId];
+
+        if (!handler.finalized_ && valid()) {
+            if (consume_remaining(producerId)) {
+                // get new batch storage
+                wait_for_storage(producerId);
+            }
+        }
+    }
+
+
     // -----------------------------------------------------------------------
     /** @brief  consume last batch if not empty */
     void finalize_producer(int producerId = 0) {
         auto& handler = producerBatches_[producerId];
 
         if (!handler.finalized_ && valid()) {
-            consume_batch_if_full(producerId);
-
-            // finalize last batch
-            if (handler.workCount_ > 0) {
-                handler.batch_.resize(handler.workCount_);
-                consume_batch(producerId);
-                handler.workCount_ = 0;
-            }
+            consume_remaining(producerId);
 
             handler.finalized_ = true;
         }
@@ -235,6 +290,23 @@ public:
 
 
 private:
+    // -----------------------------------------------------------------------
+    /** @return true, if a (partial) batch was consumed */
+    bool consume_remaining(int producerId) {
+        auto& handler = producerBatches_[producerId];
+
+        consume_batch_if_full(producerId);
+
+        if (handler.workCount_ < 1) return false;
+
+        handler.batch_.resize(handler.workCount_);
+        consume_batch(producerId);
+        handler.workCount_ = 0;
+        handler.workSize_ = 0;
+        return true;
+    }
+
+
     // -----------------------------------------------------------------------
     void consume_batch_if_full(int producerId) {
         auto& handler = producerBatches_[producerId];
@@ -246,7 +318,10 @@ private:
             if (handler.workSize_ >= param_.batch_size()) {
                 WorkItem lastItem;
                 // if batch too big, remove last item
-                if (handler.workSize_ > param_.batch_size())
+                // (unless it is the only one)
+                const bool carryOver = handler.workSize_ > param_.batch_size() &&
+                                       handler.workCount_ > 1;
+                if (carryOver)
                     lastItem = std::move(handler.batch_[--handler.workCount_]);
 
                 handler.batch_.resize(handler.workCount_);
@@ -254,12 +329,11 @@ private:
                 consume_batch(producerId);
 
                 // get new batch storage
-                while (valid() && !storageQueue_.try_dequeue(handler.batch_)) {
-                    std::this_thread::sleep_for (std::chrono::milliseconds{1});
-                }
+                wait_for_storage(producerId);
 
                 // reinsert last item
-                if (handler.workSize_ > param_.batch_size()) {
+                if (carryOver) {
+                    if (handler.batch_.empty()) handler.batch_.resize(1);
                     handler.batch_.front() = std::move(lastItem);
                     handler.workSize_ = lastSize;
                     handler.workCount_ = 1;
@@ -277,23 +351,622 @@ private:
     void consume_batch(int producerId) {
         auto& handler = producerBatches_[producerId];
 
-        workQueue_.enqueue(std::move(handler.batch_));
+        const auto n = nextQueue_.fetch_add(1) % workerQueues_.size();
+        push_work(int(n), std::move(handler.batch_));
     }
 
 
     // -----------------------------------------------------------------------
-    using batch_queue = moodycamel::ConcurrentQueue<batch_type>;
+    void push_work(int workerId, batch_type&& batch) {
+        auto& queue = workerQueues_[workerId];
+        {
+            std::lock_guard<std::mutex> lock(queue.mtx_);
+            queue.batches_.push_back(std::move(batch));
+        }
+        ++pending_;
+        notify_one(workAvailable_);
+    }
+
+
+    // -----------------------------------------------------------------------
+    /** @brief  takes oldest batch from own queue or steals newest batch
+     *          from another worker's queue */
+    bool try_get_work(int workerId, batch_type& batch) {
+        if (pending_.load() < 1) return false;
+
+        const int n = int(workerQueues_.size());
+        for (int i = 0; i < n; ++i) {
+            auto& queue = workerQueues_[(workerId + i) % n];
+            std::lock_guard<std::mutex> lock(queue.mtx_);
+            if (!queue.batches_.empty()) {
+                if (i == 0) {
+                    batch = std::move(queue.batches_.front());
+                    queue.batches_.pop_front();
+                } else {
+                    batch = std::move(queue.batches_.back());
+                    queue.batches_.pop_back();
+                }
+                --pending_;
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+    // -----------------------------------------------------------------------
+    bool wait_for_work(int workerId, batch_type& batch, int& spin) {
+        ++idle_;
+        const bool success = wait_for(
+            [&] { return try_get_work(workerId, batch); },
+            workAvailable_, spin, true);
+        --idle_;
+        return success;
+    }
+
+
+    // -----------------------------------------------------------------------
+    /**
+     * @brief  hands over 2nd half of batch to idle workers
+     *         as long as there is no other work left and some
+     *         batch storage is left for producers
+     */
+    void split_if_workers_idle(int workerId, batch_type& batch) {
+        const auto minSize = param_.min_split_size();
+        if (minSize < 1) return;
+
+        while (batch.size() >= 2*minSize && idle_.load() > 0 &&
+               pending_.load() < 1 &&
+               storageQueue_.size_approx() > std::size_t(param_.num_producers()))
+        {
+            batch_type other;
+            if (!storageQueue_.try_dequeue(other)) return;
+
+            const auto half = batch.size() / 2;
+            other.resize(batch.size() - half);
+            std::move(batch.begin() + half, batch.end(), other.begin());
+            batch.resize(half);
+
+            push_work(workerId, std::move(other));
+        }
+    }
+
+
+    // -----------------------------------------------------------------------
+    void wait_for_storage(int producerId) {
+        auto& handler = producerBatches_[producerId];
+        wait_for(
+            [&] { return storageQueue_.try_dequeue(handler.batch_); },
+            storageAvailable_, handler.spin_, false);
+    }
+
+
+    // -----------------------------------------------------------------------
+    /**
+     * @brief  calls 'tryGet' up to 'spin' times (yielding in between)
+     *         and then blocks until it succeeds or the executor
+     *         is invalidated; adapts 'spin' to the recent success of spinning
+     * @param  drain  if true, 'tryGet' is called after invalidation
+     *                until it fails
+     * @return false, if 'tryGet' did not succeed
+     */
+    template<class TryGet>
+    bool wait_for(TryGet&& tryGet, std::condition_variable& available,
+                  int& spin, bool drain)
+    {
+        for (int i = 0; i < spin; ++i) {
+            if (tryGet()) {
+                // spinning was successful => spin longer next time
+                spin = std::min(2*spin, param_.spin_count());
+                return true;
+            }
+            if (!valid()) break;
+            std::this_thread::yield();
+        }
+        // spinning was unsuccessful => spin shorter next time
+        spin = std::max(spin / 2, param_.spin_count() > 0 ? 1 : 0);
+
+        std::unique_lock<std::mutex> lock(waitMtx_);
+        for (;;) {
+            if (tryGet()) return true;
+            if (!valid()) return drain && tryGet();
+            available.wait(lock);
+        }
+    }
 
+
+    // -----------------------------------------------------------------------
+    void notify_one(std::condition_variable& available) {
+        // lock ensures that waiting threads cannot miss the notification
+        { std::lock_guard<std::mutex> lock(waitMtx_); }
+        available.notify_one();
+    }
+
+
+    // -----------------------------------------------------------------------
     const batch_processing_options<WorkItem> param_;
     std::atomic_int keepWorking_;
     batch_queue storageQueue_;
-    batch_queue workQueue_;
+    std::vector<worker_queue> workerQueues_;
+    // number of batches in worker queues
+    std::atomic_int pending_;
+    // number of workers waiting for work
+    std::atomic_int idle_;
+    std::atomic<std::size_t> nextQueue_;
+    std::mutex waitMtx_;
+    std::condition_variable workAvailable_;
+    std::condition_variable storageAvailable_;
     std::vector<batch_handler> producerBatches_;
     std::vector<std::future<void>> consumers_;
     batch_consumer consume_;
 };
 
 
+
+/*************************************************************************//**
+ *
+ * @brief  FIFO queue with limited capacity for several producers and
+ *         consumers; producers block while the queue is full,
+ *         consumers block while it is empty
+ *
+ *****************************************************************************/
+template<class T>
+class bounded_queue
+{
+public:
+    // -----------------------------------------------------------------------
+    explicit
+    bounded_queue(std::size_t capacity):
+        capacity_{std::max(std::size_t(1), capacity)}
+    {}
+
+
+    // -----------------------------------------------------------------------
+    /**
+     * @brief  blocks while queue is full
+     * @return false, if queue was closed (item is not inserted)
+     */
+    bool push(T&& item) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        notFull_.wait(lock, [this] {
+            return closed_ || items_.size() < capacity_;
+        });
+        if (closed_) return false;
+        items_.push_back(std::move(item));
+        lock.unlock();
+        notEmpty_.notify_one();
+        return true;
+    }
+
+
+    // -----------------------------------------------------------------------
+    /**
+     * @brief  blocks while queue is empty and not closed
+     * @return false, if queue is closed and empty
+     */
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        notEmpty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty()) return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        lock.unlock();
+        notFull_.notify_one();
+        return true;
+    }
+
+
+    // -----------------------------------------------------------------------
+    /**
+     * @brief  no more items can be pushed; remaining items can still be
+     *         popped; wakes up all waiting threads
+     */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            closed_ = true;
+        }
+        notFull_.notify_all();
+        notEmpty_.notify_all();
+    }
+
+
+private:
+    const std::size_t capacity_;
+    std::mutex mtx_;
+    std::condition_variable notFull_;
+    std::condition_variable notEmpty_;
+    std::deque<T> items_;
+    bool closed_ = false;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief  persistent group of worker threads for fork-join parallelism;
+ *         the calling thread takes part in each job
+ *
+ *****************************************************************************/
+class fork_join_pool
+{
+public:
+    // -----------------------------------------------------------------------
+    /**
+     * @param numThreads  total number of threads per job
+     *                    (including the calling thread)
+     */
+    explicit
+    fork_join_pool(unsigned numThreads)
+    {
+        for (unsigned i = 1; i < numThreads; ++i) {
+            workers_.emplace_back([this] { work(); });
+        }
+    }
+
+    fork_join_pool(const fork_join_pool&) = delete;
+    fork_join_pool& operator = (const fork_join_pool&) = delete;
+
+    ~fork_join_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
+        }
+        jobAvailable_.notify_all();
+        for (auto& w : workers_) w.join();
+    }
+
+
+    // -----------------------------------------------------------------------
+    unsigned size() const noexcept {
+        return unsigned(workers_.size()) + 1;
+    }
+
+
+    // -----------------------------------------------------------------------
+    /**
+     * @brief  calls 'f(i)' for all i in [0,n) concurrently and
+     *         returns after all calls have finished;
+     *         rethrows the first exception thrown by 'f'
+     *         must not be called concurrently
+     */
+    template<class F>
+    void for_each_index(std::size_t n, F&& f)
+    {
+        if (n < 1) return;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            job_ = [&f] (std::size_t i) { f(i); };
+            jobSize_ = n;
+            next_ = 0;
+            active_ = unsigned(workers_.size());
+            error_ = nullptr;
+            ++generation_;
+        }
+        jobAvailable_.notify_all();
+
+        run_job();
+
+        std::unique_lock<std::mutex> lock(mtx_);
+        jobDone_.wait(lock, [this] { return active_ == 0; });
+        job_ = nullptr;
+
+        if (error_) std::rethrow_exception(error_);
+    }
+
+
+private:
+    // -----------------------------------------------------------------------
+    void run_job() {
+        for (std::size_t i = next_++; i < jobSize_; i = next_++) {
+            try {
+                job_(i);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (!error_) error_ = std::current_exception();
+            }
+        }
+    }
+
+
+    // -----------------------------------------------------------------------
+    void work() {
+        std::uint64_t generation = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                jobAvailable_.wait(lock, [&] {
+                    return stop_ || generation_ != generation;
+                });
+                if (stop_) return;
+                generation = generation_;
+            }
+            run_job();
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                --active_;
+            }
+            jobDone_.notify_one();
+        }
+    }
+
+
+    // -----------------------------------------------------------------------
+    std::mutex mtx_;
+    std::condition_variable jobAvailable_;
+    std::condition_variable jobDone_;
+    std::function<void(std::size_t)> job_;
+    std::size_t jobSize_ = 0;
+    std::atomic<std::size_t> next_{0};
+    unsigned active_ = 0;
+    std::uint64_t generation_ = 0;
+    std::exception_ptr error_;
+    bool stop_ = false;
+    std::vector<std::thread> workers_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief  reorder buffer in front of a single writer thread;
+ *         each item covers a half-open range [begin,end) of positions
+ *         (e.g. query ids) within one of several independent streams;
+ *         items of a stream are passed to the consumer in the order of
+ *         their ranges as soon as all preceding positions are covered;
+ *         positions without items (e.g. filtered input) must be skipped;
+ *         submitting threads only wait for the consumer if the number
+ *         of unconsumed items exceeds a given window
+ *
+ * @tparam Item  default constructible, movable
+ *
+ *****************************************************************************/
+template<class Item>
+class ordered_writer
+{
+public:
+    using position_type = std::uint64_t;
+    using consumer      = std::function<void(Item&&)>;
+    using action        = std::function<void()>;
+    using error_handler = std::function<void(std::exception&)>;
+
+private:
+    struct entry {
+        std::size_t stream_{0};
+        position_type begin_{0};
+        position_type end_{0};
+        bool hasItem_{false};
+        Item item_{};
+        action action_{};
+    };
+
+    using range_type = std::pair<position_type,position_type>;
+
+    struct stream_state {
+        position_type next_{0};
+        // entries that have to wait for preceding positions
+        std::multimap<range_type,entry> pending_;
+    };
+
+public:
+    // -----------------------------------------------------------------------
+    /**
+     * @param first         first position of each stream
+     * @param consume       processes items on the writer thread
+     * @param handleErrors  handles exceptions thrown by 'consume' & actions
+     * @param window        max. number of submitted but not yet consumed
+     *                      items; 'submit' blocks while the window is full
+     *                      (0: unbounded)
+     * @param maxWaiting    max. number of threads blocked in 'submit'
+     *                      at the same time; must be smaller than the number
+     *                      of submitting threads so that the items
+     *                      the writer waits for can still be produced
+     */
+    ordered_writer(position_type first,
+                   consumer consume, error_handler handleErrors,
+                   std::size_t window, unsigned maxWaiting)
+    :
+        first_{first},
+        window_{window},
+        maxWaiting_{maxWaiting},
+        consume_{std::move(consume)},
+        handleErrors_{std::move(handleErrors)}
+    {
+        writer_ = std::async(std::launch::async, [this] { write(); });
+    }
+
+    ordered_writer(const ordered_writer&) = delete;
+    ordered_writer& operator = (const ordered_writer&) = delete;
+
+    ~ordered_writer() { finish(); }
+
+
+    // -----------------------------------------------------------------------
+    /** @brief hands over item that covers positions [begin,end);
+     *         blocks while the window is full unless the writer
+     *         is waiting for exactly this item */
+    void submit(std::size_t stream, position_type begin, position_type end,
+                Item&& item)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            if (window_ > 0 && waiting_ < maxWaiting_) {
+                ++waiting_;
+                space_.wait(lock, [&] {
+                    return done_ || outstanding_ < window_ ||
+                           begin <= next_position(stream);
+                });
+                --waiting_;
+            }
+            ++outstanding_;
+        }
+        entry e;
+        e.stream_  = stream;
+        e.begin_   = begin;
+        e.end_     = end;
+        e.hasItem_ = true;
+        e.item_    = std::move(item);
+        enqueue(std::move(e));
+    }
+
+    /** @brief positions [begin,end) will never be covered by an item */
+    void skip(std::size_t stream, position_type begin, position_type end)
+    {
+        if (begin >= end) return;
+        entry e;
+        e.stream_ = stream;
+        e.begin_  = begin;
+        e.end_    = end;
+        enqueue(std::move(e));
+    }
+
+    /** @brief runs action on the writer thread before any item
+     *         of the stream that starts at position 'pos' */
+    void post(std::size_t stream, position_type pos, action act)
+    {
+        entry e;
+        e.stream_ = stream;
+        e.begin_  = pos;
+        e.end_    = pos;
+        e.action_ = std::move(act);
+        enqueue(std::move(e));
+    }
+
+
+    // -----------------------------------------------------------------------
+    /** @brief  waits until all items have been consumed;
+     *          items that still wait for uncovered positions
+     *          are consumed in order regardless */
+    void finish() {
+        if (!writer_.valid()) return;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            done_ = true;
+        }
+        available_.notify_one();
+        space_.notify_all();
+        writer_.get();
+    }
+
+
+private:
+    // -----------------------------------------------------------------------
+    void enqueue(entry&& e) {
+        // one queue for all threads: entries are inserted in the order
+        // they were handed over, e.g. actions before subsequent items
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            incoming_.push_back(std::move(e));
+        }
+        available_.notify_one();
+    }
+
+
+    // -----------------------------------------------------------------------
+    void write() {
+        std::vector<entry> incoming;
+        for (;;) {
+            for (auto& e : incoming) {
+                insert(std::move(e));
+            }
+            incoming.clear();
+
+            std::unique_lock<std::mutex> lock(mtx_);
+            publish_progress();
+            if (done_ && incoming_.empty()) break;
+            available_.wait(lock, [this] {
+                return done_ || !incoming_.empty();
+            });
+            incoming.swap(incoming_);
+        }
+
+        for (auto& stream : streams_) {
+            for (auto& pending : stream.pending_) {
+                consume(pending.second);
+            }
+            stream.pending_.clear();
+        }
+    }
+
+
+    // -----------------------------------------------------------------------
+    void insert(entry&& e) {
+        if (e.stream_ >= streams_.size()) {
+            const auto n = streams_.size();
+            streams_.resize(e.stream_ + 1);
+            for (auto i = n; i < streams_.size(); ++i) {
+                streams_[i].next_ = first_;
+            }
+        }
+        auto& stream = streams_[e.stream_];
+        const range_type range {e.begin_, e.end_};
+        stream.pending_.emplace(range, std::move(e));
+
+        auto& pending = stream.pending_;
+        while (!pending.empty() && pending.begin()->first.first <= stream.next_) {
+            auto& next = pending.begin()->second;
+            stream.next_ = std::max(stream.next_, next.end_);
+            consume(next);
+            pending.erase(pending.begin());
+        }
+    }
+
+
+    // -----------------------------------------------------------------------
+    /** @brief makes consumption progress visible to blocked submitters;
+     *         requires lock on 'mtx_' */
+    void publish_progress() {
+        outstanding_ -= consumed_;
+        consumed_ = 0;
+        next_.resize(streams_.size());
+        for (std::size_t i = 0; i < streams_.size(); ++i) {
+            next_[i] = streams_[i].next_;
+        }
+        if (waiting_ > 0) space_.notify_all();
+    }
+
+    /** @brief requires lock on 'mtx_' */
+    position_type next_position(std::size_t stream) const noexcept {
+        return stream < next_.size() ? next_[stream] : first_;
+    }
+
+
+    // -----------------------------------------------------------------------
+    void consume(entry& e) {
+        if (e.hasItem_) ++consumed_;
+        try {
+            if (e.action_) e.action_();
+            if (e.hasItem_) consume_(std::move(e.item_));
+        }
+        catch(std::exception& ex) {
+            handleErrors_(ex);
+        }
+    }
+
+
+    // -----------------------------------------------------------------------
+    const position_type first_;
+    const std::size_t window_;
+    const unsigned maxWaiting_;
+    consumer consume_;
+    error_handler handleErrors_;
+    std::mutex mtx_;
+    std::condition_variable available_;
+    std::condition_variable space_;
+    bool done_{false};
+    // guarded by 'mtx_'
+    std::vector<entry> incoming_;
+    std::size_t outstanding_{0};
+    unsigned waiting_{0};
+    std::vector<position_type> next_;
+    // only accessed by writer thread
+    std::size_t consumed_{0};
+    std::vector<stream_state> streams_;
+    std::future<void> writer_;
+};
+
+
 } // namespace mc
 
 
@@ -32,13 +32,17 @@
 #include "options.h"
 #include "printing.h"
 #include "sequence_io.h"
+#include "sketch_io.h"
 #include "taxonomy_io.h"
 #include "timer.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <stdexcept>
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -61,70 +65,33 @@ using taxon_pointer_set = std::unordered_set<const taxon*>;
  *        accession  accession.version taxid gi
  *        (like the NCBI's *.accession2version files)
  *
+ * @param accessions  sorted names of all targets
+ * @param accTaxa     target taxa in the same order as 'accessions'
+ *
  *****************************************************************************/
 void rank_targets_with_mapping_file(taxonomy_cache& taxonomy,
                                     taxon_pointer_set& targetTaxa,
+                                    const std::vector<string>& accessions,
+                                    const std::vector<const taxon*>& accTaxa,
                                     const string& mappingFile,
-                                    info_level infoLvl)
+                                    info_level infoLvl,
+                                    unsigned numThreads)
 {
-    const bool showInfo = infoLvl != info_level::silent;
-
     if (targetTaxa.empty()) return;
 
-    std::ifstream is {mappingFile};
-    if (!is.good()) return;
-
-    const auto fsize = file_size(mappingFile);
-
-    if (showInfo) {
-        cout << "Try to map sequences to taxa using '" << mappingFile
-             << "' (" << std::max(std::streamoff(1),
-                                 fsize/(1024*1024)) << " MB)" << endl;
-    }
-
-    bool showProgress = showInfo && fsize > 100000000;
-    // accession2taxid files have 40-450M lines
-    // update progress indicator every 1M lines
-    size_t step = 0;
-    size_t statStep = 1UL << 20;
-    if (showProgress) show_progress_indicator(cout, 0);
-
-    string acc;
-    string accver;
-    std::uint64_t taxid;
-    string gi;
-
-    // skip header
-    getline(is, acc);
-    acc.clear();
-
-    while (is >> acc >> accver >> taxid >> gi) {
-        // target in database?
-        // accession.version is the default
-        const taxon* tax = taxonomy.taxon_with_name(accver);
-
-        if (!tax) {
-            tax = taxonomy.taxon_with_similar_name(acc);
-            if (!tax) tax = taxonomy.taxon_with_name(gi);
-        }
-
-        // if in database then set parent
-        if (tax) {
-            auto i = targetTaxa.find(tax);
-            if (i != targetTaxa.end()) {
-                taxonomy.reset_target_parent(*tax, taxid);
-                targetTaxa.erase(i);
-                if (targetTaxa.empty()) break;
-            }
-        }
-
-        if (showProgress && !(++step % statStep)) {
-            auto pos = is.tellg();
-            show_progress_indicator(cout, pos / float(fsize));
+    // only rows with accessions of database targets are kept
+    const auto matches = read_accession_to_taxon_id_mapping(
+                             mappingFile, accessions, infoLvl, numThreads);
+
+    // first matching row of a target determines its parent
+    for (const auto& m : matches) {
+        auto i = targetTaxa.find(accTaxa[m.index]);
+        if (i != targetTaxa.end()) {
+            taxonomy.reset_target_parent(**i, m.taxonId);
+            targetTaxa.erase(i);
+            if (targetTaxa.empty()) break;
         }
     }
-
-    if (showProgress) clear_current_line(cout);
 }
 
 
@@ -186,8 +153,27 @@ void try_to_rank_unranked_targets(taxonomy_cache& taxonomy, const build_options&
                  << " targets are unranked." << endl;
         }
 
+        // collect accessions (names) of all targets, i.e., all sequence ids
+        // from the reference headers, so that mapping files can be filtered
+        auto accTaxa = std::vector<const taxon*>{};
+        accTaxa.reserve(taxonomy.target_taxon_count());
+        for (const auto& tax : taxonomy.target_taxa()) {
+            accTaxa.push_back(&tax);
+        }
+        std::sort(accTaxa.begin(), accTaxa.end(),
+            [](const taxon* a, const taxon* b) { return a->name() < b->name(); });
+
+        auto accessions = std::vector<string>{};
+        accessions.reserve(accTaxa.size());
+        for (const taxon* tax : accTaxa) {
+            accessions.push_back(tax->name());
+        }
+
         for (const auto& file : opt.taxonomy.mappingPostFiles) {
-            rank_targets_with_mapping_file(taxonomy, unranked, file, opt.infoLevel);
+            rank_targets_with_mapping_file(taxonomy, unranked,
+                                           accessions, accTaxa,
+                                           file, opt.infoLevel,
+                                           opt.numThreads);
             if (unranked.empty()) break;
         }
     }
@@ -234,12 +220,38 @@ taxon_id find_taxon_id(
 
 
 
+/*************************************************************************//**
+ *
+ * @return true, if sketches were made with the database's sketching parameters
+ *
+ *****************************************************************************/
+bool sketching_compatible(const database& db, const sketch_reader& reader)
+{
+    const auto& dbSk = db.target_sketching();
+    const auto& fileSk = reader.sketching();
+
+    return dbSk.kmerlen   == fileSk.kmerlen   &&
+           dbSk.sketchlen == fileSk.sketchlen &&
+           dbSk.winlen    == fileSk.winlen    &&
+           dbSk.winstride == fileSk.winstride;
+}
+
+
+
 // ---------------------------------------------------------------------------
 struct input_sequence {
     sequence_reader::header_type header;
+#ifndef GPU_MODE
+    // 2-bit packed: less data to move from readers to database workers
+    packed_sequence data;
+#else
     sequence_reader::data_type data;
+#endif
     database::file_source fileSource;
     taxon_id fileTaxId = 0;
+    // pre-computed window sketches (used instead of sequence data)
+    target_sketches sketches;
+    bool fromSketchFile = false;
 };
 
 using input_batch = std::vector<input_sequence>;
@@ -259,12 +271,33 @@ bool add_targets_to_database(
     input_batch& batch,
     const std::map<string,taxon_id>& sequ2taxid,
     sequence_id_type seqIdType,
+    sketch_writer* sketchOut,
     info_level infoLvl)
 {
     for (auto& seq : batch) {
         if (!db.check_load_factor(dbPart)) return false;
         if (db.add_target_failed(dbPart)) return false;
 
+#ifndef GPU_MODE
+        if (seq.fromSketchFile) {
+            bool added = db.add_target(dbPart, seq.sketches);
+
+            if (infoLvl == info_level::verbose) {
+                cout << "        [" << seq.sketches.name;
+                if (seq.sketches.parentTaxid > 0) cout << ":" << seq.sketches.parentTaxid;
+                cout << "]  " << seq.sketches.window_count() << " windows";
+                if (added) {
+                    cout << endl;
+                } else {
+                    cout << "  --  not added to database!" << endl;
+                }
+            }
+
+            seq.sketches.clear();
+            continue;
+        }
+#endif
+
         if (!seq.data.empty()) {
             auto seqId = extract_accession_string(seq.header, seqIdType);
 
@@ -281,8 +314,13 @@ bool add_targets_to_database(
                 parentTaxId = extract_taxon_id(seq.header);
 
             // try to add to database
+#ifndef GPU_MODE
+            bool added = db.add_target(
+                dbPart, seq.data, seqId, parentTaxId, seq.fileSource, sketchOut);
+#else
             bool added = db.add_target(
                 dbPart, seq.data, seqId, parentTaxId, seq.fileSource);
+#endif
 
             if (infoLvl == info_level::verbose) {
                 cout << "        [" << seqId;
@@ -313,20 +351,51 @@ void add_targets_to_database(database& db,
     const std::vector<string>& infiles,
     const std::map<string,taxon_id>& sequ2taxid,
     sequence_id_type seqIdType,
+    const string& sketchFile,
+    unsigned numThreads,
     info_level infoLvl)
 {
+    // one sketch output file per database part
+    std::vector<std::unique_ptr<sketch_writer>> sketchWriters;
+#ifndef GPU_MODE
+    // a database built without some of its references would be wrong
+    for (const auto& filename : infiles) {
+        if (is_sketch_file(filename) &&
+            !sketching_compatible(db, sketch_reader{filename}))
+        {
+            throw std::runtime_error{"Sketching parameters of '" + filename +
+                                     "' differ from the database's!"};
+        }
+    }
+
+    if (!sketchFile.empty()) {
+        for (part_id part = 0; part < db.num_parts(); ++part) {
+            sketchWriters.emplace_back(std::make_unique<sketch_writer>(
+                db.num_parts() > 1 ? sketchFile + "_" + std::to_string(part)
+                                   : sketchFile,
+                db.target_sketching()));
+        }
+    }
+#endif
+
     // make executor that runs database insertion (concurrently) in batches
     // IMPORTANT: do not use more than one worker thread!
     batch_processing_options<input_sequence> execOpt;
     execOpt.batch_size(8);
     execOpt.queue_size(8);
+    // parts that are idle take over targets from other parts' batches
+    execOpt.min_split_size(1);
 #ifndef GPU_MODE
     execOpt.concurrency(db.num_parts(), db.num_parts());
 #else
     execOpt.concurrency(8, db.num_parts());
 #endif
 
+    // sketch files are only finished if all targets were added
+    std::atomic<bool> allAdded{true};
+
     execOpt.on_error([&] (std::exception& e) {
+        allAdded = false;
         if (dynamic_cast<database::target_limit_exceeded_error*>(&e)) {
             cout << endl;
             cerr << "! Reached maximum number of targets per database ("
@@ -341,10 +410,18 @@ void add_targets_to_database(database& db,
 
     execOpt.on_work_done([&] (int id) { db.wait_until_add_target_complete(id); });
 
-    batch_executor<input_sequence> executor { execOpt,
+    auto executor = std::make_unique<batch_executor<input_sequence>>(execOpt,
         [&] (int id, auto& batch) {
-            return add_targets_to_database(db, id, batch, sequ2taxid, seqIdType, infoLvl);
-        }};
+            auto sketchOut = sketchWriters.empty() ? nullptr : sketchWriters[id].get();
+            if (add_targets_to_database(db, id, batch, sequ2taxid, seqIdType,
+                                        sketchOut, infoLvl))
+            {
+                return true;
+            }
+            // remaining targets of batch are dropped
+            allAdded = false;
+            return false;
+        });
 
     // spawn threads to read sequences
     std::vector<std::future<void>> producers;
@@ -353,10 +430,14 @@ void add_targets_to_database(database& db,
     readingProgress.total = numFiles;
     std::mutex outputMtx;
 
+    // input files are read (and decompressed) concurrently
+    const unsigned maxReadThreads = std::max(1U,
+        numThreads / unsigned(std::max(1, execOpt.num_producers())));
+
     for (int producerId = 0; producerId < execOpt.num_producers(); ++producerId) {
         producers.emplace_back(std::async(std::launch::async, [&, producerId] {
             auto fileId = readingProgress.counter++;
-            while (fileId < numFiles && executor.valid()) {
+            while (fileId < numFiles && executor->valid()) {
                 const auto& filename = infiles[fileId];
                 if (infoLvl == info_level::verbose) {
                     std::lock_guard<std::mutex> lock(outputMtx);
@@ -365,6 +446,22 @@ void add_targets_to_database(database& db,
                 }
 
                 try {
+#ifndef GPU_MODE
+                    if (is_sketch_file(filename)) {
+                        // sketching parameters were checked before
+                        sketch_reader reader{filename};
+
+                        while (reader.has_next() && executor->valid()) {
+                            // get (ref to) next input storage and fill it
+                            auto& seq = executor->next_item(producerId);
+                            seq.fromSketchFile = true;
+                            reader.next(seq.sketches);
+                        }
+
+                        fileId = readingProgress.counter++;
+                        continue;
+                    }
+#endif
                     auto fileAccession = extract_accession_string(filename, seqIdType);
                     taxon_id fileTaxId = find_taxon_id(sequ2taxid, fileAccession);
 
@@ -381,11 +478,12 @@ void add_targets_to_database(database& db,
                              << "' -> taxid " << fileTaxId << endl;
                     }
 
-                    sequence_reader reader{filename};
+                    sequence_reader reader{filename, maxReadThreads};
 
-                    while (reader.has_next() && executor.valid()) {
+                    while (reader.has_next() && executor->valid()) {
                         // get (ref to) next input sequence storage and fill it
-                        auto& seq = executor.next_item(producerId);
+                        auto& seq = executor->next_item(producerId);
+                        seq.fromSketchFile = false;
                         seq.fileSource.filename = filename;
                         seq.fileSource.index = reader.index();
                         seq.fileTaxId = fileTaxId;
@@ -402,7 +500,7 @@ void add_targets_to_database(database& db,
                 fileId = readingProgress.counter++;
             }
 
-            executor.finalize_producer(producerId);
+            executor->finalize_producer(producerId);
         }));
     }
 
@@ -415,11 +513,19 @@ void add_targets_to_database(database& db,
         }
     }
 
+    // wait until all batches are processed
+    executor.reset();
+
     float progress = readingProgress.progress();
     if (progress < 1.0f) {
         cout << "WARNING: Could only only process " << 100*progress << "% of input files." << endl;
     }
 
+    // unfinished sketch files of incomplete builds are rejected by readers
+    if (progress >= 1.0f && allAdded) {
+        for (auto& writer : sketchWriters) writer->finish();
+    }
+
     db.taxo_cache().mark_cached_lineages_outdated();
 }
 
@@ -450,7 +556,9 @@ void prepare_database(database& db, const build_options& opt)
             make_taxonomic_hierarchy(opt.taxonomy.nodesFile,
                                      opt.taxonomy.namesFile,
                                      opt.taxonomy.mergeFile,
-                                     opt.infoLevel) );
+                                     opt.taxonomy.snapshotFile,
+                                     opt.infoLevel,
+                                     opt.numThreads) );
 
         if (opt.infoLevel != info_level::silent) {
             cout << "Taxonomy applied to database." << endl;
@@ -477,7 +585,7 @@ void prepare_database(database& db, const build_options& opt)
         }
     }
 
-    db.initialize_hash_table(opt.numDbParts);
+    db.initialize_hash_table(opt.numDbParts, opt.numThreads);
 }
 
 
@@ -585,7 +693,8 @@ void add_to_database(database& db, const build_options& opt, timer& time)
 
 
         add_targets_to_database(db, opt.infiles, taxonMap,
-                                opt.sequenceIdType, opt.infoLevel);
+                                opt.sequenceIdType, opt.sketchFile,
+                                opt.numThreads, opt.infoLevel);
 
         if (notSilent) {
             clear_current_line(cout);
@@ -27,8 +27,11 @@
 #include "candidate_structs.h"
 #include "options.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <limits>
+#include <memory>
+#include <vector>
 
 
 namespace mc {
@@ -127,27 +130,514 @@ void for_all_contiguous_window_ranges(
 
 
 
+/*************************************************************************//**
+ *
+ * @brief  produces the same contiguous window ranges as
+ *         'for_all_contiguous_window_ranges' from *unsorted* matches;
+ *         hits are accumulated in an open addressing hash table keyed by
+ *         target, so that large match lists don't need to be sorted;
+ *         the best range of each target is found with a counting histogram
+ *         over the target's window span (or by sorting only the target's
+ *         windows if the span is much larger than its number of hits);
+ *         targets are processed in ascending order,
+ *         so ties are resolved exactly as for sorted match lists
+ *
+ *         all buffers are kept between invocations, so one accumulator
+ *         per thread should be re-used for all queries
+ *
+ *****************************************************************************/
+template<class Location>
+class target_hits_accumulator
+{
+    using target_id  = decltype(Location::tgt);
+    using window_id  = decltype(Location::win);
+    using hit_count  = match_candidate::count_type;
+    using index_type = std::uint32_t;
+
+    static constexpr target_id  no_target = std::numeric_limits<target_id>::max();
+    static constexpr index_type no_index  = std::numeric_limits<index_type>::max();
+
+    struct target_slot {
+        target_id  tgt   = no_target;
+        index_type head  = no_index;
+        index_type count = 0;
+        window_id  minWin = 0;
+        window_id  maxWin = 0;
+    };
+
+    struct window_hit {
+        window_id  win;
+        index_type next;
+    };
+
+public:
+    //---------------------------------------------------------------
+    target_hits_accumulator():
+        slots_(64), mask_(63)
+    {}
+
+
+    /****************************************************************
+     * @brief  produces all contiguous window ranges of matches
+     *         that are at most 'numWindows' long;
+     *         the main loop is aborted if 'consume' returns false
+     */
+    template<class Locations, class Consumer>
+    void for_all_contiguous_window_ranges(
+        const Locations& matches,
+        window_id numWindows,
+        Consumer&& consume)
+    {
+        for (const auto& loc : matches) {
+            add(loc.tgt, loc.win);
+        }
+
+        std::sort(used_.begin(), used_.end(),
+            [this] (index_type a, index_type b) {
+                return slots_[a].tgt < slots_[b].tgt;
+            });
+
+        for (auto i : used_) {
+            if (!consume(best_range(slots_[i], numWindows))) break;
+        }
+
+        clear();
+    }
+
+
+private:
+    //---------------------------------------------------------------
+    void clear() {
+        for (auto i : used_) slots_[i] = target_slot{};
+        used_.clear();
+        hits_.clear();
+    }
+
+
+    //---------------------------------------------------------------
+    index_type slot_index(target_id tgt) const noexcept {
+        return index_type((std::uint64_t(tgt) * 0x9E3779B97F4A7C15ULL) >> 32) & mask_;
+    }
+
+
+    //---------------------------------------------------------------
+    void add(target_id tgt, window_id win)
+    {
+        auto i = slot_index(tgt);
+        while (slots_[i].tgt != tgt && slots_[i].tgt != no_target) {
+            i = (i + 1) & mask_;
+        }
+
+        auto& slot = slots_[i];
+        if (slot.tgt == no_target) {
+            slot.tgt    = tgt;
+            slot.minWin = win;
+            slot.maxWin = win;
+            used_.push_back(i);
+        }
+        else {
+            if (win < slot.minWin) slot.minWin = win;
+            if (win > slot.maxWin) slot.maxWin = win;
+        }
+        hits_.push_back(window_hit{win, slot.head});
+        slot.head = index_type(hits_.size() - 1);
+        ++slot.count;
+
+        // keep load factor below 1/2
+        if (2 * used_.size() > slots_.size()) grow();
+    }
+
+
+    //---------------------------------------------------------------
+    void grow()
+    {
+        std::vector<target_slot> old (2 * slots_.size());
+        swap(old, slots_);
+        mask_ = index_type(slots_.size() - 1);
+
+        for (auto& u : used_) {
+            const auto& slot = old[u];
+            auto i = slot_index(slot.tgt);
+            while (slots_[i].tgt != no_target) {
+                i = (i + 1) & mask_;
+            }
+            slots_[i] = slot;
+            u = i;
+        }
+    }
+
+
+    //---------------------------------------------------------------
+    match_candidate
+    best_range(const target_slot& slot, window_id numWindows)
+    {
+        match_candidate best;
+        best.tax  = nullptr;
+        best.tgt  = slot.tgt;
+        best.hits = 0;
+
+        const std::size_t span = std::size_t(slot.maxWin - slot.minWin) + 1;
+
+        // dense window span: count hits per window
+        if (numWindows > 0 && span <= 64 + 4 * std::size_t(slot.count)) {
+            counts_.assign(span, 0);
+            for (auto h = slot.head; h != no_index; h = hits_[h].next) {
+                ++counts_[hits_[h].win - slot.minWin];
+            }
+
+            hit_count hits = 0;
+            std::size_t fst = 0;
+            for (std::size_t lst = 0; lst < span; ++lst) {
+                // subtract hits to the left that fall out of range
+                if (lst >= numWindows) hits -= counts_[lst - numWindows];
+
+                if (counts_[lst] == 0) continue;
+                hits += counts_[lst];
+
+                if (hits > best.hits) {
+                    // left side of range is first occupied window in range
+                    const std::size_t lo = lst + 1 > numWindows ? lst + 1 - numWindows : 0;
+                    if (fst < lo) fst = lo;
+                    while (counts_[fst] == 0) ++fst;
+
+                    best.hits    = hits;
+                    best.pos.beg = window_id(slot.minWin + fst);
+                    best.pos.end = window_id(slot.minWin + lst);
+                }
+            }
+        }
+        // sparse window span: sort windows of this target only
+        else {
+            wins_.clear();
+            for (auto h = slot.head; h != no_index; h = hits_[h].next) {
+                wins_.push_back(hits_[h].win);
+            }
+            std::sort(wins_.begin(), wins_.end());
+
+            hit_count hits = 0;
+            std::size_t fst = 0;
+            for (std::size_t lst = 0; lst < wins_.size(); ++lst) {
+                hits++;
+                while (fst != lst && (wins_[lst] - wins_[fst]) >= numWindows) {
+                    hits--;
+                    ++fst;
+                }
+                if (hits > best.hits) {
+                    best.hits    = hits;
+                    best.pos.beg = wins_[fst];
+                    best.pos.end = wins_[lst];
+                }
+            }
+        }
+
+        return best;
+    }
+
+
+    //---------------------------------------------------------------
+    std::vector<target_slot> slots_;
+    index_type mask_;
+    std::vector<index_type> used_;
+    std::vector<window_hit> hits_;
+    std::vector<hit_count> counts_;
+    std::vector<window_id> wins_;
+};
+
+
+
+/*************************************************************************//**
+*
+* @brief bounded heap of candidates with the worst candidate on top;
+*        candidates with equal hits are ordered by the time of their
+*        last insertion or update (earlier is better);
+*        optionally keeps an open addressing index (taxon -> heap slot),
+*        so that candidates of the same taxon can be found in O(1)
+*
+*****************************************************************************/
+class candidate_heap
+{
+    using stamp_type = std::uint64_t;
+    using index_type = std::uint32_t;
+
+    static constexpr index_type no_slot = std::numeric_limits<index_type>::max();
+
+    struct entry {
+        match_candidate cand;
+        stamp_type stamp;
+    };
+
+    struct index_slot {
+        const taxon* tax = nullptr;
+        index_type pos = no_slot;
+    };
+
+public:
+    using size_type = std::size_t;
+
+    static constexpr size_type npos = std::numeric_limits<size_type>::max();
+
+
+    //---------------------------------------------------------------
+    /** @brief initializes heap from list sorted by hits (best first) */
+    void assign(const std::vector<match_candidate>& sorted, bool indexed)
+    {
+        heap_.clear();
+        stamp_ = 0;
+        for (const auto& cand : sorted) {
+            heap_.push_back(entry{cand, stamp_++});
+        }
+        // a list sorted from worst to best is also a valid heap
+        std::reverse(heap_.begin(), heap_.end());
+
+        indexed_ = indexed;
+        index_.clear();
+        if (indexed_) {
+            index_.resize(min_index_size(heap_.size()));
+            for (size_type i = 0; i < heap_.size(); ++i) {
+                index_insert(heap_[i].cand.tax, index_type(i));
+            }
+        }
+    }
+
+
+    //---------------------------------------------------------------
+    size_type size() const noexcept { return heap_.size(); }
+
+    const match_candidate& worst() const noexcept { return heap_.front().cand; }
+
+
+    //---------------------------------------------------------------
+    /** @return heap position of taxon's candidate or npos */
+    size_type find(const taxon* tax) const noexcept
+    {
+        if (!indexed_) return npos;
+        const auto i = index_find(tax);
+        return index_[i].tax == tax ? size_type(index_[i].pos) : npos;
+    }
+
+    const match_candidate& operator [] (size_type pos) const noexcept {
+        return heap_[pos].cand;
+    }
+
+
+    //---------------------------------------------------------------
+    void push(const match_candidate& cand)
+    {
+        heap_.push_back(entry{cand, stamp_++});
+        if (indexed_) {
+            if (2 * heap_.size() > index_.size()) grow_index();
+            index_insert(cand.tax, index_type(heap_.size() - 1));
+        }
+        sift_up(heap_.size() - 1);
+    }
+
+
+    //---------------------------------------------------------------
+    void pop_worst()
+    {
+        if (indexed_) index_erase(heap_.front().cand.tax);
+
+        if (heap_.size() > 1) {
+            heap_.front() = heap_.back();
+            heap_.pop_back();
+            sift_down(0);
+        }
+        else {
+            heap_.pop_back();
+        }
+    }
+
+
+    //---------------------------------------------------------------
+    /** @pre replacement must not be worse than current candidate */
+    void improve(size_type pos, const match_candidate& cand)
+    {
+        heap_[pos] = entry{cand, stamp_++};
+        sift_down(pos);
+    }
+
+
+    //---------------------------------------------------------------
+    /** @brief writes candidates sorted by hits (best first) to 'out' */
+    void sorted(std::vector<match_candidate>& out)
+    {
+        // a list sorted from worst to best is also a valid heap
+        std::sort(heap_.begin(), heap_.end(), worse);
+        if (indexed_) {
+            for (size_type i = 0; i < heap_.size(); ++i) {
+                index_[index_find(heap_[i].cand.tax)].pos = index_type(i);
+            }
+        }
+        out.clear();
+        for (auto i = heap_.rbegin(); i != heap_.rend(); ++i) {
+            out.push_back(i->cand);
+        }
+    }
+
+
+private:
+    //---------------------------------------------------------------
+    static bool worse(const entry& a, const entry& b) noexcept {
+        return a.cand.hits < b.cand.hits ||
+              (a.cand.hits == b.cand.hits && a.stamp > b.stamp);
+    }
+
+
+    //---------------------------------------------------------------
+    void place(size_type pos, const entry& e) {
+        heap_[pos] = e;
+        if (indexed_) index_[index_find(e.cand.tax)].pos = index_type(pos);
+    }
+
+    void sift_up(size_type pos)
+    {
+        const entry e = heap_[pos];
+        while (pos > 0) {
+            const auto parent = (pos - 1) / 2;
+            if (!worse(e, heap_[parent])) break;
+            place(pos, heap_[parent]);
+            pos = parent;
+        }
+        place(pos, e);
+    }
+
+    void sift_down(size_type pos)
+    {
+        const entry e = heap_[pos];
+        const auto n = heap_.size();
+        for (auto child = 2*pos + 1; child < n; child = 2*pos + 1) {
+            if (child + 1 < n && worse(heap_[child+1], heap_[child])) ++child;
+            if (!worse(heap_[child], e)) break;
+            place(pos, heap_[child]);
+            pos = child;
+        }
+        place(pos, e);
+    }
+
+
+    //---------------------------------------------------------------
+    static size_type min_index_size(size_type n) {
+        size_type s = 32;
+        while (s < 2 * n) s *= 2;
+        return s;
+    }
+
+    size_type index_hash(const taxon* tax) const noexcept {
+        const auto h = std::uint64_t(reinterpret_cast<std::uintptr_t>(tax))
+                       * 0x9E3779B97F4A7C15ULL;
+        return size_type(h >> 32) & (index_.size() - 1);
+    }
+
+    /** @return slot of taxon or first empty slot in its probe sequence */
+    size_type index_find(const taxon* tax) const noexcept {
+        const auto mask = index_.size() - 1;
+        auto i = index_hash(tax);
+        while (index_[i].tax != tax && index_[i].tax != nullptr) {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    void index_insert(const taxon* tax, index_type pos) {
+        const auto i = index_find(tax);
+        index_[i].tax = tax;
+        index_[i].pos = pos;
+    }
+
+    /** @brief backward shift deletion (no tombstones needed) */
+    void index_erase(const taxon* tax)
+    {
+        const auto mask = index_.size() - 1;
+        auto i = index_find(tax);
+        if (index_[i].tax != tax) return;
+
+        for (auto j = (i + 1) & mask; index_[j].tax != nullptr; j = (j + 1) & mask) {
+            const auto home = index_hash(index_[j].tax);
+            // move slot j to i if i lies cyclically in [home, j)
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                index_[i] = index_[j];
+                i = j;
+            }
+        }
+        index_[i] = index_slot{};
+    }
+
+    void grow_index() {
+        std::vector<index_slot> old (2 * index_.size());
+        swap(old, index_);
+        for (const auto& s : old) {
+            if (s.tax) index_insert(s.tax, s.pos);
+        }
+    }
+
+
+    //---------------------------------------------------------------
+    std::vector<entry> heap_;
+    std::vector<index_slot> index_;
+    stamp_type stamp_ = 0;
+    bool indexed_ = false;
+};
+
+
+
+
 /*************************************************************************//**
 *
 * @brief processes a database match list and
 *        stores contiguous window ranges of *distinct* targets
 *        as a list *sorted* by accumulated hits
 *
+*        small numbers of candidates are kept in a sorted list;
+*        larger ones in a bounded heap with a taxon index
+*        that is only sorted when the candidates are accessed
+*
 *****************************************************************************/
 class best_distinct_matches_in_contiguous_window_ranges
 {
     using candidates_list  = std::vector<match_candidate>;
 
+    // list size from which on a heap is used
+    static constexpr std::size_t min_heap_size = 32;
+
 public:
     using size_type      = std::size_t;
     using iterator       = candidates_list::iterator;
     using const_iterator = candidates_list::const_iterator;
 
 
+    //---------------------------------------------------------------
+    best_distinct_matches_in_contiguous_window_ranges() = default;
+
+    best_distinct_matches_in_contiguous_window_ranges(
+        const best_distinct_matches_in_contiguous_window_ranges& src)
+    :
+        top_(src.top_),
+        heap_(src.heap_ ? std::make_unique<candidate_heap>(*src.heap_) : nullptr),
+        listValid_(src.listValid_)
+    {}
+
+    best_distinct_matches_in_contiguous_window_ranges(
+        best_distinct_matches_in_contiguous_window_ranges&&) = default;
+
+    best_distinct_matches_in_contiguous_window_ranges&
+    operator = (const best_distinct_matches_in_contiguous_window_ranges& src) {
+        if (&src != this) {
+            top_ = src.top_;
+            heap_ = src.heap_ ? std::make_unique<candidate_heap>(*src.heap_) : nullptr;
+            listValid_ = src.listValid_;
+        }
+        return *this;
+    }
+
+    best_distinct_matches_in_contiguous_window_ranges&
+    operator = (best_distinct_matches_in_contiguous_window_ranges&&) = default;
+
+
     /****************************************************************
      * @brief copy candidates from span
      */
     void assign(const span<const match_candidate> cand) {
+        heap_.reset();
         top_.assign(cand.begin(), cand.end());
     }
 
@@ -162,7 +652,8 @@ public:
         const candidate_generation_rules& rules = candidate_generation_rules{})
     {
         if (rules.maxCandidates < std::numeric_limits<std::size_t>::max())
-            top_.reserve(rules.maxCandidates+1);
+            top_.reserve((rules.maxCandidates < min_heap_size
+                          ? rules.maxCandidates : min_heap_size) + 1);
 
         for_all_contiguous_window_ranges(matches, rules.maxWindowsInRange,
             [&,this] (match_candidate& cand) {
@@ -178,6 +669,8 @@ public:
                 const taxonomy_cache& taxonomy,
                 const candidate_generation_rules& rules = candidate_generation_rules{})
     {
+        if (heap_) return insert_into_heap(cand, taxonomy, rules);
+
         // early exit
         if (top_.size() == rules.maxCandidates && top_.back().hits >= cand.hits) return true;
 
@@ -195,6 +688,12 @@ public:
                        };
 
         if (rules.mergeBelow == taxon_rank::Sequence) {
+            // large list: continue with heap
+            if (top_.size() >= min_heap_size && rules.maxCandidates > top_.size()) {
+                make_heap(rules);
+                return insert_into_heap(cand, taxonomy, rules);
+            }
+
             auto i = std::upper_bound(top_.begin(), top_.end(), cand, greater);
 
             if (i != top_.end() || top_.size() < rules.maxCandidates) {
@@ -215,11 +714,18 @@ public:
                 // taxon already in list, update, if more hits
                 if (cand.hits > i->hits) {
                     *i = cand;
-                    std::sort(top_.begin(), i+1, greater);
+                    // move behind all candidates with at least as many hits
+                    std::rotate(std::upper_bound(top_.begin(), i, cand, greater), i, i+1);
                 }
             }
             // taxon not in list yet
             else {
+                // large list: continue with heap
+                if (top_.size() >= min_heap_size && rules.maxCandidates > top_.size()) {
+                    make_heap(rules);
+                    return insert_into_heap(cand, taxonomy, rules);
+                }
+
                 auto j = std::upper_bound(top_.begin(), top_.end(), cand, greater);
 
                 if (j != top_.end() || top_.size() < rules.maxCandidates) {
@@ -236,23 +742,95 @@ public:
 
 
     //---------------------------------------------------------------
-    auto begin() const noexcept { return top_.begin(); }
-    auto end()   const noexcept { return top_.end(); }
+    // candidates kept in a heap are sorted on first access,
+    // so read access is non-const (and not thread-safe)
+    const_iterator begin() { return list().begin(); }
+    const_iterator end()   { return list().end(); }
 
-    bool empty()     const noexcept { return top_.empty(); }
-    size_type size() const noexcept { return top_.size(); }
+    bool empty()     const noexcept { return heap_ ? heap_->size() == 0 : top_.empty(); }
+    size_type size() const noexcept { return heap_ ? heap_->size() : top_.size(); }
 
-    void clear() { top_.clear(); }
+    void clear() {
+        heap_.reset();
+        top_.clear();
+    }
 
     const match_candidate&
-    operator [] (size_type i) const noexcept { return top_[i]; }
+    operator [] (size_type i) { return list()[i]; }
+
+    iterator erase(const_iterator pos) {
+        // list is modified directly, so heap can't be kept
+        heap_.reset();
+        return top_.erase(pos);
+    }
 
-    iterator erase(const_iterator pos) { return top_.erase(pos); }
+    auto view() { return span<const match_candidate>(list()); }
 
-    auto view() const noexcept { return span<const match_candidate>(top_); }
 
 private:
+    //---------------------------------------------------------------
+    void make_heap(const candidate_generation_rules& rules) {
+        heap_ = std::make_unique<candidate_heap>();
+        heap_->assign(top_, rules.mergeBelow != taxon_rank::Sequence);
+        listValid_ = true;
+    }
+
+
+    //---------------------------------------------------------------
+    bool insert_into_heap(match_candidate cand,
+                          const taxonomy_cache& taxonomy,
+                          const candidate_generation_rules& rules)
+    {
+        auto& heap = *heap_;
+
+        // early exit
+        if (heap.size() == rules.maxCandidates && heap.worst().hits >= cand.hits) return true;
+
+        if (!cand.tax) {
+            if (rules.mergeBelow > taxon_rank::Sequence)
+                cand.tax = taxonomy.lowest_ranked_ancestor(cand.tgt, rules.mergeBelow);
+            else
+                cand.tax = taxonomy.cached_taxon_of_target(cand.tgt);
+        }
+
+        if (!cand.tax) return true;
+
+        if (rules.mergeBelow != taxon_rank::Sequence) {
+            const auto i = heap.find(cand.tax);
+            if (i != candidate_heap::npos) {
+                // taxon already in heap, update, if more hits
+                if (cand.hits > heap[i].hits) {
+                    heap.improve(i, cand);
+                    listValid_ = false;
+                }
+                return true;
+            }
+        }
+
+        // not full or better than worst candidate (see early exit)
+        heap.push(cand);
+        if (heap.size() > rules.maxCandidates) heap.pop_worst();
+        listValid_ = false;
+
+        return true;
+    }
+
+
+    //---------------------------------------------------------------
+    const candidates_list& list() {
+        if (heap_ && !listValid_) {
+            heap_->sorted(top_);
+            listValid_ = true;
+        }
+        return top_;
+    }
+
+
+    //---------------------------------------------------------------
     candidates_list top_;
+    // only used for large numbers of candidates
+    std::unique_ptr<candidate_heap> heap_;
+    bool listValid_ = true;
 };
 
 
@@ -31,12 +31,19 @@
 #include "options.h"
 #include "printing.h"
 #include "database_query.h"
+#include "reference_cache.h"
+#include "result_io.h"
 #include "sequence_io.h"
 #include "sequence_view.h"
 #include "span.h"
 
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <future>
 #include <iterator>
+#include <limits>
+#include <memory>
 #include <sstream>
 #include <unordered_map>
 #include <unordered_set>
@@ -51,18 +58,63 @@ using std::cerr;
 
 /*************************************************************************//**
  *
- * @brief makes non-owning view to (sub)sequence
+ * @brief makes sequence with a copy of a query sequence view
  *
  *****************************************************************************/
-template<class Sequence>
-inline auto
-make_view_from_window_range (const Sequence& s, const window_range& range,
-                             int size, int stride)
+sequence
+make_sequence (const sequence_query::view_type& v)
 {
-    auto end = s.begin() + (stride * range.end) + size;
-    if (end > s.end()) end = s.end();
+    sequence s;
+    s.append(v.begin(), v.size());
+    return s;
+}
+
 
-    return make_view(s.begin() + (stride * range.beg), end);
+
+/*************************************************************************//**
+ *
+ * @brief query sequences in both orientations
+ *
+ *****************************************************************************/
+struct stranded_query
+{
+    explicit
+    stranded_query(const sequence_query& q):
+        query{q},
+        seq1r{make_reverse_complement(make_sequence(q.seq1))},
+        seq2r{q.seq2.empty() ? sequence{}
+                             : make_reverse_complement(make_sequence(q.seq2))}
+    {}
+
+    const sequence_query& query;
+    sequence seq1r;
+    sequence seq2r;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief semi-global alignment scores of a query (pair)
+ *        in forward and reverse complement orientation
+ *
+ *****************************************************************************/
+template<class Subject>
+std::pair<default_alignment_scheme::score_type,
+          default_alignment_scheme::score_type>
+semi_global_alignment_scores (const stranded_query& q, const Subject& subject)
+{
+    const auto scheme = default_alignment_scheme{};
+
+    auto score  = align_semi_global_score(q.query.seq1, subject, scheme);
+    auto scorer = align_semi_global_score(q.seq1r, subject, scheme);
+
+    // align paired read as well
+    if (!q.query.seq2.empty()) {
+        score  += align_semi_global_score(q.query.seq2, subject, scheme);
+        scorer += align_semi_global_score(q.seq2r, subject, scheme);
+    }
+    return {score, scorer};
 }
 
 
@@ -77,30 +129,20 @@ alignment<default_alignment_scheme::score_type,typename sequence::value_type>
 make_semi_global_alignment (const sequence_query& query,
                             const Subject& subject)
 {
-    std::size_t score  = 0;
-    std::size_t scorer = 0;
-
-    const auto scheme = default_alignment_scheme{};
+    const auto q = stranded_query{query};
 
-    // compute alignment
-    auto align = align_semi_global(query.seq1, subject, scheme);
-    score = align.score;
-    // reverse complement
-    auto query1r = make_reverse_complement(query.seq1);
-    auto alignr = align_semi_global(query1r, subject, scheme);
-    scorer = alignr.score;
+    // compare scores of both strands first
+    const auto scores = semi_global_alignment_scores(q, subject);
 
-    // align paired read as well
-    if (!query.seq2.empty()) {
-        score += align_semi_global_score(query.seq2, subject, scheme);
-        auto query2r = make_reverse_complement(query.seq2);
-        scorer += align_semi_global_score(query2r, subject, scheme);
-    }
-
-    return (score > scorer) ? align : alignr;
+    // backtrace only best alignment
+    const auto scheme = default_alignment_scheme{};
+    return (scores.first > scores.second)
+        ? align_semi_global(query.seq1, subject, scheme)
+        : align_semi_global(q.seq1r, subject, scheme);
 }
 
 
+
 /*************************************************************************//**
  *
  * @brief returns query taxon (ground truth for precision tests)
@@ -219,7 +261,8 @@ make_classification (
     cls.best = classify(taxonomy, optClassify, candidates);
 
     if (makeGroundTruth) {
-        cls.groundTruth = ground_truth(taxonomy, query.header);
+        cls.groundTruth = ground_truth(taxonomy,
+            string(query.header.begin(), query.header.end()));
     }
 
     return cls;
@@ -371,6 +414,85 @@ void estimate_abundance (const taxonomy_cache& taxonomy,
 
 
 
+/*************************************************************************//**
+ *
+ * @brief reference sequence range covered by the windows of a candidate
+ *
+ *****************************************************************************/
+sequence
+candidate_reference_range (const sketching_opt& targetSketching,
+                           reference_cache& references,
+                           const match_candidate& cand)
+{
+    const auto& src = cand.tax->source();
+    const auto w = targetSketching.winstride;
+
+    return references.subsequence(src.filename, src.index,
+        std::size_t(w) * cand.pos.beg,
+        std::size_t(w) * cand.pos.end + targetSketching.winlen);
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief verifies top candidates by semi-global alignment of the query
+ *        to their reference sequence ranges;
+ *        verified candidates with a lower score than the best one
+ *        are removed; all other candidates keep their order (by hits),
+ *        including those that can't be aligned (e.g. missing reference
+ *        files) and those beyond the top ones
+ *
+ *****************************************************************************/
+void verify_candidates (const sketching_opt& targetSketching,
+                        const classification_options& opt,
+                        reference_cache& references,
+                        const sequence_query& query,
+                        const span<const match_candidate> candidates,
+                        vector<match_candidate>& verified)
+{
+    using score_type = default_alignment_scheme::score_type;
+
+    constexpr auto unverified = std::numeric_limits<score_type>::lowest();
+
+    const auto numVerify = std::min(candidates.size(), opt.verifyTopCandidates);
+    const auto q = stranded_query{query};
+
+    vector<score_type> scores(numVerify, unverified);
+    score_type best = unverified;
+
+    for (std::size_t i = 0; i < numVerify; ++i) {
+        const auto& cand = candidates[i];
+        if (!cand.tax || cand.tax->rank() != taxon_rank::Sequence) continue;
+        try {
+            const auto subject = candidate_reference_range(
+                                     targetSketching, references, cand);
+            if (!subject.empty()) {
+                const auto s = semi_global_alignment_scores(q, subject);
+                scores[i] = std::max(s.first, s.second);
+                best = std::max(best, scores[i]);
+            }
+        }
+        catch (std::exception& e) {
+            const auto& filename = cand.tax->source().filename;
+            if (references.first_failure(filename)) {
+                cerr << "Could not verify candidates of reference file '"
+                     << filename << "': " << e.what() << '\n';
+            }
+        }
+    }
+
+    verified.clear();
+    verified.reserve(candidates.size());
+
+    for (std::size_t i = 0; i < candidates.size(); ++i) {
+        if (i < numVerify && scores[i] != unverified && scores[i] < best) continue;
+        verified.push_back(candidates[i]);
+    }
+}
+
+
+
 /*************************************************************************//**
  *
  * @brief compute alignment of top hits and optionally show it
@@ -379,6 +501,7 @@ void estimate_abundance (const taxonomy_cache& taxonomy,
 void show_alignment (std::ostream& os,
                      const sketching_opt& targetSketching,
                      const classification_output_options& opt,
+                     reference_cache& references,
                      const sequence_query& query,
                      const span<const match_candidate> tophits)
 {
@@ -387,28 +510,25 @@ void show_alignment (std::ostream& os,
     if (tgtTax && tgtTax->rank() == taxon_rank::Sequence) {
         const auto& src = tgtTax->source();
         try {
-            // load candidate file and forward to sequence
-            sequence_reader reader{src.filename};
-            reader.skip(src.index-1);
-
-            if (reader.has_next()) {
-                auto tgtSequ = reader.next().data;
-                auto subject = make_view_from_window_range(
-                               tgtSequ, tophits[0].pos,
-                               targetSketching.winlen,
-                               targetSketching.winstride);
+            // reference sequence range of top candidate
+            const auto w = targetSketching.winstride;
+            const auto subject = candidate_reference_range(
+                                     targetSketching, references, tophits[0]);
 
+            if (!subject.empty()) {
                 auto align = make_semi_global_alignment(query, subject);
 
+                // fetched range is clamped to the reference length
+                const auto beg = std::size_t(w) * tophits[0].pos.beg;
+                const auto end = beg + subject.size();
+
                 // print alignment to top candidate
-                const auto w = targetSketching.winstride;
                 const auto& comment = opt.format.tokens.comment;
                 os  << '\n'
                     << comment << "  score  " << align.score
                     << "  aligned to "
                     << src.filename << " #" << src.index
-                    << " in range [" << (w * tophits[0].pos.beg)
-                    << ',' << (w * tophits[0].pos.end + w) << "]\n"
+                    << " in range [" << beg << ',' << end << "]\n"
                     << comment << "  query  " << align.query << '\n'
                     << comment << "  target " << align.subject;
             }
@@ -462,8 +582,10 @@ void show_query_mapping_header(std::ostream& os,
  *
  *****************************************************************************/
 void show_query_mapping(
-    std::ostream& os,
+    print_buffer& os,
     const database& db,
+    const taxon_formatter& taxonFmt,
+    reference_cache& references,
     const classification_output_options& opt,
     const sequence_query& query,
     const classification& cls,
@@ -483,18 +605,12 @@ void show_query_mapping(
     if (fmt.showQueryIds) os << query.id << colsep;
 
     // print query header (first contiguous string only)
-    auto l = query.header.find(' ');
-    if (l != string::npos) {
-        auto oit = std::ostream_iterator<char>{os, ""};
-        std::copy(query.header.begin(), query.header.begin() + l, oit);
-    }
-    else {
-        os << query.header;
-    }
+    const auto l = std::find(query.header.begin(), query.header.end(), ' ');
+    os.write(query.header.begin(), l - query.header.begin());
     os << colsep;
 
     if (opt.evaluate.showGroundTruth) {
-        show_taxon(os, db.taxo_cache(), opt.format, cls.groundTruth);
+        taxonFmt.print(os, cls.groundTruth);
         os << colsep;
     }
     if (opt.analysis.showAllHits) {
@@ -510,10 +626,13 @@ void show_query_mapping(
         os << colsep;
     }
 
-    show_taxon(os, db.taxo_cache(), fmt, cls.best);
+    taxonFmt.print(os, cls.best);
 
     if (opt.analysis.showAlignment && cls.best) {
-        show_alignment(os, db.target_sketching(), opt, query, candidates);
+        std::ostringstream alignment;
+        show_alignment(alignment, db.target_sketching(), opt, references,
+                       query, candidates);
+        os << alignment.str();
     }
 
     os << '\n';
@@ -521,10 +640,28 @@ void show_query_mapping(
 
 
 
+/*************************************************************************//**
+ *
+ * @brief text and (optional) binary per-read output of queries
+ *
+ *****************************************************************************/
+struct output_buffers
+{
+    void clear() noexcept {
+        text.clear();
+        binary.clear();
+    }
+
+    print_buffer text;
+    print_buffer binary;
+};
+
+
+
 /*************************************************************************//**
  *
  * @brief create and evaluate final classification,
- *        store output into buffer
+ *        store output into buffers
  *
  *****************************************************************************/
 void classify_and_evaluate(
@@ -533,14 +670,27 @@ void classify_and_evaluate(
     const span<const location> allhits,
     const database& db,
     const query_options& opt,
+    const taxon_formatter& taxonFmt,
+    reference_cache& references,
     taxon_count_map& taxCounts,
     classification_statistics& statistics,
-    std::ostream& bufout)
+    output_buffers& out)
 {
     const auto& optEval = opt.output.evaluate;
     const bool makeGroundTruth = optEval.precision || optEval.determineGroundTruth;
 
-    auto cls = make_classification(query, tophits, db.taxo_cache(),
+    // optional alignment-based verification (needs read sequence)
+    vector<match_candidate> verified;
+    const bool verify = opt.classify.verifyTopCandidates > 0 &&
+                        !query.seq1.empty() && !tophits.empty();
+    if (verify) {
+        verify_candidates(db.target_sketching(), opt.classify, references,
+                          query, tophits, verified);
+    }
+    const auto candidates = verify ? span<const match_candidate>{verified}
+                                   : tophits;
+
+    auto cls = make_classification(query, candidates, db.taxo_cache(),
                                    opt.classify, makeGroundTruth);
 
     if (opt.make_tax_counts() && cls.best) {
@@ -549,7 +699,13 @@ void classify_and_evaluate(
 
     evaluate_classification(cls, db.taxo_cache(), opt.output.evaluate, statistics);
 
-    show_query_mapping(bufout, db, opt.output, query, cls, tophits, allhits);
+    show_query_mapping(out.text, db, taxonFmt, references, opt.output,
+                       query, cls, candidates, allhits);
+
+    if (!opt.binaryMappingsFile.empty()) {
+        append_query_result(out.binary, query, cls.best, candidates,
+                            db.taxo_cache(), opt.output.format.lowestRank);
+    }
 }
 
 
@@ -561,7 +717,7 @@ void classify_and_evaluate(
  *****************************************************************************/
 void publish_results(
     const taxon_count_map& taxCounts,
-    const std::ostringstream& bufout,
+    const output_buffers& out,
     const query_options& opt,
     classification_results& results)
 {
@@ -570,8 +726,9 @@ void publish_results(
         for (const auto& taxCount : taxCounts)
             results.taxCounts[taxCount.first] += taxCount.second;
     }
-    // write output buffer to output stream
-    results.perReadOut << bufout.str();
+    // write output buffers to output streams
+    results.perReadOut << out.text;
+    if (results.perReadBinaryOut) *results.perReadBinaryOut << out.binary;
 }
 
 
@@ -644,6 +801,13 @@ struct query_mapping
 
 using query_mappings = std::vector<query_mapping>;
 
+/** @brief query mappings of one batch and its position in the output */
+struct query_mappings_batch
+{
+    std::size_t index = 0;
+    query_mappings mappings;
+};
+
 
 
 /*************************************************************************//**
@@ -670,37 +834,52 @@ update_candidates(classification_candidates& candidates,
  *
  *****************************************************************************/
 void redo_classification_batched(
-    moodycamel::ConcurrentQueue<query_mappings>& queryMappingsQueue,
+    moodycamel::ConcurrentQueue<query_mappings_batch>& queryMappingsQueue,
     const matches_per_target& tgtMatches,
     const database& db,
     const query_options& opt,
+    const taxon_formatter& taxonFmt,
+    reference_cache& references,
     classification_results& results)
 {
+    struct batch_output {
+        output_buffers out;
+        taxon_count_map taxCounts;
+    };
+
+    const auto numThreads = std::max(1U, unsigned(opt.performance.numThreads));
+
+    // results are published in the original batch order
+    ordered_writer<batch_output> output {0,
+        [&] (batch_output&& buf) {
+            publish_results(buf.taxCounts, buf.out, opt, results);
+        },
+        [] (std::exception& e) { std::cerr << "FAIL: " << e.what() << '\n'; },
+        4 * std::size_t(numThreads), numThreads - 1};
+
     // parallel
     std::vector<std::future<void>> threads;
-    std::mutex mtx;
 
-    for (unsigned threadId = 0; threadId < opt.performance.numThreads; ++threadId) {
+    for (unsigned threadId = 0; threadId < numThreads; ++threadId) {
         threads.emplace_back(std::async(std::launch::async, [&, threadId] {
 
-            query_mappings mappings;
+            query_mappings_batch batch;
 
             while (queryMappingsQueue.size_approx()) {
-                if (queryMappingsQueue.try_dequeue(mappings)) {
-                    std::ostringstream bufout;
-                    taxon_count_map taxCounts;
+                if (queryMappingsQueue.try_dequeue(batch)) {
+                    batch_output buf;
 
-                    for (auto& mapping : mappings) {
+                    for (auto& mapping : batch.mappings) {
                         // classify using only targets left in tgtMatches
                         update_candidates(mapping.candidates, tgtMatches);
 
                         classify_and_evaluate(
                             mapping.query, mapping.candidates.view(), {},
-                            db, opt, taxCounts, results.statistics, bufout);
+                            db, opt, taxonFmt, references,
+                            buf.taxCounts, results.statistics, buf.out);
                     }
 
-                    std::lock_guard<std::mutex> lock(mtx);
-                    publish_results(taxCounts, bufout, opt, results);
+                    output.submit(0, batch.index, batch.index + 1, std::move(buf));
                 }
             }
         }));
@@ -710,6 +889,7 @@ void redo_classification_batched(
     for (auto& thread : threads) {
         thread.get();
     }
+    output.finish();
 }
 
 
@@ -721,30 +901,51 @@ void redo_classification_batched(
  *****************************************************************************/
 struct mappings_buffer
 {
-    std::ostringstream out;
+    // input group of all queries in batch
+    std::size_t group = 0;
+    output_buffers out;
     query_mappings queryMappings;
     matches_per_target hitsPerTarget;
     taxon_count_map taxCounts;
 };
 
+/*************************************************************************//**
+ *
+ * @brief global (target -> hits) lists and query mappings of one input group
+ *
+ *****************************************************************************/
+struct query_group_mappings
+{
+    explicit
+    query_group_mappings(classification_results& res): results{res} {}
+
+    classification_results& results;
+    // global target -> query_id/win:hits... list
+    matches_per_target tgtMatches;
+    moodycamel::ConcurrentQueue<query_mappings_batch> queryMappingsQueue;
+    // number of batches in queryMappingsQueue
+    std::size_t numMappingsBatches = 0;
+};
+
 /*************************************************************************//**
  *
  * @brief default classification scheme with
  *        additional target->hits list generation and output
- *        try to map each read to a taxon with the lowest possible rank
+ *        try to map each read to a taxon with the lowest possible rank;
+ *        results of each input group go to separate results object
+ *        that is only needed from 'openGroup(g)' until 'closeGroup(g)'
  *
  *****************************************************************************/
 void map_queries_to_targets_default(
-    const vector<string>& infiles,
+    const vector<vector<string>>& inputGroups,
     const database& db, const query_options& opt,
-    classification_results& results)
+    const classification_group_opener& openGroup,
+    const classification_group_closer& closeGroup)
 {
     const auto& fmt = opt.output.format;
 
-    // global target -> query_id/win:hits... list
-    matches_per_target tgtMatches;
-
-    moodycamel::ConcurrentQueue<query_mappings> queryMappingsQueue;
+    // only groups that are currently processed are present
+    vector<std::unique_ptr<query_group_mappings>> groups(inputGroups.size());
 
     if (opt.output.evaluate.precision || opt.output.evaluate.determineGroundTruth) {
         // groundtruth may be outside of target lineages
@@ -752,6 +953,21 @@ void map_queries_to_targets_default(
         db.taxo_cache().update_cached_lineages(taxon_rank::none);
     }
 
+    const taxon_formatter taxonFmt{db.taxo_cache(), fmt};
+
+    // reference sequence access for alignments;
+    // record index of reference files is kept next to the database
+    reference_cache references;
+    const auto refIndexFile = opt.dbfile + ".refindex";
+    if (opt.output.analysis.showAlignment ||
+        opt.classify.verifyTopCandidates > 0)
+    {
+        references.read_index(refIndexFile);
+    }
+
+    // output buffers of finalized batches are re-used
+    moodycamel::ConcurrentQueue<output_buffers> outputBuffers;
+
     // input queries are divided into batches;
     // each batch might be processed by a different thread;
     // the following 4 lambdas define actions that should be performed
@@ -759,7 +975,11 @@ void map_queries_to_targets_default(
     // the batch buffer can be used to cache intermediate results
 
     // creates an empty batch buffer
-    const auto makeBatchBuffer = [] { return mappings_buffer(); };
+    const auto makeBatchBuffer = [&] {
+        mappings_buffer buf;
+        outputBuffers.try_dequeue(buf.out);
+        return buf;
+    };
 
     // updates buffer with the database answer of a single query
     const auto processQuery = [&] (
@@ -768,6 +988,8 @@ void map_queries_to_targets_default(
         const span<const location> allhits,
         const span<const match_candidate> tophits)
     {
+        buf.group = query.group;
+
         if (query.empty()) return;
 
         if (opt.output.analysis.showHitsPerTargetList || opt.classify.covPercentile > 0) {
@@ -779,73 +1001,119 @@ void map_queries_to_targets_default(
 
         if (opt.classify.covPercentile > 0) {
             // copy id and header, sequence strings are not needed
-            sequence_query qinfo;
-            qinfo.id = query.id;
-            qinfo.header = query.header;
-            // copy candidates
+            auto qinfo = query.header_only_copy();
+            // copy candidates (verified while sequences are available)
             classification_candidates cands;
-            cands.assign(tophits);
+            if (opt.classify.verifyTopCandidates > 0 && !tophits.empty()) {
+                vector<match_candidate> verified;
+                verify_candidates(db.target_sketching(), opt.classify,
+                                  references, query, tophits, verified);
+                cands.assign(span<const match_candidate>{verified});
+            } else {
+                cands.assign(tophits);
+            }
             // save query mapping for post processing
             buf.queryMappings.emplace_back(query_mapping{std::move(qinfo), std::move(cands)});
         }
         else {
             classify_and_evaluate(
-                query, tophits, allhits,
-                db, opt, buf.taxCounts, results.statistics, buf.out);
+                query, tophits, allhits, db, opt, taxonFmt, references,
+                buf.taxCounts, groups[query.group]->results.statistics, buf.out);
         }
     };
 
-    // runs before a batch buffer is discarded
+    // runs before a batch buffer is discarded;
+    // batches are finalized one after another in input order
     const auto finalizeBatch = [&] (mappings_buffer&& buf) {
+        auto& group = *groups[buf.group];
+
         if (opt.output.analysis.showHitsPerTargetList || opt.classify.covPercentile > 0) {
             // merge batch (target->hits) lists into global one
-            tgtMatches.merge(std::move(buf.hitsPerTarget));
+            group.tgtMatches.merge(std::move(buf.hitsPerTarget));
         }
         if (opt.classify.covPercentile > 0) {
             // move mappings to global map
-            queryMappingsQueue.enqueue(std::move(buf.queryMappings));
+            group.queryMappingsQueue.enqueue(query_mappings_batch{
+                group.numMappingsBatches++, std::move(buf.queryMappings)});
             buf.queryMappings.clear();
         }
         else {
-            publish_results(buf.taxCounts, buf.out, opt, results);
+            publish_results(buf.taxCounts, buf.out, opt, group.results);
+            buf.out.clear();
+            outputBuffers.enqueue(std::move(buf.out));
         }
     };
 
     // runs if something needs to be appended to the output
-    const auto appendToOutput = [&] (const std::string& msg) {
-        results.perReadOut << fmt.tokens.comment << msg << '\n';
+    const auto appendToOutput = [&] (std::size_t group, const std::string& msg) {
+        groups[group]->results.perReadOut << fmt.tokens.comment << msg << '\n';
     };
 
-    // run (parallel) database queries according to processing options
-    query_database(infiles, db, opt,
-                   makeBatchBuffer, processQuery, finalizeBatch,
-                   appendToOutput);
+    const auto beginGroup = [&] (std::size_t g) {
+        groups[g] = std::make_unique<query_group_mappings>(openGroup(g));
+    };
 
-    // filter all matches by coverage
-    if (opt.classify.covPercentile > 0) {
-        filter_targets_by_coverage(db.taxo_cache(), tgtMatches, opt.classify.covPercentile);
+    // runs after all batches of a group are finalized
+    const auto endGroup = [&] (std::size_t g) {
+        auto& group = *groups[g];
+        auto& results = group.results;
+        auto& tgtMatches = group.tgtMatches;
 
-        redo_classification_batched(queryMappingsQueue, tgtMatches, db, opt, results);
-    }
+        // filter all matches by coverage
+        if (opt.classify.covPercentile > 0) {
+            filter_targets_by_coverage(db.taxo_cache(), tgtMatches, opt.classify.covPercentile);
 
-    const auto& analysis = opt.output.analysis;
+            redo_classification_batched(group.queryMappingsQueue, tgtMatches,
+                                        db, opt, taxonFmt, references, results);
+        }
 
-    if (analysis.showHitsPerTargetList) {
-        tgtMatches.sort_match_lists();
-        show_matches_per_targets(results.perTargetOut, db, tgtMatches, fmt);
-    }
+        const auto& analysis = opt.output.analysis;
 
-    if (analysis.showTaxAbundances) {
-        show_abundances(results.perTaxonOut, results.taxCounts,
-                        results.statistics, fmt);
-    }
+        if (analysis.showHitsPerTargetList) {
+            tgtMatches.sort_match_lists();
+            show_matches_per_targets(results.perTargetOut, db, tgtMatches, fmt);
+        }
 
-    if (analysis.showAbundanceEstimatesOnRank != taxonomy::rank::none) {
-        estimate_abundance(db.taxo_cache(), results.taxCounts, analysis.showAbundanceEstimatesOnRank);
+        if (analysis.showTaxAbundances) {
+            show_abundances(results.perTaxonOut, results.taxCounts,
+                            results.statistics, fmt);
+        }
 
-        show_abundance_estimates(results.perTaxonOut,
-                                 analysis.showAbundanceEstimatesOnRank,
-                                 results.taxCounts, results.statistics, fmt);
+        if (analysis.showAbundanceEstimatesOnRank != taxonomy::rank::none) {
+            estimate_abundance(db.taxo_cache(), results.taxCounts, analysis.showAbundanceEstimatesOnRank);
+
+            show_abundance_estimates(results.perTaxonOut,
+                                     analysis.showAbundanceEstimatesOnRank,
+                                     results.taxCounts, results.statistics, fmt);
+        }
+
+        groups[g].reset();
+        closeGroup(g);
+    };
+
+    // run (parallel) database queries according to processing options
+    if (inputGroups.size() == 1) {
+        beginGroup(0);
+        query_database(inputGroups.front(), db, opt,
+                       makeBatchBuffer, processQuery, finalizeBatch,
+                       [&] (const std::string& msg) { appendToOutput(0, msg); });
+        endGroup(0);
+    }
+    else {
+        query_database_groups(inputGroups, db, opt,
+            makeBatchBuffer, processQuery, finalizeBatch, appendToOutput,
+            [] (float p) { show_progress_indicator(std::cerr, p); },
+            [] (std::exception& e) { std::cerr << "FAIL: " << e.what() << '\n'; },
+            beginGroup, endGroup);
+    }
+
+    // keep index of newly accessed reference files for future queries;
+    // failure to do so is not fatal
+    if (references.index_modified()) {
+        try {
+            references.write_index(refIndexFile);
+        }
+        catch (file_access_error&) {}
     }
 }
 
@@ -857,15 +1125,45 @@ void map_queries_to_targets_default(
  *        try to map each read to a taxon with the lowest possible rank
  *
  *****************************************************************************/
+void map_queries_to_targets(const vector<vector<string>>& inputGroups,
+                            const database& db, const query_options& opt,
+                            const classification_group_opener& openGroup,
+                            const classification_group_closer& closeGroup)
+{
+    vector<classification_results*> groupResults(inputGroups.size());
+
+    map_queries_to_targets_default(inputGroups, db, opt,
+        [&] (std::size_t g) -> classification_results& {
+            auto& results = openGroup(g);
+            groupResults[g] = &results;
+
+            if (opt.output.format.mapViewMode != map_view_mode::none) {
+                show_query_mapping_header(results.perReadOut, opt.output);
+            }
+            if (results.perReadBinaryOut) {
+                write_result_file_header(*results.perReadBinaryOut,
+                    result_file_properties{opt.output.format.lowestRank,
+                                           db.target_sketching()});
+            }
+            return results;
+        },
+        [&] (std::size_t g) {
+            if (groupResults[g]->perReadBinaryOut) {
+                write_result_file_footer(*groupResults[g]->perReadBinaryOut);
+            }
+            closeGroup(g);
+        });
+}
+
+
+//-------------------------------------------------------------------
 void map_queries_to_targets(const vector<string>& infiles,
                             const database& db, const query_options& opt,
                             classification_results& results)
 {
-    if (opt.output.format.mapViewMode != map_view_mode::none) {
-        show_query_mapping_header(results.perReadOut, opt.output);
-    }
-
-    map_queries_to_targets_default(infiles, db, opt, results);
+    map_queries_to_targets(vector<vector<string>>{infiles}, db, opt,
+        [&] (std::size_t) -> classification_results& { return results; },
+        [] (std::size_t) {});
 }
 
 
@@ -873,44 +1171,133 @@ void map_queries_to_targets(const vector<string>& infiles,
 /*************************************************************************//**
  *
  * @brief needed for 'merge' mode: default classification scheme & output
- *        try to map candidates to a taxon with the lowest possible rank
+ *        try to map candidates to a taxon with the lowest possible rank;
+ *        batches are classified concurrently
  *
  *****************************************************************************/
-void map_candidates_to_targets(vector<string>&& queryHeaders,
-                               const vector<classification_candidates>& queryCandidates,
-                               const database& db, const query_options& opt,
-                               classification_results& results)
+void map_candidates_to_targets(
+    const std::function<bool(std::size_t&,query_candidates_batch&)>& loadBatch,
+    const database& db, const query_options& opt,
+    classification_results& results)
 {
     if (opt.output.format.mapViewMode != map_view_mode::none) {
         show_query_mapping_header(results.perReadOut, opt.output);
     }
 
-    // taxon -> read count
-    taxon_count_map allTaxCounts;
+    const taxon_formatter taxonFmt{db.taxo_cache(), opt.output.format};
+
+    reference_cache references;
+
+    struct batch_output {
+        output_buffers out;
+        taxon_count_map taxCounts;
+    };
+
+    const auto numThreads = std::max(1U, unsigned(opt.performance.numThreads));
+
+    // results are published in batch order
+    ordered_writer<batch_output> output {0,
+        [&] (batch_output&& buf) {
+            publish_results(buf.taxCounts, buf.out, opt, results);
+        },
+        [] (std::exception& e) { std::cerr << "FAIL: " << e.what() << '\n'; },
+        4 * std::size_t(numThreads), numThreads - 1};
+
+    std::atomic<bool> stop{false};
+
+    std::vector<std::future<void>> threads;
+
+    for (unsigned threadId = 0; threadId < numThreads; ++threadId) {
+        threads.emplace_back(std::async(std::launch::async, [&] {
+            query_candidates_batch batch;
+            try {
+                std::size_t b = 0;
+                while (!stop && loadBatch(b, batch)) {
+
+                    batch_output buf;
+                    for (std::size_t i = 0; i < batch.headers.size(); ++i) {
+                        const auto& header = batch.headers[i];
+                        sequence_query query{batch.firstId + i, sequence_query::view_type{
+                            header.data(), header.data() + header.size()}};
 
-    for (size_t i = 0; i < queryHeaders.size(); ++i) {
-        sequence_query query{i+1, std::move(queryHeaders[i]), {}};
+                        classify_and_evaluate(
+                            query, batch.candidates[i].view(), {},
+                            db, opt, taxonFmt, references,
+                            buf.taxCounts, results.statistics, buf.out);
+                    }
+                    output.submit(0, b, b + 1, std::move(buf));
+                }
+            }
+            catch (...) {
+                // stop other threads
+                stop = true;
+                throw;
+            }
+        }));
+    }
 
-        classify_and_evaluate(
-            query, queryCandidates[i].view(), {},
-            db, opt, allTaxCounts, results.statistics, results.perReadOut);
+    std::exception_ptr error;
+    for (auto& thread : threads) {
+        try {
+            thread.get();
+        }
+        catch (...) {
+            if (!error) error = std::current_exception();
+        }
     }
+    output.finish();
+
+    if (error) std::rethrow_exception(error);
 
     const auto& analysis = opt.output.analysis;
     if (analysis.showTaxAbundances) {
-        show_abundances(results.perTaxonOut, allTaxCounts,
+        show_abundances(results.perTaxonOut, results.taxCounts,
                         results.statistics, opt.output.format);
     }
 
     if (analysis.showAbundanceEstimatesOnRank != taxonomy::rank::none) {
-        estimate_abundance(db.taxo_cache(), allTaxCounts, analysis.showAbundanceEstimatesOnRank);
+        estimate_abundance(db.taxo_cache(), results.taxCounts, analysis.showAbundanceEstimatesOnRank);
 
         show_abundance_estimates(results.perTaxonOut,
                                  analysis.showAbundanceEstimatesOnRank,
-                                 allTaxCounts,
+                                 results.taxCounts,
                                  results.statistics, opt.output.format);
     }
 }
 
 
+//-------------------------------------------------------------------
+void map_candidates_to_targets(vector<string>&& queryHeaders,
+                               vector<classification_candidates>&& queryCandidates,
+                               const database& db, const query_options& opt,
+                               classification_results& results)
+{
+    constexpr std::size_t batchSize = 4096;
+
+    const auto numQueries = queryHeaders.size();
+    const auto numBatches = (numQueries + batchSize - 1) / batchSize;
+
+    std::atomic<std::size_t> nextBatch{0};
+
+    map_candidates_to_targets(
+        [&] (std::size_t& b, query_candidates_batch& batch) {
+            b = nextBatch++;
+            if (b >= numBatches) return false;
+
+            const auto first = b * batchSize;
+            const auto last  = std::min(first + batchSize, numQueries);
+
+            batch.firstId = first + 1;
+            batch.headers.assign(
+                std::make_move_iterator(queryHeaders.begin() + first),
+                std::make_move_iterator(queryHeaders.begin() + last));
+            batch.candidates.assign(
+                std::make_move_iterator(queryCandidates.begin() + first),
+                std::make_move_iterator(queryCandidates.begin() + last));
+            return true;
+        },
+        db, opt, results);
+}
+
+
 } // namespace mc
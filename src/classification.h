@@ -29,6 +29,7 @@
 #include "database_query.h"
 #include "timer.h"
 
+#include <functional>
 #include <vector>
 #include <string>
 #include <iostream>
@@ -80,6 +81,7 @@ struct classification_results
         perReadOut.flush();
         perTargetOut.flush();
         perTaxonOut.flush();
+        if (perReadBinaryOut) perReadBinaryOut->flush();
         status.flush();
     }
 
@@ -87,6 +89,8 @@ struct classification_results
     std::ostream& perTargetOut;
     std::ostream& perTaxonOut;
     std::ostream& status;
+    // optional binary per-read results
+    std::ostream* perReadBinaryOut = nullptr;
     timer time;
     classification_statistics statistics;
     taxon_count_map taxCounts; // global taxon -> read count
@@ -105,6 +109,49 @@ void map_queries_to_targets(
     classification_results&);
 
 
+/*************************************************************************//**
+ *
+ * @brief provides results object of an input group before its first query;
+ *        the object must stay valid until the group is closed
+ *
+ *****************************************************************************/
+using classification_group_opener =
+    std::function<classification_results&(std::size_t group)>;
+
+/** @brief called as soon as all results of an input group are complete */
+using classification_group_closer = std::function<void(std::size_t group)>;
+
+
+/*************************************************************************//**
+ *
+ * @brief try to map each read from several groups of input files to a taxon;
+ *        up to 'concurrentFiles' groups are processed concurrently,
+ *        results of group i go to 'openGroup(i)';
+ *        groups are opened right before and closed right after
+ *        they are processed
+ *
+ *****************************************************************************/
+void map_queries_to_targets(
+    const std::vector<std::vector<std::string>>& inputGroups,
+    const database&, const query_options&,
+    const classification_group_opener& openGroup,
+    const classification_group_closer& closeGroup);
+
+
+/*************************************************************************//**
+ *
+ * @brief needed for 'merge' mode: headers and candidates of
+ *        consecutive queries; query i has id 'firstId + i'
+ *
+ *****************************************************************************/
+struct query_candidates_batch
+{
+    query_id firstId = 1;
+    std::vector<std::string> headers;
+    std::vector<classification_candidates> candidates;
+};
+
+
 /*************************************************************************//**
  *
  * @brief needed for 'merge' mode: try to map candidates to a taxon
@@ -113,7 +160,23 @@ void map_queries_to_targets(
  *****************************************************************************/
 void map_candidates_to_targets(
     std::vector<std::string>&&,
-    const std::vector<classification_candidates>&,
+    std::vector<classification_candidates>&&,
+    const database&, const query_options&,
+    classification_results&);
+
+
+/*************************************************************************//**
+ *
+ * @brief needed for 'merge' mode: try to map candidates to a taxon;
+ *        batches are loaded with 'loadBatch(batchIndex, batch)' until it
+ *        returns false; the loader assigns consecutive batch indices
+ *        (0,1,2,...) and can be called concurrently;
+ *        batches are classified concurrently, output is written in
+ *        batch order
+ *
+ *****************************************************************************/
+void map_candidates_to_targets(
+    const std::function<bool(std::size_t&,query_candidates_batch&)>& loadBatch,
     const database&, const query_options&,
     classification_results&);
 
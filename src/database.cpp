@@ -22,6 +22,7 @@
 
 
 #include "database.h"
+#include "sketch_io.h"
 
 #include <future>
 
@@ -30,10 +31,10 @@ namespace mc {
 
 
 // ----------------------------------------------------------------------------
-bool database::add_target(part_id dbPart,
-                          const sequence& seq, taxon_name sid,
-                          taxon_id parentTaxid,
-                          file_source source)
+template<class FeatureInserter>
+bool database::insert_target(part_id dbPart, bool empty, const taxon_name& sid,
+                             taxon_id parentTaxid, file_source source,
+                             FeatureInserter&& insertFeatures)
 {
     // reached hard limit for number of targets
     if (targetCount_.load() >= max_target_count()) {
@@ -48,16 +49,15 @@ bool database::add_target(part_id dbPart,
         throw target_limit_exceeded_error{};
     }
 
-    if (seq.empty()) return false;
+    if (empty) return false;
 
     if (parentTaxid < 1) parentTaxid = 0;
 
     const auto targetId = target_id(targetCount);
     const auto taxid = taxon_id_of_target(targetId);
 
-    // sketch sequence -> insert features
-    source.windows = featureStore_.add_target(dbPart, seq, targetId,
-                                              targetSketchingOptions_);
+    // insert features
+    source.windows = insertFeatures(targetId, parentTaxid, source);
 
     // insert sequence metadata as a new taxon
     auto result = taxonomyCache_.emplace_target_taxon(taxid, parentTaxid, sid, source);
@@ -75,6 +75,60 @@ bool database::add_target(part_id dbPart,
 }
 
 
+//-------------------------------------------------------------------
+bool database::add_target(part_id dbPart,
+                          const sequence& seq, taxon_name sid,
+                          taxon_id parentTaxid,
+                          file_source source)
+{
+    return insert_target(dbPart, seq.empty(), sid, parentTaxid, std::move(source),
+        [&] (target_id tgt, taxon_id, const file_source&) {
+            // sketch sequence -> insert features
+            return featureStore_.add_target(dbPart, seq, tgt,
+                                            targetSketchingOptions_);
+        });
+}
+
+
+#ifndef GPU_MODE
+//-------------------------------------------------------------------
+bool database::add_target(part_id dbPart,
+                          const packed_sequence& seq, taxon_name sid,
+                          taxon_id parentTaxid,
+                          file_source source,
+                          sketch_writer* sketchOut)
+{
+    return insert_target(dbPart, seq.empty(), sid, parentTaxid, std::move(source),
+        [&] (target_id tgt, taxon_id parent, const file_source& src) {
+            // sketch sequence -> insert features
+            if (!sketchOut) {
+                return featureStore_.add_target(dbPart, seq, tgt,
+                                                targetSketchingOptions_);
+            }
+            sketchOut->begin_target(sid, parent, src);
+            auto windows = featureStore_.add_target(dbPart, seq, tgt,
+                targetSketchingOptions_,
+                [&] (const sketch& sk) { sketchOut->add_window(sk); });
+            sketchOut->end_target();
+            return windows;
+        });
+}
+
+
+//-------------------------------------------------------------------
+bool database::add_target(part_id dbPart, const target_sketches& target)
+{
+    // only non-empty sequences are written to sketch files,
+    // even if they are too short to yield any window
+    return insert_target(dbPart, false, target.name,
+                         target.parentTaxid, target.source,
+        [&] (target_id tgt, taxon_id, const file_source&) {
+            return featureStore_.add_target_sketches(dbPart, target, tgt);
+        });
+}
+#endif
+
+
 
 // ----------------------------------------------------------------------------
 part_id database::read_meta(const std::string& filename, std::future<void>& taxonomyReaderThread)
@@ -91,7 +145,10 @@ part_id database::read_meta(const std::string& filename, std::future<void>& taxo
     uint64_t dbVer = 0;
     read_binary(is, dbVer);
 
-    if (uint64_t( MC_DB_VERSION ) != dbVer) {
+    // older databases only differ in the serialization of the taxonomy
+    const bool legacyTaxonomy = dbVer == uint64_t( MC_DB_VERSION_PER_TAXON );
+
+    if (uint64_t( MC_DB_VERSION ) != dbVer && !legacyTaxonomy) {
         throw file_read_error{
             "Database " + filename + " (version " + std::to_string(dbVer) + ")"
             + " is incompatible\nwith this version of MetaCache"
@@ -149,7 +206,12 @@ part_id database::read_meta(const std::string& filename, std::future<void>& taxo
 
     // read taxon metadata in separate thread
     taxonomyReaderThread = std::async(std::launch::async,
-        [&, is = std::move(is)]() mutable {read_binary(is, taxonomyCache_);});
+        [&, is = std::move(is), legacyTaxonomy]() mutable {
+            if (legacyTaxonomy)
+                read_legacy_binary(is, taxonomyCache_);
+            else
+                read_binary(is, taxonomyCache_);
+        });
 
     return numParts;
 }
@@ -304,10 +366,50 @@ void database::write(const std::string& filename) const
 }
 
 
+// ----------------------------------------------------------------------------
+void database::attach(database&& other)
+{
+#ifdef GPU_MODE
+    (void)other;
+    throw std::runtime_error{"Querying several databases is not supported in GPU mode"};
+#else
+    const auto& sk = other.target_sketching();
+    const auto& own = target_sketching();
+
+    if (sk.kmerlen   != own.kmerlen  || sk.sketchlen != own.sketchlen ||
+        sk.winlen    != own.winlen   || sk.winstride != own.winstride)
+    {
+        throw std::runtime_error{
+            "Databases can only be queried together, "
+            "if they use the same sketching scheme."};
+    }
+
+    // hits of attached databases are mapped to taxa of this database
+    std::size_t unknownTaxa = 0;
+    for (const auto& tax : other.taxonomyCache_.non_target_taxa()) {
+        if (!taxonomyCache_.taxon_with_id(tax.id())) ++unknownTaxa;
+    }
+    if (unknownTaxa > 0) {
+        std::cerr << "Warning: " << unknownTaxa << " taxa of an additional "
+                     "database are not part of the first database's taxonomy. "
+                     "Hits to these taxa will be ignored.\n";
+    }
+
+    attached_.push_back(std::make_unique<database>(std::move(other)));
+
+    // candidate taxa of attached databases might not be
+    // in the lineages of this database's targets
+    taxonomyCache_.update_cached_lineages(taxon_rank::none);
+#endif
+}
+
+
+
 // ----------------------------------------------------------------------------
 void database::clear() {
     taxonomyCache_.clear();
     featureStore_.clear();
+    attached_.clear();
 }
 
 
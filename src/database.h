@@ -59,6 +59,11 @@
 
 namespace mc {
 
+
+class sketch_writer;
+struct target_sketches;
+
+
 /*************************************************************************//**
  *
  * @brief  maps 'features' (e.g. hash values obtained by min-hashing)
@@ -218,7 +223,8 @@ public:
         targetSketchingOptions_{std::move(other.targetSketchingOptions_)},
         targetCount_{other.targetCount_.load()},
         featureStore_{std::move(other.featureStore_)},
-        taxonomyCache_{std::move(other.taxonomyCache_)}
+        taxonomyCache_{std::move(other.taxonomyCache_)},
+        attached_{std::move(other.attached_)}
     {}
 
     database& operator = (const database&) = delete;
@@ -286,8 +292,13 @@ public:
 
 
     //---------------------------------------------------------------
-    void initialize_hash_table(part_id numParts) {
+    void initialize_hash_table(part_id numParts, unsigned numThreads) {
+#ifndef GPU_MODE
+        featureStore_.initialize_build_hash_tables(numParts, numThreads);
+#else
+        (void)numThreads;
         featureStore_.initialize_build_hash_tables(numParts);
+#endif
     }
 
     //---------------------------------------------------------------
@@ -310,6 +321,32 @@ public:
         taxon_id parentTaxid = 0,
         file_source source = file_source{});
 
+#ifndef GPU_MODE
+    //-----------------------------------------------------
+    /** @brief adds target given as 2-bit packed sequence;
+     *         writes its window sketches to 'sketchOut' if not null */
+    bool add_target(
+        part_id dbPart,
+        const packed_sequence& seq, taxon_name sid,
+        taxon_id parentTaxid = 0,
+        file_source source = file_source{},
+        sketch_writer* sketchOut = nullptr);
+
+    //-----------------------------------------------------
+    /** @brief adds target using pre-computed window sketches */
+    bool add_target(part_id dbPart, const target_sketches&);
+#endif
+
+private:
+    //-----------------------------------------------------
+    template<class FeatureInserter>
+    bool insert_target(
+        part_id dbPart, bool empty, const taxon_name& sid,
+        taxon_id parentTaxid, file_source source,
+        FeatureInserter&& insertFeatures);
+
+public:
+
 
     //---------------------------------------------------------------
     void wait_until_add_target_complete(part_id partId) {
@@ -368,16 +405,85 @@ public:
     }
 
 
+    //---------------------------------------------------------------
+    /**
+     * @brief  attaches an independent database with the same target
+     *         sketching scheme that is queried together with this one;
+     *         each query is sketched only once and looked up in all
+     *         databases; candidates of all databases are combined and
+     *         refer to taxa of this database's taxonomy;
+     *         all databases should share the same taxonomy: candidates
+     *         with taxa that are unknown to this database are ignored
+     *         (a warning with their number is printed on attaching)
+     *
+     * @details candidates can only be combined above sequence level,
+     *          so queries need a lowest candidate rank above 'sequence'
+     */
+    void attach(database&& other);
+
+    //-----------------------------------------------------
+    std::size_t attached_count() const noexcept {
+        return attached_.size();
+    }
+
+
     //---------------------------------------------------------------
 #ifndef GPU_MODE
+    template<class Sequence>
     void
-    query_host(const sequence& query1, const sequence& query2,
+    query_host(const Sequence& query1, const Sequence& query2,
                query_handler<location>& queryHandler,
                const sketching_opt querySketching,
                const candidate_generation_rules& rules) const
     {
+        if (attached_.empty()) {
+            featureStore_.query_host_hashmap(
+                query1, query2, queryHandler, taxonomyCache_, querySketching, rules);
+            return;
+        }
+
+        using std::begin;
+        using std::end;
+
+        // sketch query only once for all databases
+        auto& allWindowSketch = queryHandler.querySketch;
+        allWindowSketch.clear();
+
+        const auto keep = [&] (const auto& sk) {
+            allWindowSketch.insert(allWindowSketch.end(), sk.begin(), sk.end());
+        };
+        queryHandler.querySketcher.for_each_sketch(
+            begin(query1), end(query1), querySketching, keep);
+        queryHandler.querySketcher.for_each_sketch(
+            begin(query2), end(query2), querySketching, keep);
+
+        // candidates of other databases are not bound to targets
+        auto& combined = queryHandler.combinedCandidates;
+        combined.clear();
+
         featureStore_.query_host_hashmap(
-            query1, query2, queryHandler, taxonomyCache_, querySketching, rules);
+            allWindowSketch, queryHandler, taxonomyCache_, rules);
+
+        for (const auto& cand : queryHandler.classificationCandidates) {
+            combined.insert(match_candidate{cand.tax, cand.hits}, taxonomyCache_, rules);
+        }
+
+        for (const auto& db : attached_) {
+            db->featureStore_.query_host_hashmap(
+                allWindowSketch, queryHandler, db->taxonomyCache_, rules);
+
+            for (const auto& cand : queryHandler.classificationCandidates) {
+                // unknown taxa have been reported by 'attach'
+                const taxon* tax = taxonomyCache_.taxon_with_id(cand.tax->id());
+                if (tax) {
+                    combined.insert(match_candidate{tax, cand.hits}, taxonomyCache_, rules);
+                }
+            }
+        }
+
+        // matches of single databases can't be reported
+        queryHandler.matchesSorter.clear();
+        std::swap(queryHandler.classificationCandidates, combined);
     }
 #else
     void
@@ -482,6 +588,7 @@ private:
     std::atomic<std::uint64_t> targetCount_;
     mutable feature_store featureStore_;
     taxonomy_cache taxonomyCache_;
+    std::vector<std::unique_ptr<database>> attached_;
 };
 
 
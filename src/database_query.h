@@ -37,7 +37,14 @@
     #include "query_batch.cuh"
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <utility>
 #include <vector>
 
 
@@ -47,30 +54,57 @@ namespace mc {
 /*************************************************************************//**
  *
  * @brief single query = id + header + read(pair)
+ *        header and sequences are views into reference-counted input blocks
  *
  *****************************************************************************/
 struct sequence_query
 {
+    using view_type  = sequence_record::view_type;
+    using block_type = std::shared_ptr<const sequence_block>;
+
     sequence_query() = default;
     sequence_query(const sequence_query&) = default;
     sequence_query(sequence_query&&) = default;
     sequence_query& operator = (const sequence_query&) = default;
     sequence_query& operator = (sequence_query&&) = default;
 
+    /** @brief referenced header and sequence data must outlive query */
     explicit
-    sequence_query(query_id qid, std::string headerText,
-                   sequence s1, sequence s2 = sequence{}) noexcept
+    sequence_query(query_id qid, view_type headerText,
+                   view_type s1 = view_type{}, view_type s2 = view_type{}) noexcept
     :
-        id{qid}, header(std::move(headerText)),
-        seq1(std::move(s1)), seq2(std::move(s2))
+        id{qid}, header{headerText}, seq1{s1}, seq2{s2}
     {}
 
     bool empty() const noexcept { return header.empty() || seq1.empty(); }
 
+    /** @brief returns query with id and own copy of header only */
+    sequence_query header_only_copy() const {
+        auto block = std::make_shared<sequence_block>(header.begin(), header.end());
+        sequence_query q{id, view_type{block->data(), block->data() + block->size()}};
+        q.block1 = std::move(block);
+        q.group = group;
+        return q;
+    }
+
+    /** @brief drops views and references to input blocks */
+    void release() noexcept {
+        header = view_type{};
+        seq1   = view_type{};
+        seq2   = view_type{};
+        block1.reset();
+        block2.reset();
+    }
+
     query_id id = 0;
-    std::string header;
-    sequence seq1;
-    sequence seq2;  // 2nd part of paired-end read
+    // index of input group (for routing results to separate outputs)
+    std::size_t group = 0;
+    view_type header;
+    view_type seq1;
+    view_type seq2;  // 2nd part of paired-end read
+    // keep input data referenced by views alive
+    block_type block1;
+    block_type block2;
 };
 
 
@@ -146,49 +180,80 @@ struct sequence_query
 
 
 
- /*************************************************************************//**
+/*************************************************************************//**
  *
- * @brief queries database with batches of reads from ONE sequence source (pair)
- *        produces batch buffers with one match list per sequence
+ * @brief number of threads that parse one query input source;
+ *        standard FASTQ input can be parsed by several producer threads
  *
- * @tparam BufferSource     returns a per-batch buffer object
+ *****************************************************************************/
+inline unsigned
+query_parser_count(const query_options& opt)
+{
+    return opt.performance.queryLimit < std::numeric_limits<std::int_least64_t>::max()
+           ? 1 : opt.performance.numParsers;
+}
+
+
+
+/*************************************************************************//**
  *
- * @tparam BufferUpdate     takes database matches of one query and a buffer;
- *                          must be thread-safe (only const operations on DB!)
+ * @brief max. number of threads that read (and decompress) one query input
+ *        file if 'numReaders' inputs are read at the same time;
+ *        reading shares the thread budget with classification
  *
- * @tparam BufferSink       recieves buffer after batch is finished
+ *****************************************************************************/
+inline unsigned
+query_reader_thread_count(const query_options& opt, unsigned numReaders = 1)
+{
+    return std::max(1U, opt.performance.numThreads / std::max(1U, numReaders));
+}
+
+
+
+/*************************************************************************//**
  *
- * @tparam InfoCallback     prints messages
+ * @brief creates batch executor that classifies batches of queries
+ *        and runs 'produce' with it;
+ *        finished batch buffers are finalized by a separate writer thread
+ *        in the order of their query ids (separately for each input group);
+ *        the executor is destroyed (and all batches finalized)
+ *        after 'produce' returned
  *
- * @tparam ProgressHandler  prints progress messages
+ * @param idOffset  query ids of each input group start at idOffset+1
  *
- * @tparam ErrorHandler     handles exceptions
+ * @tparam Producer  takes executor and ordered output;
+ *                   adds queries to executor, must report the ids of
+ *                   discarded queries to the output
  *
  *****************************************************************************/
 template<
     class BufferSource, class BufferUpdate, class BufferSink,
-    class ErrorHandler
+    class ErrorHandler, class Producer
 >
-query_id query_batched(
-    const std::string& filename1, const std::string& filename2,
+void run_query_executor(
     const database& db,
     const query_options& opt,
+    int numProducers, unsigned numWorkers,
     query_id idOffset,
     BufferSource&& getBuffer, BufferUpdate&& update, BufferSink&& finalize,
-    ErrorHandler&& handleErrors)
+    ErrorHandler&& handleErrors,
+    Producer&& produce)
 {
-    if (opt.performance.queryLimit < 1) return idOffset;
-    size_t queryLimit = opt.performance.queryLimit > 0 ?
-                        size_t(opt.performance.queryLimit) :
-                        std::numeric_limits<size_t>::max();
-
-    std::mutex finalizeMtx;
+    using buffer_type = std::decay_t<decltype(getBuffer())>;
 
-    const unsigned numWorkers = opt.performance.numThreads - (opt.performance.numThreads > 1);
+    // workers only wait for finalization or output if too many
+    // batches are ahead of the writer; one worker always keeps going
+    ordered_writer<buffer_type> output {idOffset + 1,
+        [&] (buffer_type&& buffer) { finalize(std::move(buffer)); },
+        handleErrors,
+        4 * std::size_t(std::max(1U, numWorkers)),
+        std::max(1U, numWorkers) - 1};
 
 #ifndef GPU_MODE
     std::vector<query_handler<location>> queryHandlers;
     queryHandlers.resize(numWorkers);
+    for (auto& handler : queryHandlers)
+        handler.sortAllMatches = opt.output.analysis.showAllHits;
 
 #else
     std::vector<std::mutex> scheduleMtxs(opt.performance.replication);
@@ -211,9 +276,11 @@ query_id query_batched(
 
     // get executor that runs classification in batches
     batch_processing_options<sequence_query> execOpt;
-    execOpt.concurrency(1, numWorkers);
+    execOpt.concurrency(numProducers, numWorkers);
     execOpt.batch_size(opt.performance.batchSize);
     execOpt.queue_size(opt.performance.numThreads + 8);
+    // idle workers take over halves of large batches
+    execOpt.min_split_size(16);
     execOpt.on_error(handleErrors);
     execOpt.work_item_measure([&] (const auto& query) {
         using std::begin;
@@ -249,40 +316,211 @@ query_id query_batched(
                       resultsBuffer, update, scheduleMtxs[id%opt.performance.replication]);
 #endif
 
-            std::lock_guard<std::mutex> lock(finalizeMtx);
-            finalize(std::move(resultsBuffer));
+            // input blocks can be re-used as soon as possible
+            for (auto& query : batch) query.release();
+
+            // queries of a batch are consecutive in their input group
+            if (!batch.empty()) {
+                output.submit(batch.front().group,
+                              batch.front().id, batch.back().id + 1,
+                              std::move(resultsBuffer));
+            }
 
             return true;
         }};
 
+    produce(executor, output);
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief collects runs of consecutive ids of discarded queries
+ *        and reports them to the ordered output
+ *
+ *****************************************************************************/
+template<class Output>
+class discarded_queries
+{
+public:
+    discarded_queries(Output& output, std::size_t group):
+        output_(output), group_{group}
+    {}
+
+    void add(query_id id) {
+        if (id != end_) flush();
+        if (begin_ == end_) begin_ = id;
+        end_ = id + 1;
+    }
+
+    /** @brief must be called before a query after the run is added to
+     *         the executor, otherwise its output would be held back */
+    void flush() {
+        output_.skip(group_, begin_, end_);
+        begin_ = end_;
+    }
+
+private:
+    Output& output_;
+    std::size_t group_;
+    query_id begin_ = 0;
+    query_id end_ = 0;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief reads queries from ONE sequence source (pair) and adds them to
+ *        the executor using producers 'producerId' and (if numParsers > 1)
+ *        'producerId'+1 ... 'producerId'+numParsers;
+ *        partial batches are handed to the executor after each chunk
+ *        of parsed input and at the end, so that each batch only
+ *        contains consecutive queries;
+ *        ids of discarded queries are reported to the ordered output;
+ *        each input file is read by at most 'maxReadThreads' threads
+ *
+ * @return query id offset for next sequence source
+ *
+ *****************************************************************************/
+template<class Output, class ErrorHandler>
+query_id read_query_input(
+    const std::string& filename1, const std::string& filename2,
+    const query_options& opt,
+    query_id idOffset, std::size_t group,
+    batch_executor<sequence_query>& executor, Output& output,
+    int producerId, unsigned numParsers, unsigned maxReadThreads,
+    ErrorHandler&& handleErrors)
+{
+    size_t queryLimit = opt.performance.queryLimit > 0 ?
+                        size_t(opt.performance.queryLimit) :
+                        std::numeric_limits<size_t>::max();
+
     std::size_t discardedCount = 0;
     std::size_t totalReadCount = 0;
 
     // read sequences from file
     try {
-        sequence_pair_reader reader{filename1, filename2};
+        // records are views into input blocks; qualities are never needed
+        sequence_record_pair_reader reader{filename1, filename2, true, false,
+                                           maxReadThreads};
         reader.index_offset(idOffset);
 
+        sequence_record record1;
+        sequence_record record2;
+
+        const auto assign = [group] (sequence_query& query, query_id id,
+                                     sequence_record& rec1, sequence_record& rec2)
+        {
+            query.id     = id;
+            query.group  = group;
+            query.header = rec1.header;
+            query.seq1   = rec1.data;
+            query.seq2   = rec2.data;
+            query.block1 = std::move(rec1.block);
+            query.block2 = std::move(rec2.block);
+        };
+
+        if (numParsers > 1) {
+            // this thread cuts input into chunks of complete records;
+            // parser threads parse records from chunks
+            bounded_queue<sequence_chunk> chunks{2 * std::size_t(numParsers)};
+            std::atomic_bool failed{false};
+
+            const auto parse = [&] (int parserId) {
+                std::size_t total = 0;
+                std::size_t discarded = 0;
+                try {
+                    sequence_chunk chunk;
+                    sequence_record rec1;
+                    sequence_record rec2;
+                    discarded_queries<Output> skipped{output, group};
+
+                    while (chunks.pop(chunk)) {
+                        while (!chunk.empty()) {
+                            const auto id = chunk.next(rec1, rec2);
+                            ++total;
+                            // read length filter
+                            if (rec1.data.size() < opt.minReadLength ||
+                                rec1.data.size() > opt.maxReadLength)
+                            {
+                                ++discarded;
+                                skipped.add(id);
+                                continue;
+                            }
+                            skipped.flush();
+                            assign(executor.next_item(parserId), id, rec1, rec2);
+                        }
+                        // batches must not span several chunks
+                        skipped.flush();
+                        executor.flush_producer(parserId);
+                    }
+                }
+                catch(std::exception& e) {
+                    failed.store(true);
+                    // stop splitting
+                    chunks.close();
+                    handleErrors(e);
+                }
+                return std::make_pair(total, discarded);
+            };
+
+            std::vector<std::future<std::pair<std::size_t,std::size_t>>> parsers;
+            parsers.reserve(numParsers);
+            for (unsigned i = 1; i <= numParsers; ++i) {
+                parsers.emplace_back(std::async(std::launch::async, parse, producerId + i));
+            }
+
+            try {
+                // blocks while enough chunks are queued
+                sequence_chunk chunk;
+                while (reader.next_chunk(chunk, opt.performance.batchSize) &&
+                       chunks.push(std::move(chunk)))
+                {}
+            }
+            catch(std::exception&) {
+                chunks.close();
+                for (auto& parser : parsers) parser.wait();
+                throw;
+            }
+            chunks.close();
+
+            for (auto& parser : parsers) {
+                const auto counts = parser.get();
+                totalReadCount += counts.first;
+                discardedCount += counts.second;
+            }
+            // don't continue after errors
+            if (failed.load()) queryLimit = 0;
+        }
+
+        discarded_queries<Output> skipped{output, group};
+
+        // remaining input that could not be cut into chunks
         while (reader.has_next()) {
             if (queryLimit < 1) break;
 
-            // get (ref to) next query sequence storage and fill it
-            auto& query = executor.next_item();
-            query.id = reader.next_header_and_data(query.header, query.seq1, query.seq2);
+            const auto id = reader.next(record1, record2);
             ++totalReadCount;
 
             // read length filter
-            while (query.seq1.size() < opt.minReadLength ||
-                   query.seq1.size() > opt.maxReadLength)
+            if (record1.data.size() < opt.minReadLength ||
+                record1.data.size() > opt.maxReadLength)
             {
                 ++discardedCount;
-                if (!reader.has_next()) break;
-                query.id = reader.next_header_and_data(query.header, query.seq1, query.seq2);
-                ++totalReadCount;
+                skipped.add(id);
+                continue;
             }
+            skipped.flush();
+
+            // get (ref to) next query sequence storage and fill it
+            assign(executor.next_item(producerId), id, record1, record2);
 
             --queryLimit;
         }
+        skipped.flush();
+        executor.flush_producer(producerId);
 
         idOffset = reader.index();
     }
@@ -306,6 +544,230 @@ query_id query_batched(
 
 
 
+ /*************************************************************************//**
+ *
+ * @brief queries database with batches of reads from ONE sequence source (pair)
+ *        produces batch buffers with one match list per sequence
+ *
+ * @tparam BufferSource     returns a per-batch buffer object
+ *
+ * @tparam BufferUpdate     takes database matches of one query and a buffer;
+ *                          must be thread-safe (only const operations on DB!)
+ *
+ * @tparam BufferSink       recieves buffer after batch is finished
+ *
+ * @tparam ErrorHandler     handles exceptions
+ *
+ *****************************************************************************/
+template<
+    class BufferSource, class BufferUpdate, class BufferSink,
+    class ErrorHandler
+>
+query_id query_batched(
+    const std::string& filename1, const std::string& filename2,
+    const database& db,
+    const query_options& opt,
+    query_id idOffset,
+    BufferSource&& getBuffer, BufferUpdate&& update, BufferSink&& finalize,
+    ErrorHandler&& handleErrors)
+{
+    if (opt.performance.queryLimit < 1) return idOffset;
+
+    const unsigned numParsers = query_parser_count(opt);
+
+    const unsigned numThreads = opt.performance.numThreads;
+    const unsigned numWorkers = numThreads - std::min(numParsers, numThreads - 1);
+
+    run_query_executor(db, opt,
+        numParsers > 1 ? numParsers + 1 : 1, numWorkers, idOffset,
+        std::forward<BufferSource>(getBuffer),
+        std::forward<BufferUpdate>(update),
+        std::forward<BufferSink>(finalize),
+        handleErrors,
+        [&] (batch_executor<sequence_query>& executor, auto& output) {
+            idOffset = read_query_input(filename1, filename2, opt, idOffset, 0,
+                                        executor, output, 0, numParsers,
+                                        query_reader_thread_count(opt),
+                                        handleErrors);
+        });
+
+    return idOffset;
+}
+
+
+
+ /*************************************************************************//**
+ *
+ * @brief queries database with batches of reads from several groups of
+ *        sequence sources using one executor for all of them;
+ *        up to 'concurrentFiles' groups are read at the same time;
+ *        the sources of one group are read one after another,
+ *        query ids are consecutive within each group;
+ *        each query carries the index of its group,
+ *        each batch only contains queries of one group
+ *
+ * @tparam BufferSource     returns a per-batch buffer object
+ *
+ * @tparam BufferUpdate     takes database matches of one query and a buffer;
+ *                          must be thread-safe (only const operations on DB!)
+ *
+ * @tparam BufferSink       recieves buffer after batch is finished
+ *
+ * @tparam InfoCallback     takes group index and message
+ *
+ * @tparam ProgressHandler  prints progress messages
+ *
+ * @tparam ErrorHandler     handles exceptions
+ *
+ * @tparam GroupBegin       takes group index;
+ *                          called before any query of the group is read
+ *
+ * @tparam GroupEnd         takes group index;
+ *                          called after all batches of the group are finished
+ *                          and before the next group of the same reader
+ *                          begins (unless reading the group failed)
+ *
+ *****************************************************************************/
+template<
+    class BufferSource, class BufferUpdate, class BufferSink,
+    class InfoCallback, class ProgressHandler, class ErrorHandler,
+    class GroupBegin, class GroupEnd
+>
+void query_database_groups(
+    const std::vector<std::vector<std::string>>& inputGroups,
+    const database& db,
+    const query_options& opt,
+    BufferSource&& bufsrc, BufferUpdate&& bufupdate, BufferSink&& bufsink,
+    InfoCallback&& showInfo, ProgressHandler&& showProgress,
+    ErrorHandler&& errorHandler,
+    GroupBegin&& beginGroup, GroupEnd&& endGroup)
+{
+    if (opt.performance.queryLimit < 1) {
+        for (std::size_t g = 0; g < inputGroups.size(); ++g) {
+            beginGroup(g);
+            endGroup(g);
+        }
+        return;
+    }
+    if (inputGroups.empty()) return;
+
+    const size_t stride = opt.pairing == pairing_mode::files ? 1 : 0;
+    const std::string nofile;
+
+    std::size_t numInputs = 0;
+    for (const auto& group : inputGroups) numInputs += group.size();
+
+    const unsigned numParsers = query_parser_count(opt);
+    const int producersPerReader = numParsers > 1 ? numParsers + 1 : 1;
+
+    const unsigned numReaders = std::max(1U, std::min(
+        opt.performance.concurrentFiles, unsigned(inputGroups.size())));
+
+    const unsigned numThreads = opt.performance.numThreads;
+    const unsigned numWorkers = numThreads - std::min(numParsers, numThreads - 1);
+
+    const unsigned maxReadThreads = query_reader_thread_count(opt, numReaders);
+
+    // groups that could not be ended by their readers
+    std::mutex unfinishedMtx;
+    std::vector<std::size_t> unfinished;
+
+    run_query_executor(db, opt,
+        numReaders * producersPerReader, numWorkers, 0,
+        std::forward<BufferSource>(bufsrc),
+        std::forward<BufferUpdate>(bufupdate),
+        std::forward<BufferSink>(bufsink),
+        errorHandler,
+        [&] (batch_executor<sequence_query>& executor, auto& output) {
+            std::atomic<std::size_t> nextGroup{0};
+            std::atomic<std::size_t> inputsStarted{0};
+
+            // each reader processes one group at a time
+            const auto read = [&] (unsigned readerId) {
+                const int producerId = readerId * producersPerReader;
+
+                for (std::size_t g = nextGroup++; g < inputGroups.size(); g = nextGroup++) {
+                    const auto& infilenames = inputGroups[g];
+                    query_id queryIdOffset = 0;
+
+                    beginGroup(g);
+
+                    std::atomic_bool failed{false};
+                    const auto handleErrors = [&] (std::exception& e) {
+                        failed.store(true);
+                        errorHandler(e);
+                    };
+
+                    // input filenames passed to sequence reader depend on pairing mode:
+                    // none     -> infiles[i], ""
+                    // sequence -> infiles[i], infiles[i]
+                    // files    -> infiles[i], infiles[i+1]
+                    for (size_t i = 0; i < infilenames.size(); i += stride+1) {
+                        const auto& fname1 = infilenames[i];
+
+                        const auto& fname2 = (opt.pairing == pairing_mode::none)
+                                             ? nofile : infilenames[i+stride];
+
+                        const auto info = (opt.pairing == pairing_mode::files)
+                                          ? fname1 + " + " + fname2 : fname1;
+                        const auto started = inputsStarted.fetch_add(stride+1);
+                        const float progress = numInputs > 1 ? started/float(numInputs) : -1;
+
+                        // shown after all previous output of the group
+                        output.post(g, queryIdOffset + 1, [&, g, info, progress] {
+                            showInfo(g, info);
+                            showProgress(progress);
+                        });
+
+                        queryIdOffset = read_query_input(
+                            fname1, fname2, opt, queryIdOffset, g,
+                            executor, output, producerId, numParsers,
+                            maxReadThreads, handleErrors);
+                    }
+
+                    // runs after all batches of the group are finished
+                    auto finished = std::make_shared<std::promise<void>>();
+                    auto groupDone = finished->get_future();
+                    output.post(g, queryIdOffset + 1, [finished] {
+                        finished->set_value();
+                    });
+
+                    // batches of failed inputs or of a stopped executor
+                    // are only finished when the executor is destroyed
+                    auto status = std::future_status::timeout;
+                    while (status != std::future_status::ready &&
+                           !failed.load() && executor.valid())
+                    {
+                        status = groupDone.wait_for(std::chrono::milliseconds(10));
+                    }
+
+                    if (status == std::future_status::ready) {
+                        endGroup(g);
+                    }
+                    else {
+                        std::lock_guard<std::mutex> lock(unfinishedMtx);
+                        unfinished.push_back(g);
+                    }
+                }
+            };
+
+            std::vector<std::future<void>> readers;
+            readers.reserve(numReaders);
+            for (unsigned r = 1; r < numReaders; ++r) {
+                readers.emplace_back(std::async(std::launch::async, read, r));
+            }
+            read(0);
+
+            for (auto& reader : readers) reader.get();
+        });
+
+    // all remaining batches have been finished by now
+    std::sort(unfinished.begin(), unfinished.end());
+    for (auto g : unfinished) endGroup(g);
+}
+
+
+
 
  /*************************************************************************//**
  *
@@ -337,6 +799,19 @@ void query_database(
     InfoCallback&& showInfo, ProgressHandler&& showProgress,
     ErrorHandler&& errorHandler)
 {
+    // one executor for all input files
+    if (opt.performance.concurrentFiles > 1) {
+        query_database_groups({infilenames}, db, opt,
+            std::forward<BufferSource>(bufsrc),
+            std::forward<BufferUpdate>(bufupdate),
+            std::forward<BufferSink>(bufsink),
+            [&] (std::size_t, const std::string& msg) { showInfo(msg); },
+            std::forward<ProgressHandler>(showProgress),
+            std::forward<ErrorHandler>(errorHandler),
+            [] (std::size_t) {}, [] (std::size_t) {});
+        return;
+    }
+
     const size_t stride = opt.pairing == pairing_mode::files ? 1 : 0;
     const std::string nofile;
     query_id queryIdOffset = 0;
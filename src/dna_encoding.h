@@ -314,6 +314,61 @@ for_each_kmer_2bit(numk_t k,
 
 
 
+/*************************************************************************//**
+ * @brief loops through all 2-bit encoded k-mers in a 2-bit packed sequence;
+ *        uses the stored codes and ambiguity flags directly
+ *
+ * @tparam UInt    result type, must be an unsigned integer type
+ *
+ * @param k        number of characters in a k-mer
+ * @param first    iterator to the first nucleotide of the input sequence
+ * @param last     iterator to one after the last nucleotide
+ * @param consume  function object lambda consuming the k-mers
+ *****************************************************************************/
+template<class UInt, class Consumer>
+inline void
+for_each_kmer_2bit(numk_t k,
+                   packed_sequence::const_iterator first,
+                   packed_sequence::const_iterator last,
+                   Consumer&& consume)
+{
+    static_assert(std::is_integral<UInt>::value &&
+                  std::is_unsigned<UInt>::value,
+                  "only unsigned integer types are supported");
+
+    using ambig_t = half_size_t<UInt>;
+
+    auto kmer    = UInt(0);
+    auto kmerMsk = UInt(~0);
+    kmerMsk >>= (sizeof(kmerMsk) * CHAR_BIT) - (k * 2);
+
+    auto ambig    = ambig_t(0);  // bitfield marking ambiguous nucleotides
+    auto ambigMsk = ambig_t(~0);
+    ambigMsk >>= (sizeof(ambigMsk) * CHAR_BIT) - k;
+
+    if (!(first < last)) return;
+
+    const packed_sequence& seq = *first.sequence();
+
+    for (auto i = first.index(), e = last.index(); i < e; ++i) {
+        // append next letter
+        kmer  = (kmer << 2) | UInt(seq.code(i));
+        ambig = (ambig << 1) | ambig_t(seq.ambiguous(i));
+        --k;
+        // make sure we load k letters at the beginning
+        if (k == 0) {
+            kmer  &= kmerMsk;   // stamp out 2*k lower bits
+            ambig &= ambigMsk;  // stamp out k lower bits
+
+            // do something with the kmer (and the ambiguous letters flag)
+            consume(kmer, ambig);
+            ++k; // we want only one letter next time
+        }
+    }
+}
+
+
+
 /*************************************************************************//**
  * @brief loops through all 2-bit encoded k-mers in a sequence of characters
  *
@@ -21,10 +21,15 @@
 
 
 #include "filesys_utility.h"
+#include "io_error.h"
 
 #include <cstring>
 #include <dirent.h> // POSIX header
+#include <fcntl.h>
 #include <iterator>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 namespace mc {
@@ -115,6 +120,23 @@ file_size(const std::string& filename)
 
 
 
+//-------------------------------------------------------------------
+std::int64_t
+file_modification_time(const std::string& filename)
+{
+    struct stat st;
+    if (::stat(filename.c_str(), &st) != 0) return 0;
+#ifdef __APPLE__
+    return std::int64_t(st.st_mtimespec.tv_sec) * 1000000000 +
+           std::int64_t(st.st_mtimespec.tv_nsec);
+#else
+    return std::int64_t(st.st_mtim.tv_sec) * 1000000000 +
+           std::int64_t(st.st_mtim.tv_nsec);
+#endif
+}
+
+
+
 //-------------------------------------------------------------------
 bool file_readable(const std::string& filename)
 {
@@ -122,5 +144,84 @@ bool file_readable(const std::string& filename)
 }
 
 
+
+
+//-------------------------------------------------------------------
+bool is_regular_file(const std::string& filename)
+{
+    struct stat st;
+    return ::stat(filename.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+
+
+//-------------------------------------------------------------------
+mapped_file::mapped_file(const std::string& filename)
+{
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw file_access_error{"Could not open file '" + filename + "'"};
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        throw file_access_error{"Could not map file '" + filename + "'"};
+    }
+
+    size_ = std::size_t(st.st_size);
+    if (size_ > 0) {
+        void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            size_ = 0;
+            throw file_access_error{"Could not map file '" + filename + "'"};
+        }
+        data_ = static_cast<const char*>(p);
+    }
+    // mapping stays valid after closing the file descriptor
+    ::close(fd);
+}
+
+
+//-------------------------------------------------------------------
+mapped_file::~mapped_file()
+{
+    unmap();
+}
+
+
+//-------------------------------------------------------------------
+mapped_file::mapped_file(mapped_file&& src) noexcept :
+    data_{src.data_}, size_{src.size_}
+{
+    src.data_ = nullptr;
+    src.size_ = 0;
+}
+
+
+//-------------------------------------------------------------------
+mapped_file& mapped_file::operator = (mapped_file&& src) noexcept
+{
+    if (this != &src) {
+        unmap();
+        data_ = src.data_;
+        size_ = src.size_;
+        src.data_ = nullptr;
+        src.size_ = 0;
+    }
+    return *this;
+}
+
+
+//-------------------------------------------------------------------
+void mapped_file::unmap() noexcept
+{
+    if (data_) ::munmap(const_cast<char*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+
+
 } // namespace mc
 
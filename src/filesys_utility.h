@@ -23,6 +23,7 @@
 #define MC_FS_TOOLS_H_
 
 
+#include <cstdint>
 #include <fstream>
 #include <set>
 #include <string>
@@ -72,6 +73,16 @@ std::ifstream::pos_type file_size(const std::string& filename);
 
 
 
+/*************************************************************************//**
+ *
+ * @brief returns the last modification time of a file
+ *        (nanoseconds since epoch; 0 if file doesn't exist)
+ *
+ *****************************************************************************/
+std::int64_t file_modification_time(const std::string& filename);
+
+
+
 /*************************************************************************//**
  *
  * @return true, if file with name 'filename' could be opened for reading
@@ -80,6 +91,53 @@ std::ifstream::pos_type file_size(const std::string& filename);
 bool file_readable(const std::string& filename);
 
 
+
+/*************************************************************************//**
+ *
+ * @return true, if 'filename' refers to a regular file
+ *         (and not to a directory, pipe, device, ...)
+ *
+ *****************************************************************************/
+bool is_regular_file(const std::string& filename);
+
+
+
+/*************************************************************************//**
+ *
+ * @brief read-only memory mapping of a whole regular file (POSIX)
+ *
+ *****************************************************************************/
+class mapped_file
+{
+public:
+    mapped_file() = default;
+
+    /** @throws file_access_error if file could not be mapped */
+    explicit
+    mapped_file(const std::string& filename);
+
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator = (const mapped_file&) = delete;
+
+    mapped_file(mapped_file&&) noexcept;
+    mapped_file& operator = (mapped_file&&) noexcept;
+
+    const char* begin() const noexcept { return data_; }
+    const char* end()   const noexcept { return data_ + size_; }
+
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+
+private:
+    void unmap() noexcept;
+
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+
 } // namespace mc
 
 
@@ -0,0 +1,429 @@
+/******************************************************************************
+ *
+ * MetaCache - Meta-Genomic Classification Tool
+ *
+ * Copyright (C) 2016-2024 André Müller (muellan@uni-mainz.de)
+ *                       & Robin Kobus  (kobus@uni-mainz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef MC_NO_ZLIB
+
+#include "gzip_stream.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace mc {
+
+
+//-------------------------------------------------------------------
+// size of decompressed blocks of non-BGZF gzip files
+static constexpr std::size_t gzip_block_size = std::size_t(1) << 20;
+// max. number of BGZF members that are decompressed as one block
+static constexpr std::size_t bgzf_members_per_block = 16;
+// BGZF members decompress to at most 64 KiB
+static constexpr std::uint32_t bgzf_max_member_size = 1 << 16;
+// more BGZF decompression threads hardly speed up reading
+static constexpr unsigned bgzf_max_workers = 4;
+
+
+
+//-------------------------------------------------------------------
+enum class bgzf_status { ok, end, truncated, error };
+
+/*****************************************************************************
+ *
+ * @brief appends next BGZF member (gzip member with 'BC' extra subfield
+ *        that contains the member size) to 'buf';
+ *        a truncated member is appended as far as it could be read
+ *
+ *****************************************************************************/
+static bgzf_status
+read_bgzf_member (std::FILE* file, std::vector<unsigned char>& buf,
+                  std::uint32_t& isize)
+{
+    unsigned char head[12];
+    const auto n = std::fread(head, 1, 12, file);
+    if (n == 0) return bgzf_status::end;
+
+    if (n < 12 || head[0] != 0x1f || head[1] != 0x8b || head[2] != 8 ||
+        !(head[3] & 4))
+    {
+        return bgzf_status::error;
+    }
+
+    const std::size_t xlen = head[10] | (std::size_t(head[11]) << 8);
+    const std::size_t offset = buf.size();
+    buf.resize(offset + 12 + xlen);
+    std::memcpy(buf.data() + offset, head, 12);
+    if (std::fread(buf.data() + offset + 12, 1, xlen, file) != xlen) {
+        return bgzf_status::error;
+    }
+
+    // total member size from 'BC' subfield
+    std::size_t bsize = 0;
+    for (std::size_t i = 0; i + 4 <= xlen; ) {
+        const unsigned char* sub = buf.data() + offset + 12 + i;
+        const std::size_t slen = sub[2] | (std::size_t(sub[3]) << 8);
+        if (sub[0] == 'B' && sub[1] == 'C' && slen == 2 && i + 6 <= xlen) {
+            bsize = (sub[4] | (std::size_t(sub[5]) << 8)) + 1;
+            break;
+        }
+        i += 4 + slen;
+    }
+    // header + deflate data + crc32 + isize
+    if (bsize < 12 + xlen + 8) return bgzf_status::error;
+
+    const std::size_t rest = bsize - 12 - xlen;
+    buf.resize(offset + bsize);
+    const auto r = std::fread(buf.data() + offset + 12 + xlen, 1, rest, file);
+    if (r != rest) {
+        buf.resize(offset + 12 + xlen + r);
+        return bgzf_status::truncated;
+    }
+
+    const unsigned char* tail = buf.data() + offset + bsize - 4;
+    isize = tail[0] | (std::uint32_t(tail[1]) << 8) |
+            (std::uint32_t(tail[2]) << 16) | (std::uint32_t(tail[3]) << 24);
+
+    return bgzf_status::ok;
+}
+
+
+
+//-------------------------------------------------------------------
+bool gzip_reader::open (const char* filename, unsigned maxThreads)
+{
+    close();
+
+    // decompress on the reading thread
+    if (maxThreads < 2) {
+        gzfile_ = gzopen(filename, "r");
+        if (gzfile_ == Z_NULL) {
+            gzfile_ = nullptr;
+            return false;
+        }
+        mode_ = mode::plain;
+        return true;
+    }
+
+    rawfile_ = std::fopen(filename, "rb");
+    if (!rawfile_) return false;
+
+    unsigned char magic[2] = {0,0};
+    const bool gzipped = std::fread(magic, 1, 2, rawfile_) == 2 &&
+                         magic[0] == 0x1f && magic[1] == 0x8b;
+
+    bool bgzf = false;
+    if (gzipped) {
+        std::rewind(rawfile_);
+        std::vector<unsigned char> member;
+        std::uint32_t isize = 0;
+        bgzf = read_bgzf_member(rawfile_, member, isize) == bgzf_status::ok;
+    }
+    std::rewind(rawfile_);
+
+    if (bgzf) {
+        mode_ = mode::bgzf;
+        start_workers(std::min(bgzf_max_workers, maxThreads - 1));
+        return true;
+    }
+
+    std::fclose(rawfile_);
+    rawfile_ = nullptr;
+
+    gzfile_ = gzopen(filename, "r");
+    if (gzfile_ == Z_NULL) {
+        gzfile_ = nullptr;
+        return false;
+    }
+
+    if (gzipped) {
+        mode_ = mode::gzip;
+        start_workers(1);
+    }
+    else {
+        mode_ = mode::plain;
+    }
+    return true;
+}
+
+
+
+//-------------------------------------------------------------------
+void gzip_reader::start_workers (unsigned numWorkers)
+{
+    slots_.resize(2 * numWorkers + 2);
+    for (std::size_t i = 0; i < slots_.size(); ++i) {
+        slots_[i].seq = i;
+    }
+
+    for (unsigned i = 0; i < numWorkers; ++i) {
+        workers_.emplace_back(std::async(std::launch::async, [this] {
+            if (mode_ == mode::bgzf)
+                decompress_bgzf();
+            else
+                decompress_gzip();
+        }));
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+void gzip_reader::close ()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    filled_.notify_all();
+    freed_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.valid()) worker.get();
+    }
+    workers_.clear();
+    slots_.clear();
+
+    if (gzfile_) {
+        gzclose(gzfile_);
+        gzfile_ = nullptr;
+    }
+    if (rawfile_) {
+        std::fclose(rawfile_);
+        rawfile_ = nullptr;
+    }
+
+    mode_    = mode::none;
+    readSeq_ = 0;
+    jobSeq_  = 0;
+    endSeq_  = 0;
+    ended_   = false;
+    error_   = false;
+    stop_    = false;
+}
+
+
+
+//-------------------------------------------------------------------
+gzip_reader::slot*
+gzip_reader::acquire_slot (std::uint64_t seq)
+{
+    auto& s = slots_[seq % slots_.size()];
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    freed_.wait(lock, [&] { return stop_ || (s.seq == seq && !s.filled); });
+
+    return stop_ ? nullptr : &s;
+}
+
+
+
+//-------------------------------------------------------------------
+void gzip_reader::publish_slot (slot& s)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        s.pos = 0;
+        s.filled = true;
+    }
+    filled_.notify_all();
+}
+
+
+
+//-------------------------------------------------------------------
+void gzip_reader::finish (std::uint64_t endSeq, bool error)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ended_ || endSeq < endSeq_) endSeq_ = endSeq;
+        ended_ = true;
+        error_ = error_ || error;
+    }
+    filled_.notify_all();
+}
+
+
+
+//-------------------------------------------------------------------
+void gzip_reader::decompress_gzip ()
+{
+    for (std::uint64_t seq = 0; ; ++seq) {
+        slot* s = acquire_slot(seq);
+        if (!s) return;
+
+        s->data.resize(gzip_block_size);
+        const int n = gzread(gzfile_, s->data.data(), unsigned(gzip_block_size));
+        if (n <= 0) {
+            finish(seq, n < 0);
+            return;
+        }
+        s->size = n;
+        publish_slot(*s);
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+void gzip_reader::decompress_bgzf ()
+{
+    std::vector<unsigned char> compressed;
+    std::vector<std::size_t> offsets;
+    std::vector<std::uint32_t> sizes;
+    unsigned char empty = 0;
+
+    z_stream strm;
+    std::memset(&strm, 0, sizeof(strm));
+    // gzip wrapper
+    if (inflateInit2(&strm, 15 + 16) != Z_OK) {
+        finish(0, true);
+        return;
+    }
+
+    for (;;) {
+        compressed.clear();
+        offsets.clear();
+        sizes.clear();
+        std::uint64_t seq = 0;
+        bool last = false;
+        bool error = false;
+
+        // read next group of members
+        {
+            std::lock_guard<std::mutex> lock(fileMutex_);
+            seq = jobSeq_++;
+            for (std::size_t i = 0; i < bgzf_members_per_block; ++i) {
+                std::uint32_t isize = 0;
+                const auto offset = compressed.size();
+                const auto status = read_bgzf_member(rawfile_, compressed, isize);
+                if (status == bgzf_status::truncated) {
+                    // decompress as much as possible
+                    offsets.push_back(offset);
+                    sizes.push_back(bgzf_max_member_size);
+                }
+                if (status != bgzf_status::ok) {
+                    last = true;
+                    error = status != bgzf_status::end;
+                    break;
+                }
+                offsets.push_back(offset);
+                sizes.push_back(isize);
+            }
+        }
+
+        if (sizes.empty()) {
+            finish(seq, error);
+            break;
+        }
+
+        slot* s = acquire_slot(seq);
+        if (!s) break;
+
+        std::size_t total = 0;
+        for (auto isize : sizes) total += isize;
+        s->data.resize(total);
+
+        // inflate members
+        std::size_t out = 0;
+        for (std::size_t i = 0; i < sizes.size(); ++i) {
+            const auto in = offsets[i];
+            const auto isize = sizes[i];
+
+            inflateReset(&strm);
+            strm.next_in   = compressed.data() + in;
+            strm.avail_in  = unsigned(compressed.size() - in);
+            // zlib needs a valid output pointer even for empty members
+            strm.next_out  = isize > 0 ? s->data.data() + out : &empty;
+            strm.avail_out = isize;
+
+            const int ret = inflate(&strm, Z_FINISH);
+            out += strm.total_out;
+            if (ret != Z_STREAM_END || strm.total_out != isize) {
+                error = true;
+                break;
+            }
+        }
+        s->size = out;
+        publish_slot(*s);
+
+        if (last || error) {
+            finish(seq + 1, error);
+            break;
+        }
+    }
+
+    inflateEnd(&strm);
+}
+
+
+
+//-------------------------------------------------------------------
+int gzip_reader::read (void* buffer, std::size_t size)
+{
+    if (mode_ == mode::plain) {
+        return gzread(gzfile_, buffer, unsigned(size));
+    }
+    if (mode_ == mode::none) return -1;
+
+    auto out = static_cast<unsigned char*>(buffer);
+    std::size_t count = 0;
+
+    while (count < size) {
+        auto& s = slots_[readSeq_ % slots_.size()];
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        filled_.wait(lock, [&] {
+            return (s.filled && s.seq == readSeq_) ||
+                   (ended_ && readSeq_ >= endSeq_);
+        });
+
+        if (!s.filled || s.seq != readSeq_) {
+            // end of input
+            if (error_ && count == 0) return -1;
+            break;
+        }
+        lock.unlock();
+
+        const std::size_t n = std::min(size - count, s.size - s.pos);
+        std::memcpy(out + count, s.data.data() + s.pos, n);
+        s.pos += n;
+        count += n;
+
+        if (s.pos >= s.size) {
+            // slot can be re-used for block 'readSeq_ + number of slots'
+            {
+                std::lock_guard<std::mutex> guard(mutex_);
+                s.filled = false;
+                s.seq = readSeq_ + slots_.size();
+            }
+            freed_.notify_all();
+            ++readSeq_;
+        }
+    }
+
+    return int(count);
+}
+
+
+} // namespace mc
+
+
+#endif
@@ -0,0 +1,127 @@
+/******************************************************************************
+ *
+ * MetaCache - Meta-Genomic Classification Tool
+ *
+ * Copyright (C) 2016-2024 André Müller (muellan@uni-mainz.de)
+ *                       & Robin Kobus  (kobus@uni-mainz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef MC_GZIP_STREAM_H_
+#define MC_GZIP_STREAM_H_
+
+#ifndef MC_NO_ZLIB
+
+#include <zlib.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <future>
+#include <mutex>
+#include <vector>
+
+
+namespace mc {
+
+
+/*************************************************************************//**
+ *
+ * @brief reads gzip compressed or uncompressed files;
+ *        if more than one thread may be used, decompression of gzip files
+ *        runs on separate thread(s) and is decoupled from the reading
+ *        thread by a bounded ring buffer of decompressed blocks;
+ *        BGZF files (independent gzip members with known sizes) are
+ *        decompressed by several threads in parallel,
+ *        all other gzip files are decompressed by one thread;
+ *        uncompressed files are read directly
+ *        NOT concurrency safe
+ *
+ *****************************************************************************/
+class gzip_reader
+{
+public:
+    gzip_reader () = default;
+    ~gzip_reader () { close(); }
+
+    gzip_reader (const gzip_reader&) = delete;
+    gzip_reader& operator = (const gzip_reader&) = delete;
+
+
+    /** @param  maxThreads  max. number of threads used for reading
+     *                      (including the calling thread);
+     *                      1: decompress on the calling thread
+     *  @return false, if file could not be opened */
+    bool open (const char* filename, unsigned maxThreads = 1);
+
+    void close ();
+
+    /** @brief reads up to 'size' decompressed bytes into buffer
+     *  @return number of bytes read; 0: end of file; -1: read error */
+    int read (void* buffer, std::size_t size);
+
+
+private:
+    enum class mode : unsigned char { none, plain, gzip, bgzf };
+
+    struct slot {
+        std::vector<unsigned char> data;
+        std::size_t size = 0;
+        std::size_t pos = 0;
+        // number of next block that is to be stored in this slot
+        std::uint64_t seq = 0;
+        bool filled = false;
+    };
+
+    void start_workers (unsigned numWorkers);
+    void decompress_gzip ();
+    void decompress_bgzf ();
+
+    /** @brief waits until slot for block 'seq' can be written to;
+     *         returns nullptr, if reading was stopped */
+    slot* acquire_slot (std::uint64_t seq);
+    void publish_slot (slot&);
+    void finish (std::uint64_t endSeq, bool error);
+
+    mode mode_ = mode::none;
+    gzFile gzfile_ = nullptr;
+    std::FILE* rawfile_ = nullptr;
+
+    std::vector<slot> slots_;
+    std::vector<std::future<void>> workers_;
+    std::mutex mutex_;
+    std::condition_variable filled_;
+    std::condition_variable freed_;
+    std::mutex fileMutex_;
+
+    // number of next block to be read by the consumer
+    std::uint64_t readSeq_ = 0;
+    // number of next compressed job (protected by fileMutex_)
+    std::uint64_t jobSeq_ = 0;
+    // total number of blocks (known after end of input was reached)
+    std::uint64_t endSeq_ = 0;
+    bool ended_ = false;
+    bool error_ = false;
+    bool stop_ = false;
+};
+
+
+} // namespace mc
+
+
+#endif
+
+#endif
@@ -29,7 +29,9 @@
 #include "stat_combined.h"
 #include "taxonomy.h"
 
+#include <algorithm>
 #include <set>
+#include <thread>
 #include <vector>
 
 
@@ -98,7 +100,8 @@ public:
         maxLocationsPerFeature_{other.maxLocationsPerFeature_},
         hashTables_{std::move(other.hashTables_)},
         sketchers_{std::move(other.sketchers_)},
-        inserters_{std::move(other.inserters_)}
+        inserters_{std::move(other.inserters_)},
+        sketchingPools_{std::move(other.sketchingPools_)}
     {}
 
     host_hashmap& operator = (const host_hashmap&) = delete;
@@ -115,11 +118,23 @@ public:
 
 
     //---------------------------------------------------------------
-    void initialize_build_hash_tables(part_id numParts) {
+    void initialize_build_hash_tables(part_id numParts, unsigned numThreads) {
         hashTables_.resize(numParts);
         inserters_.resize(numParts);
         sketchers_.resize(numParts);
 
+        // all parts are built concurrently; share threads among them
+        const unsigned threadsPerPart =
+            std::max(1U, numThreads / std::max(part_id(1), numParts));
+
+        sketchingPools_.clear();
+        sketchingPools_.resize(numParts);
+        if (threadsPerPart > 1) {
+            for (auto& pool : sketchingPools_) {
+                pool = std::make_unique<fork_join_pool>(threadsPerPart);
+            }
+        }
+
         for (auto& hashTable : hashTables_)
             hashTable.max_load_factor(maxLoadFactor_);
     }
@@ -403,13 +418,37 @@ public:
     //---------------------------------------------------------------
     /**
      * @brief adds sketches to database for all windows in sequence
+     *
+     * @tparam Sequence : character sequence or 2-bit packed sequence
      */
+    template<class Sequence>
     window_id add_target(part_id part,
-                         const sequence& seq, target_id tgt,
+                         const Sequence& seq, target_id tgt,
                          const sketching_opt& opt)
+    {
+        return add_target(part, seq, tgt, opt, [] (const sketch&) {});
+    }
+
+    //-----------------------------------------------------
+    /**
+     * @brief adds sketches to database for all windows in sequence;
+     *        'onSketch' is called for each window sketch in window order
+     */
+    template<class Sequence, class SketchConsumer>
+    window_id add_target(part_id part,
+                         const Sequence& seq, target_id tgt,
+                         const sketching_opt& opt,
+                         SketchConsumer&& onSketch)
     {
         if (!inserters_[part]) make_sketch_inserter(part);
 
+        if (part < sketchingPools_.size() && sketchingPools_[part] &&
+            opt.winlen >= opt.kmerlen &&
+            window_count(seq.size(), opt) >= 2 * windows_per_sketching_chunk())
+        {
+            return add_target_chunked(part, seq, tgt, opt, onSketch);
+        }
+
         window_id win = 0;
         sketchers_[part].for_each_sketch(seq, opt,
             [&, this] (const auto& sk) {
@@ -420,6 +459,35 @@ public:
                     sketch.win = win;
                     sketch.sk = sk;
                 }
+                onSketch(sk);
+                ++win;
+            });
+
+        return win;
+    }
+
+    //---------------------------------------------------------------
+    /**
+     * @brief adds pre-computed window sketches to database
+     *
+     * @tparam Sketches : provides for_each_sketch(consume(first,last))
+     */
+    template<class Sketches>
+    window_id add_target_sketches(part_id part,
+                                  const Sketches& sketches, target_id tgt)
+    {
+        if (!inserters_[part]) make_sketch_inserter(part);
+
+        window_id win = 0;
+        sketches.for_each_sketch(
+            [&, this] (auto first, auto last) {
+                if (inserters_[part]->valid()) {
+                    // insert sketch into batch
+                    auto& sketch = inserters_[part]->next_item();
+                    sketch.tgt = tgt;
+                    sketch.win = win;
+                    sketch.sk.assign(first, last);
+                }
                 ++win;
             });
 
@@ -427,6 +495,106 @@ public:
     }
 
 private:
+    //---------------------------------------------------------------
+    static constexpr std::size_t
+    windows_per_sketching_chunk() noexcept {
+        return 4096;
+    }
+
+
+    //---------------------------------------------------------------
+    /**
+     * @brief number of windows visited by 'for_each_window'
+     */
+    static std::size_t
+    window_count(std::size_t seqLength, const sketching_opt& opt) noexcept
+    {
+        if (seqLength <= opt.winlen) return 1;
+        const std::size_t full = (seqLength - opt.winlen) / opt.winstride + 1;
+        return full + ((full * opt.winstride < seqLength) ? 1 : 0);
+    }
+
+
+    //---------------------------------------------------------------
+    /**
+     * @brief sketches windows [firstWin,lastWin) of a sequence;
+     *        each window is sketched separately, so the results are
+     *        identical to those of a single pass over the whole sequence
+     */
+    template<class Sequence>
+    static void
+    sketch_window_range(sketcher& windowSketcher,
+                        const Sequence& seq, const sketching_opt& opt,
+                        std::size_t firstWin, std::size_t lastWin,
+                        std::vector<sketch>& sketches)
+    {
+        using std::begin;
+
+        sketches.clear();
+        for (std::size_t w = firstWin; w < lastWin; ++w) {
+            const auto wbeg = w * opt.winstride;
+            const auto wend = std::min(wbeg + opt.winlen, seq.size());
+            windowSketcher.for_each_sketch(begin(seq) + wbeg, begin(seq) + wend, opt,
+                [&] (const auto& sk) { sketches.push_back(sk); });
+        }
+    }
+
+
+    //---------------------------------------------------------------
+    /**
+     * @brief splits long sequence into window-aligned chunks that are
+     *        sketched concurrently; sketches are handed to the inserter
+     *        in window order, so window ids are the same as with
+     *        sequential sketching
+     */
+    template<class Sequence, class SketchConsumer>
+    window_id add_target_chunked(part_id part,
+                                 const Sequence& seq, target_id tgt,
+                                 const sketching_opt& opt,
+                                 SketchConsumer& onSketch)
+    {
+        const std::size_t numWindows = window_count(seq.size(), opt);
+        const std::size_t chunkSize  = windows_per_sketching_chunk();
+        auto& pool = *sketchingPools_[part];
+        const std::size_t numThreads = pool.size();
+
+        std::vector<sketcher> chunkSketchers(numThreads, sketchers_[part]);
+        std::vector<std::vector<sketch>> chunkSketches(numThreads);
+
+        window_id win = 0;
+        std::size_t roundBegin = 0;
+
+        while (roundBegin < numWindows && inserters_[part]->valid()) {
+            // sketch one chunk per thread
+            pool.for_each_index(numThreads, [&] (std::size_t i) {
+                const auto first = std::min(roundBegin + i * chunkSize, numWindows);
+                const auto last  = std::min(first + chunkSize, numWindows);
+
+                sketch_window_range(chunkSketchers[i], seq, opt,
+                                    first, last, chunkSketches[i]);
+            });
+
+            // insert sketches of all chunks in order
+            for (const auto& sketches : chunkSketches) {
+                for (const auto& sk : sketches) {
+                    if (inserters_[part]->valid()) {
+                        auto& sketch = inserters_[part]->next_item();
+                        sketch.tgt = tgt;
+                        sketch.win = win;
+                        sketch.sk = sk;
+                    }
+                    onSketch(sk);
+                    ++win;
+                }
+            }
+
+            roundBegin += numThreads * chunkSize;
+        }
+
+        return win;
+    }
+
+
     //---------------------------------------------------------------
     void add_sketch_batch(part_id part, const sketch_batch& batch) {
         for (const auto& windowSketch : batch) {
@@ -462,8 +630,9 @@ private:
      * @brief accumulate matches from first db part,
      *        keep sketches in case of multiple db parts
      */
+    template<class Sequence>
     sketch
-    accumulate_matches(const sequence& query1, const sequence& query2,
+    accumulate_matches(const Sequence& query1, const Sequence& query2,
                        query_handler<location>& queryHandler,
                        const sketching_opt& opt,
                        bool keepSketches) const
@@ -527,8 +696,9 @@ private:
 
 public:
     //---------------------------------------------------------------
+    template<class Sequence>
     void
-    query_host_hashmap(const sequence& query1, const sequence& query2,
+    query_host_hashmap(const Sequence& query1, const Sequence& query2,
                        query_handler<location>& queryHandler,
                        const taxonomy_cache& taxonomy,
                        const sketching_opt& opt,
@@ -544,7 +714,7 @@ public:
         sketch allWindowSketch = accumulate_matches(
             query1, query2, queryHandler, opt, num_parts() > 1);
 
-        sorter.sort();
+        queryHandler.finish_part_matches();
 
         // accumulate and sort matches from other db parts
         for (part_id part = 1; part < num_parts(); ++part) {
@@ -552,11 +722,35 @@ public:
 
             accumulate_matches(part, queryHandler, allWindowSketch);
 
-            sorter.sort();
+            queryHandler.finish_part_matches();
+        }
+
+        queryHandler.make_candidates(taxonomy, rules);
+    }
+
+    //---------------------------------------------------------------
+    /**
+     * @brief query with pre-computed sketches of all query windows
+     */
+    void
+    query_host_hashmap(const sketch& allWindowSketch,
+                       query_handler<location>& queryHandler,
+                       const taxonomy_cache& taxonomy,
+                       const candidate_generation_rules& rules) const
+    {
+        queryHandler.clear();
+
+        auto& sorter = queryHandler.matchesSorter;
+
+        for (part_id part = 0; part < num_parts(); ++part) {
+            sorter.next();
+
+            accumulate_matches(part, queryHandler, allWindowSketch);
+
+            queryHandler.finish_part_matches();
         }
 
-        queryHandler.classificationCandidates.insert(
-            taxonomy, queryHandler.matchesSorter.locations(), rules);
+        queryHandler.make_candidates(taxonomy, rules);
     }
 
     //---------------------------------------------------------------
@@ -588,6 +782,8 @@ private:
 
     std::vector<sketcher> sketchers_;
     std::vector<std::unique_ptr<batch_executor<window_sketch>>> inserters_;
+    // sketch long targets concurrently (one pool per part)
+    std::vector<std::unique_ptr<fork_join_pool>> sketchingPools_;
 };
 
 
@@ -56,6 +56,9 @@ int main(int argc, char** argv)
         else if (modestr == "merge") {
             main_mode_merge(make_args_list(argv+2, argv+argc));
         }
+        else if (modestr == "convert") {
+            main_mode_convert(make_args_list(argv+2, argv+argc));
+        }
         else if (modestr == "info") {
             main_mode_info(make_args_list(argv+2, argv+argc));
         }
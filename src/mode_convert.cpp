@@ -0,0 +1,157 @@
+/******************************************************************************
+ *
+ * MetaCache - Meta-Genomic Classification Tool
+ *
+ * Copyright (C) 2016-2024 André Müller (muellan@uni-mainz.de)
+ *                       & Robin Kobus  (kobus@uni-mainz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "cmdline_utility.h"
+#include "io_error.h"
+#include "options.h"
+#include "print_buffer.h"
+#include "result_io.h"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+
+namespace mc {
+
+using std::cout;
+using std::endl;
+using std::string;
+
+
+
+/*************************************************************************//**
+ *
+ * @brief renders one binary query result as text line
+ *
+ *****************************************************************************/
+void show_query_result(print_buffer& os,
+                       const result_file_properties& props,
+                       const formatting_tokens& tokens,
+                       const query_result& res)
+{
+    const auto& colsep = tokens.column;
+    const auto w = props.sketching.winstride;
+
+    os << res.id << colsep << res.header << colsep;
+
+    for (std::size_t i = 0; i < res.candidates.size(); ++i) {
+        if (i > 0) os << ',';
+        os << res.candidates[i].taxid << ':' << res.candidates[i].hits;
+    }
+    os << colsep;
+
+    for (std::size_t i = 0; i < res.candidates.size(); ++i) {
+        if (i > 0) os << ',';
+        os << res.candidates[i].tgt;
+    }
+    os << colsep;
+
+    for (const auto& c : res.candidates) {
+        os << '[' << (w * c.pos.beg)
+           << ',' << (w * c.pos.end + props.sketching.winlen) << "] ";
+    }
+    os << colsep;
+
+    if (res.taxid == taxonomy::none_id()) {
+        os << tokens.none;
+    } else {
+        os << taxonomy::rank_name(res.rank) << tokens.rankSuffix << res.taxid;
+    }
+
+    os << '\n';
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief renders binary result file as text
+ *
+ *****************************************************************************/
+void convert_result_file(const string& filename, std::ostream& os)
+{
+    result_reader reader{filename};
+
+    const auto& props = reader.properties();
+    const formatting_tokens tokens;
+    const auto& colsep = tokens.column;
+
+    os << tokens.comment << "Converted from binary result file: " << filename << '\n'
+       << tokens.comment << "Classification candidates are reported on rank '"
+       << taxonomy::rank_name(props.candidateRank) << "'.\n"
+       << tokens.comment << "TABLE_LAYOUT: query_id" << colsep
+       << "query_header" << colsep << "top_hits" << colsep
+       << "top_targets" << colsep << "candidate_locations" << colsep
+       << "rank" << tokens.rankSuffix << "taxid\n";
+
+    // output is written in chunks
+    constexpr std::size_t maxBufferSize = std::size_t(1) << 20;
+    print_buffer buf;
+    query_result res;
+
+    while (reader.has_next()) {
+        reader.next(res);
+        show_query_result(buf, props, tokens, res);
+
+        if (buf.size() >= maxBufferSize) {
+            os << buf;
+            buf.clear();
+        }
+    }
+    os << buf;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief converts binary result files to text
+ *
+ *****************************************************************************/
+void main_mode_convert(const cmdline_args& args)
+{
+    const auto opt = get_convert_options(args);
+
+    std::ostream* os = &cout;
+
+    std::ofstream outFile;
+    if (!opt.outfile.empty()) {
+        outFile.open(opt.outfile, std::ios::out);
+
+        if (outFile.good()) {
+            cout << "Converted results will be written to file: " << opt.outfile << endl;
+            os = &outFile;
+        }
+        else {
+            throw file_write_error{"Could not write to file " + opt.outfile};
+        }
+    }
+
+    for (const auto& filename : opt.infiles) {
+        convert_result_file(filename, *os);
+    }
+    os->flush();
+}
+
+
+} // namespace mc
@@ -57,6 +57,7 @@ void main_mode_help (const cmdline_args& args)
             "    query         classify read sequences using pre-built database\n"
             "    build+query   build new database and query directly afterwards\n"
             "    merge         merge classification results of independent queries\n"
+            "    convert       render binary classification results as text\n"
             "    info          show database and reference sequence properties\n"
             "\n"
             "\n"
@@ -97,6 +98,9 @@ void main_mode_help (const cmdline_args& args)
     else if (args[2] == "merge") {
         std::cout << merge_mode_docs() << '\n';
     }
+    else if (args[2] == "convert") {
+        std::cout << convert_mode_docs() << '\n';
+    }
     else if (args[2] == "info") {
         std::cout << info_mode_docs() << '\n';
     }
@@ -110,6 +114,7 @@ void main_mode_help (const cmdline_args& args)
             << "    modify\n"
             << "    query\n"
             << "    merge\n"
+            << "    convert\n"
             << "    info\n";
     }
 }
@@ -29,9 +29,15 @@
 #include "io_error.h"
 #include "options.h"
 #include "printing.h"
+#include "result_io.h"
 #include "taxonomy_io.h"
 
+#include <algorithm>
+#include <atomic>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -76,23 +82,19 @@ struct results_source {
 
 /*************************************************************************//**
  *
- * @brief parse classification result file
+ * @brief parses header of text results;
+ *        stream is positioned after the TABLE_LAYOUT line afterwards
+ *
+ * @return (1-based) column index of top hits
  *
  *****************************************************************************/
-results_source
-get_results_file_properties(const string& filename)
+int read_results_header(std::istream& is, const string& filename)
 {
-    results_source res;
-    res.filename = filename;
-
-    std::ifstream ifs(filename);
-    if (!ifs.good()) throw io_error("could not open file " + filename);
-
     string line;
 
     // check classification rank
-    while (ifs.good()) {
-        getline(ifs, line);
+    while (is.good()) {
+        getline(is, line);
         if (line[0] != '#') {
             throw io_format_error("classificaion ranks not found in file " + filename);
         }
@@ -104,9 +106,11 @@ get_results_file_properties(const string& filename)
         }
     }
 
+    int tophitsColumn = 0;
+
     // get layout
-    while (ifs.good()) {
-        getline(ifs, line);
+    while (is.good()) {
+        getline(is, line);
         if (line[0] != '#') {
             throw io_format_error("TABLE_LAYOUT not found in file " + filename);
         }
@@ -123,16 +127,37 @@ get_results_file_properties(const string& filename)
                 lineStream >> column;
                 ++col;
                 if (column == "top_hits") {
-                    res.tophitsColumn = col;
+                    tophitsColumn = col;
                     break;
                 }
             }
             break;
         }
     }
-    if (res.tophitsColumn < 1)
+    if (tophitsColumn < 1)
         throw io_format_error("no top_hits in file " + filename);
 
+    return tophitsColumn;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief parse classification result file
+ *
+ *****************************************************************************/
+results_source
+get_results_file_properties(const string& filename)
+{
+    results_source res;
+    res.filename = filename;
+
+    std::ifstream ifs(filename);
+    if (!ifs.good()) throw io_error("could not open file " + filename);
+
+    res.tophitsColumn = read_results_header(ifs, filename);
+
     char lineBegin = ifs.peek();
     // skip comments
     while (ifs.good() && lineBegin == '#') {
@@ -232,6 +257,639 @@ void read_results(const results_source& res,
 
 
 
+/*************************************************************************//**
+ *
+ * @brief extract query headers and candidates from binary results file
+ *
+ *****************************************************************************/
+void read_binary_results(const string& filename,
+                         const taxonomy_cache& taxonomy,
+                         const candidate_generation_rules& rules,
+                         vector<string>& queryHeaders,
+                         vector<classification_candidates>& queryCandidates)
+{
+    result_reader reader{filename};
+
+    if (reader.properties().candidateRank == taxon_rank::Sequence) {
+        throw io_format_error("cannot merge results on sequence level");
+    }
+
+    query_result res;
+    while (reader.has_next()) {
+        reader.next(res);
+
+        const size_t queryId = res.id > 0 ? res.id - 1 : 0;
+
+        if (queryId+1 > queryCandidates.size()) {
+            queryCandidates.resize(queryId+1);
+            queryHeaders.resize(queryId+1);
+        }
+
+        if (queryHeaders[queryId].empty() && !res.header.empty()) {
+            queryHeaders[queryId] = res.header;
+        }
+
+        for (const auto& cand : res.candidates) {
+            const taxon* tax = taxonomy.taxon_with_id(cand.taxid);
+            if (tax) {
+                queryCandidates[queryId].insert(match_candidate{tax, cand.hits}, taxonomy, rules);
+            } else {
+                cerr << "Query " << queryId+1 << ": taxid " << cand.taxid << " not found. Skipping hit.\n";
+            }
+        }
+    }
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief line navigation in memory-mapped text results
+ *
+ *****************************************************************************/
+inline const char*
+next_line(const char* p, const char* end) noexcept
+{
+    p = std::find(p, end, '\n');
+    return p < end ? p + 1 : end;
+}
+
+/** @brief first line that starts at or after 'p' */
+inline const char*
+line_start(const char* p, const char* begin, const char* end) noexcept
+{
+    return (p <= begin || p[-1] == '\n') ? p : next_line(p, end);
+}
+
+/** @brief first result line (no comment, not empty) starting at line 'p' */
+inline const char*
+next_result_line(const char* p, const char* end) noexcept
+{
+    while (p < end && (*p == '#' || *p == '\n')) p = next_line(p, end);
+    return p;
+}
+
+
+
+//-------------------------------------------------------------------
+inline const char*
+skip_blanks(const char* p, const char* end) noexcept
+{
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    return p;
+}
+
+/** @brief parses (signed) integer; returns nullptr, if no digits found */
+template<class Int>
+inline const char*
+parse_integer(const char* p, const char* end, Int& x) noexcept
+{
+    p = skip_blanks(p, end);
+    const bool negative = p < end && *p == '-';
+    if (negative || (p < end && *p == '+')) ++p;
+
+    const char* first = p;
+    std::uint64_t v = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = 10 * v + std::uint64_t(*p - '0');
+        ++p;
+    }
+    if (p == first) {
+        x = 0;
+        return nullptr;
+    }
+    x = negative ? Int(0 - v) : Int(v);
+    return p;
+}
+
+inline query_id
+result_line_query_id(const char* line, const char* end) noexcept
+{
+    query_id id = 0;
+    parse_integer(line, end, id);
+    return id;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief memory-mapped text results file
+ *
+ *****************************************************************************/
+struct mapped_results
+{
+    string filename;
+    mapped_file file;
+    const char* resultsBegin = nullptr;
+    int tophitsColumn = 0;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief maps results file into memory and parses its header
+ *
+ *****************************************************************************/
+mapped_results
+map_results_file(const string& filename)
+{
+    mapped_results res;
+    res.filename = filename;
+    res.file = mapped_file{filename};
+
+    const char* begin = res.file.begin();
+    const char* end = res.file.end();
+
+    // header: leading comment lines
+    const char* p = begin;
+    while (p < end && *p == '#') p = next_line(p, end);
+
+    std::istringstream header{string(begin, p)};
+    res.tophitsColumn = read_results_header(header, filename);
+
+    p = header.good() ? begin + std::size_t(header.tellg()) : p;
+    res.resultsBegin = next_result_line(p, end);
+
+    return res;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @return true, if query ids of all result lines are in ascending order;
+ *         file is checked in 'numParts' concurrently processed parts
+ *
+ *****************************************************************************/
+bool results_ordered_by_query_id(const mapped_results& res, unsigned numParts)
+{
+    const char* begin = res.resultsBegin;
+    const char* end = res.file.end();
+    const auto size = std::size_t(end - begin);
+
+    struct part_info {
+        bool ordered = true;
+        bool empty = true;
+        query_id first = 0;
+        query_id last = 0;
+    };
+
+    std::vector<std::future<part_info>> parts;
+    for (unsigned i = 0; i < numParts; ++i) {
+        const char* first = line_start(begin + (size * i) / numParts, begin, end);
+        const char* last  = line_start(begin + (size * (i+1)) / numParts, begin, end);
+
+        parts.emplace_back(std::async(std::launch::async, [=] {
+            part_info info;
+            for (const char* p = next_result_line(first, end); p < last;
+                 p = next_result_line(next_line(p, end), end))
+            {
+                const auto id = result_line_query_id(p, end);
+                if (info.empty) {
+                    info.first = id;
+                    info.empty = false;
+                }
+                else if (id < info.last) {
+                    info.ordered = false;
+                    break;
+                }
+                info.last = id;
+            }
+            return info;
+        }));
+    }
+
+    bool ordered = true;
+    bool empty = true;
+    query_id last = 0;
+    for (auto& part : parts) {
+        const auto info = part.get();
+        if (!info.ordered || (!empty && !info.empty && info.first < last)) {
+            ordered = false;
+        }
+        if (!info.empty) {
+            last = info.last;
+            empty = false;
+        }
+    }
+    return ordered;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @return first result line with query id >= 'id' in [begin,end);
+ *         result lines must be ordered by query id
+ *
+ *****************************************************************************/
+const char*
+find_result_line(const char* begin, const char* end, query_id id) noexcept
+{
+    // narrow down with binary search over byte positions
+    const char* lo = begin;
+    const char* hi = end;
+    while (hi - lo > 4096) {
+        const char* mid = line_start(lo + (hi - lo) / 2, begin, end);
+        if (mid >= hi) break;
+        const char* line = next_result_line(mid, end);
+        if (line >= end || result_line_query_id(line, end) >= id) {
+            hi = mid;
+        } else {
+            lo = next_line(line, end);
+        }
+    }
+    // linear search
+    const char* line = next_result_line(lo, end);
+    while (line < end && result_line_query_id(line, end) < id) {
+        line = next_result_line(next_line(line, end), end);
+    }
+    return line;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief parses query id at the beginning of a result line
+ *
+ * @return position after query id
+ *
+ *****************************************************************************/
+inline const char*
+parse_result_id(const char* line, const char* lineEnd, query_id& queryId) noexcept
+{
+    const char* p = parse_integer(line, lineEnd, queryId);
+    return p ? p : line;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief parses rest of a result line after the query id;
+ *        sets query header (if not yet known) and adds top hits to candidates
+ *
+ *****************************************************************************/
+void parse_result_hits(const char* p, const char* lineEnd, int tophitsColumn,
+                       query_id queryId,
+                       const taxonomy_cache& taxonomy,
+                       const candidate_generation_rules& rules,
+                       string& queryHeader,
+                       classification_candidates& candidates)
+{
+    p = std::find(p, lineEnd, '|');
+    if (p < lineEnd) ++p;
+
+    // header: first contiguous string
+    p = skip_blanks(p, lineEnd);
+    const char* headerEnd = p;
+    while (headerEnd < lineEnd && *headerEnd != ' ' && *headerEnd != '\t') {
+        ++headerEnd;
+    }
+    if (queryHeader.empty()) queryHeader.assign(p, headerEnd);
+    p = headerEnd;
+
+    // skip to tophits
+    for (int c = 1; c < tophitsColumn; ++c) {
+        p = std::find(p, lineEnd, '|');
+        if (p < lineEnd) ++p;
+    }
+    p = std::find(p, lineEnd, '\t');
+    if (p < lineEnd) ++p;
+
+    // get tophits; '\t' marks end of tophits
+    while (p < lineEnd && *p != '\t') {
+        taxon_id taxid = 0;
+        const char* q = parse_integer(p, lineEnd, taxid);
+        if (!q) {
+            cerr << "Query " << queryId << ": Could not read taxid.\n";
+            q = p;
+        }
+        p = std::find(q, lineEnd, ':');
+        if (p < lineEnd) ++p;
+
+        match_candidate::count_type hits = 0;
+        q = parse_integer(p, lineEnd, hits);
+        if (q) p = q;
+
+        const taxon* tax = taxonomy.taxon_with_id(taxid);
+        if (tax) {
+            candidates.insert(match_candidate{tax, hits}, taxonomy, rules);
+        } else {
+            cerr << "Query " << queryId << ": taxid " << taxid << " not found. Skipping hit.\n";
+        }
+        // consume ',' between tophits or '\t' at the end
+        if (p >= lineEnd || *p++ == '\t') break;
+    }
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief parses result lines in [begin,end) and adds their query headers
+ *        and top hits to batch; query id i goes to index i - batch.firstId
+ *
+ *****************************************************************************/
+void read_results(const char* begin, const char* end, int tophitsColumn,
+                  const taxonomy_cache& taxonomy,
+                  const candidate_generation_rules& rules,
+                  query_candidates_batch& batch)
+{
+    for (const char* line = next_result_line(begin, end); line < end;
+         line = next_result_line(next_line(line, end), end))
+    {
+        const char* lineEnd = std::find(line, end, '\n');
+
+        query_id queryId = 0;
+        const char* p = parse_result_id(line, lineEnd, queryId);
+
+        const auto i = queryId > batch.firstId ? queryId - batch.firstId : 0;
+
+        // if results are incomplete, queryIds can exceed batch size
+        if (i >= batch.headers.size()) {
+            batch.headers.resize(i+1);
+            batch.candidates.resize(i+1);
+        }
+
+        parse_result_hits(p, lineEnd, tophitsColumn, queryId, taxonomy, rules,
+                          batch.headers[i], batch.candidates[i]);
+    }
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief merges memory-mapped result files with lines ordered by query id;
+ *        all files are split into chunks that cover the same query id range;
+ *        chunks are parsed and classified concurrently without
+ *        loading all query candidates into memory
+ *
+ *****************************************************************************/
+void merge_mapped_result_files(const vector<mapped_results>& files,
+                               const database& db,
+                               const query_options& opt,
+                               const candidate_generation_rules& rules,
+                               classification_results& results)
+{
+    // chunk boundaries (query ids) are taken from first file
+    constexpr std::size_t targetChunkSize = std::size_t(1) << 23;
+
+    const auto& ref = files.front();
+    const char* refEnd = ref.file.end();
+    const auto refSize = std::size_t(refEnd - ref.resultsBegin);
+
+    const auto numSplits = std::max(
+        std::size_t(4) * opt.performance.numThreads,
+        refSize / targetChunkSize);
+
+    vector<query_id> firstIds {1};
+    for (std::size_t i = 1; i < numSplits; ++i) {
+        const char* line = next_result_line(line_start(
+            ref.resultsBegin + (refSize * i) / numSplits, ref.resultsBegin, refEnd), refEnd);
+        if (line >= refEnd) break;
+        const auto id = result_line_query_id(line, refEnd);
+        if (id > firstIds.back()) firstIds.push_back(id);
+    }
+    const auto numChunks = firstIds.size();
+
+    // chunk begin positions in each file
+    vector<vector<const char*>> chunkBegins;
+    for (const auto& res : files) {
+        vector<const char*> begins {res.resultsBegin};
+        for (std::size_t c = 1; c < numChunks; ++c) {
+            begins.push_back(find_result_line(begins.back(), res.file.end(), firstIds[c]));
+        }
+        begins.push_back(res.file.end());
+        chunkBegins.push_back(std::move(begins));
+    }
+
+    const auto& taxonomy = db.taxo_cache();
+
+    std::atomic<std::size_t> nextChunk{0};
+
+    map_candidates_to_targets(
+        [&] (std::size_t& c, query_candidates_batch& batch) {
+            c = nextChunk++;
+            if (c >= numChunks) return false;
+
+            batch.firstId = firstIds[c];
+            const std::size_t size = (c+1 < numChunks) ? firstIds[c+1] - firstIds[c] : 0;
+
+            batch.headers.resize(size);
+            for (auto& h : batch.headers) h.clear();
+            batch.candidates.resize(size);
+            for (auto& cand : batch.candidates) cand.clear();
+
+            for (std::size_t f = 0; f < files.size(); ++f) {
+                read_results(chunkBegins[f][c], chunkBegins[f][c+1],
+                             files[f].tophitsColumn, taxonomy, rules, batch);
+            }
+            return true;
+        },
+        db, opt, results);
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief sequential reader for text or binary results from a file or pipe;
+ *        query ids must be in ascending order;
+ *        NOT concurrency safe
+ *
+ *****************************************************************************/
+class result_stream
+{
+public:
+    explicit
+    result_stream(const string& filename) :
+        filename_{filename},
+        is_{filename, std::ios::in | std::ios::binary}
+    {
+        if (!is_.good()) {
+            throw file_access_error{"Could not read result file '" + filename + "'"};
+        }
+
+        // text results start with comments, binary results with magic string
+        if (is_.peek() == '#') {
+            tophitsColumn_ = read_results_header(is_, filename_);
+        }
+        else {
+            binary_.reset(new result_reader{is_, filename_});
+            if (binary_->properties().candidateRank == taxon_rank::Sequence) {
+                throw io_format_error("cannot merge results on sequence level");
+            }
+        }
+        next();
+    }
+
+    const string& filename() const noexcept { return filename_; }
+
+    /** @return false, if stream is exhausted */
+    bool has_result() const noexcept { return hasResult_; }
+
+    /** @brief query id of current result; 0 is treated as 1 */
+    query_id query() const noexcept { return std::max(id_, query_id(1)); }
+
+
+    //---------------------------------------------------------------
+    /** @brief adds current result to query's header & candidates */
+    void merge_into(const taxonomy_cache& taxonomy,
+                    const candidate_generation_rules& rules,
+                    string& queryHeader,
+                    classification_candidates& candidates) const
+    {
+        if (!hasResult_) return;
+
+        if (binary_) {
+            if (queryHeader.empty()) queryHeader = result_.header;
+
+            for (const auto& cand : result_.candidates) {
+                const taxon* tax = taxonomy.taxon_with_id(cand.taxid);
+                if (tax) {
+                    candidates.insert(match_candidate{tax, cand.hits}, taxonomy, rules);
+                } else {
+                    cerr << "Query " << id_ << ": taxid " << cand.taxid << " not found. Skipping hit.\n";
+                }
+            }
+        }
+        else {
+            const char* line = line_.data();
+            const char* lineEnd = line + line_.size();
+            query_id queryId = 0;
+            const char* p = parse_result_id(line, lineEnd, queryId);
+            parse_result_hits(p, lineEnd, tophitsColumn_, queryId,
+                              taxonomy, rules, queryHeader, candidates);
+        }
+    }
+
+
+    //---------------------------------------------------------------
+    /** @brief advances to next result */
+    void next()
+    {
+        const auto prevId = id_;
+
+        if (binary_) {
+            hasResult_ = binary_->has_next();
+            if (hasResult_) {
+                binary_->next(result_);
+                id_ = result_.id;
+            }
+        }
+        else {
+            hasResult_ = false;
+            while (getline(is_, line_)) {
+                if (!line_.empty() && line_[0] != '#') {
+                    hasResult_ = true;
+                    parse_result_id(line_.data(), line_.data() + line_.size(), id_);
+                    break;
+                }
+            }
+        }
+
+        if (hasResult_ && id_ < prevId) {
+            throw io_format_error{"Results in '" + filename_ + "' are not ordered "
+                                  "by query id; streamed results must be ordered"};
+        }
+    }
+
+
+private:
+    string filename_;
+    std::ifstream is_;
+    std::unique_ptr<result_reader> binary_;
+    int tophitsColumn_ = 0;
+    bool hasResult_ = false;
+    query_id id_ = 0;
+    string line_;
+    query_result result_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief merges result streams (files or pipes) that are ordered by query id;
+ *        all streams are consumed in lockstep; a query is classified as soon
+ *        as all streams have advanced past its query id, so memory
+ *        consumption only depends on the batch size and number of threads
+ *
+ *****************************************************************************/
+void merge_result_streams(const vector<string>& infiles,
+                          const database& db,
+                          const query_options& opt,
+                          const candidate_generation_rules& rules,
+                          classification_results& results)
+{
+    constexpr std::size_t batchSize = 4096;
+
+    vector<std::unique_ptr<result_stream>> streams;
+    for (const auto& filename : infiles) {
+        streams.emplace_back(new result_stream{filename});
+    }
+
+    const auto& taxonomy = db.taxo_cache();
+
+    std::mutex mtx;
+    std::size_t nextBatch = 0;
+    query_id nextId = 1;
+
+    map_candidates_to_targets(
+        [&] (std::size_t& b, query_candidates_batch& batch) {
+            std::lock_guard<std::mutex> lock(mtx);
+
+            batch.firstId = nextId;
+            batch.headers.resize(batchSize);
+            for (auto& h : batch.headers) h.clear();
+            batch.candidates.resize(batchSize);
+            for (auto& cand : batch.candidates) cand.clear();
+
+            std::size_t size = 0;
+            bool exhausted = false;
+            while (true) {
+                // lowest query id that has not been merged yet
+                exhausted = true;
+                query_id id = 0;
+                for (const auto& s : streams) {
+                    if (s->has_result() && (exhausted || s->query() < id)) {
+                        id = s->query();
+                        exhausted = false;
+                    }
+                }
+                if (exhausted || id - batch.firstId >= batchSize) break;
+
+                const auto i = id - batch.firstId;
+                for (auto& s : streams) {
+                    while (s->has_result() && s->query() == id) {
+                        s->merge_into(taxonomy, rules,
+                                      batch.headers[i], batch.candidates[i]);
+                        s->next();
+                    }
+                }
+                size = i + 1;
+            }
+
+            if (exhausted) {
+                if (size == 0) return false;
+                batch.headers.resize(size);
+                batch.candidates.resize(size);
+            }
+
+            b = nextBatch++;
+            nextId += batchSize;
+            return true;
+        },
+        db, opt, results);
+}
+
+
+
 /*************************************************************************//**
  *
  * @brief merge classification result files
@@ -265,6 +923,57 @@ void merge_result_files(const vector<string>& infiles,
         results.perReadOut << comment << filename << '\n';
     }
 
+    // pipes can only be read once and are merged as ordered streams
+    const bool allRegular = std::all_of(infiles.begin(), infiles.end(),
+                            [](const string& f) { return is_regular_file(f); });
+    if (!allRegular) {
+        cerr << "Merging and classifying result streams.\n";
+        merge_result_streams(infiles, db, opt, rules, results);
+        return;
+    }
+
+    // text files with ordered results are memory-mapped and
+    // merged chunk by chunk; binary files are merged as streams;
+    // otherwise all candidates are loaded first
+    const bool anyBinary = std::any_of(infiles.begin(), infiles.end(),
+                           [](const string& f) { return is_result_file(f); });
+    bool ordered = true;
+    vector<mapped_results> files;
+    try {
+        for (const auto& filename : infiles) {
+            if (is_result_file(filename)) continue;
+
+            if (infoLvl == info_level::verbose) {
+                cerr << "Mapping " << filename << '\n';
+            }
+            files.push_back(map_results_file(filename));
+            if (!results_ordered_by_query_id(files.back(), opt.performance.numThreads)) {
+                if (infoLvl != info_level::silent) {
+                    cerr << "Results in " << filename << " are not ordered by query id.\n";
+                }
+                ordered = false;
+                break;
+            }
+        }
+    }
+    catch (file_access_error&) {
+        ordered = false;
+    }
+
+    if (ordered) {
+        if (anyBinary) {
+            files.clear();
+            cerr << "Merging and classifying result streams.\n";
+            merge_result_streams(infiles, db, opt, rules, results);
+        }
+        else {
+            cerr << "Merging and classifying.\n";
+            merge_mapped_result_files(files, db, opt, rules, results);
+        }
+        return;
+    }
+    files.clear();
+
     for (size_t i = 0; i < infiles.size(); ++i) {
         show_progress_indicator(cerr, infiles.size() > 1 ? i/float(infiles.size()) : -1);
 
@@ -272,14 +981,21 @@ void merge_result_files(const vector<string>& infiles,
             cerr << "Merging " << infiles[i] << '\n';
         }
 
-        read_results(get_results_file_properties(infiles[i]),
-                     db.taxo_cache(), rules, queryHeaders, queryCandidates);
+        if (is_result_file(infiles[i])) {
+            read_binary_results(infiles[i],
+                db.taxo_cache(), rules, queryHeaders, queryCandidates);
+        }
+        else {
+            read_results(get_results_file_properties(infiles[i]),
+                         db.taxo_cache(), rules, queryHeaders, queryCandidates);
+        }
     }
     clear_current_line(cerr);
 
     cerr << "Completed merge. Starting classification.\n";
 
-    map_candidates_to_targets(std::move(queryHeaders), queryCandidates, db, opt, results);
+    map_candidates_to_targets(std::move(queryHeaders), std::move(queryCandidates),
+                              db, opt, results);
 }
 
 
@@ -364,8 +1080,10 @@ void process_result_files(const vector<string>& infiles,
 {
     if (infiles.empty()) return;
 
+    // pipes are not probed, because they can only be opened once
     bool noneReadable = std::none_of(infiles.begin(), infiles.end(),
-                       [](const auto& f) { return file_readable(f); });
+                       [](const auto& f) {
+                           return !is_regular_file(f) || file_readable(f); });
 
     if (noneReadable) {
         throw std::runtime_error{
@@ -397,7 +1115,9 @@ void main_mode_merge(const cmdline_args& args)
             make_taxonomic_hierarchy(opt.taxonomy.nodesFile,
                                      opt.taxonomy.namesFile,
                                      opt.taxonomy.mergeFile,
-                                     opt.infoLevel) );
+                                     opt.taxonomy.snapshotFile,
+                                     opt.infoLevel,
+                                     opt.query.performance.numThreads) );
 
         db.taxo_cache().update_cached_lineages(taxon_rank::none);
 
@@ -41,7 +41,8 @@ using std::cerr;
  *
  *****************************************************************************/
 database
-read_database(const query_options& opt)
+read_database(const std::string& filename, int dbpart,
+              const query_options& opt)
 {
     const database_storage_options& dbopt = opt.dbconfig;
 
@@ -54,7 +55,7 @@ read_database(const query_options& opt)
     }
 
     try {
-        db.read(opt.dbfile, opt.dbpart, opt.performance.replication);
+        db.read(filename, dbpart, opt.performance.replication);
     }
     catch(const file_access_error& e) {
         cerr << "FAIL\n";
@@ -105,7 +106,13 @@ void main_mode_query(const cmdline_args& args)
 {
     auto opt = get_query_options(args);
 
-    auto db = read_database(opt);
+    auto db = read_database(opt.dbfile, opt.dbpart, opt);
+
+    // independent databases are queried together with the first one
+    for (const auto& filename : opt.addedDbFiles) {
+        db.attach(read_database(filename, -1, opt));
+    }
+
     adapt_options_to_database(opt, db);
 
     if (!opt.infiles.empty()) {
@@ -74,6 +74,15 @@ void main_mode_merge(const cmdline_args&);
 
 
 
+/*************************************************************************//**
+ *
+ * @brief renders binary classification result files as text
+ *
+ *****************************************************************************/
+void main_mode_convert(const cmdline_args&);
+
+
+
 /*************************************************************************//**
  *
  * @brief shows database properties
@@ -318,6 +318,28 @@ sequence_id_format_cli(sequence_id_type& type, error_messages&)
 
 
 
+//-------------------------------------------------------------------
+// / @brief option for reading/writing a binary taxonomy snapshot
+clipp::group
+taxonomy_snapshot_cli(taxonomy_options& opt, error_messages& err)
+{
+    using namespace clipp;
+
+    return (
+    (   option("-taxonomy-snapshot") &
+        value("file", opt.snapshotFile)
+            .if_missing([&]{ err += "Filename missing after '-taxonomy-snapshot'!"; })
+    )
+        % "Binary snapshot of the taxonomy. If <file> was made from the "
+          "current dump files of the taxonomy directory, it is read instead "
+          "of parsing them. Otherwise the dump files are parsed and a new "
+          "snapshot is written to <file>.\n"
+          "default: no snapshot"
+    );
+}
+
+
+
 //-------------------------------------------------------------------
 // / @brief shared command-line options for taxonomy
 clipp::group
@@ -332,6 +354,8 @@ taxonomy_cli(taxonomy_options& opt, error_messages& err)
     )
         % "directory with taxonomic hierarchy data (see NCBI's taxonomic data files)\n"
     ,
+    taxonomy_snapshot_cli(opt, err)
+    ,
     (   option("-taxpostmap") &
         values("file", opt.mappingPostFiles)
             .if_missing([&]{ err += "Taxonomy mapping files are missing after '-taxpostmap'!"; })
@@ -526,6 +550,10 @@ build_mode_cli(build_options& opt, error_messages& err)
               "used as representatives of an organism/taxon.\n"
               "If directory names are given, they will be searched for "
               "sequence files (at most 10 levels deep).\n"
+#ifndef GPU_MODE
+              "Sketch files written with '-sketches-out' can be used "
+              "instead of sequence files.\n"
+#endif
     ),
     "BASIC OPTIONS" %
     (
@@ -559,6 +587,29 @@ build_mode_cli(build_options& opt, error_messages& err)
 #else
             " Each part occupies one GPU.\n"
             "default: number of available GPUs"s)
+#endif
+#ifndef GPU_MODE
+        ,
+        (   option("-sketches-out") &
+            value("file", opt.sketchFile)
+                .if_missing([&]{ err += "Filename missing after '-sketches-out'!"; })
+        )
+            %("Writes the window sketches of all reference sequences to "
+              "a binary sketch file. Sketch files can be used as input "
+              "instead of sequence files in later builds with the same "
+              "sketching parameters, e.g. with different feature filters "
+              "or number of parts.\n"
+              "For databases with multiple parts one file per part "
+              "('<file>_0', '<file>_1', ...) is written.")
+        ,
+        (   option("-threads") &
+            integer("#", opt.numThreads)
+                .if_missing([&]{ err += "Number missing after '-threads'!"; })
+        )
+            %("Sets the maximum number of parallel threads used for "
+              "sketching long reference sequences, for decompressing "
+              "reference files and for parsing taxonomy files.\n"
+              "default (on this machine): "s + to_string(opt.numThreads))
 #endif
     ),
     catch_unknown(err)
@@ -578,6 +629,8 @@ void process_build_options(build_options& opt)
 
     auto& sk = opt.sketching;
     if (sk.winstride == 0) sk.winstride = sk.winlen - sk.kmerlen + 1;
+
+    if (opt.numThreads < 1) opt.numThreads = 1;
 }
 
 
@@ -881,8 +934,34 @@ classification_params_cli(classification_options& opt, error_messages& err)
           "This can help to reduce false positives, especially when"
           "your input data has a high sequencing coverage.\n"
           "This feature decreases the querying speed!\n"
-          "default: "s + (opt.covPercentile > 1e-3 ? "on" : "off")
+          "default: "s + (opt.covPercentile > 1e-3 ? "on" : "off"))
+    );
+}
+
+
+
+//-------------------------------------------------------------------
+// / @brief candidate verification (needs the read sequences)
+clipp::group
+verification_cli(classification_options& opt, error_messages& err)
+{
+    using namespace clipp;
+
+    return (
+    (   option("-verify") &
+        integer("#", opt.verifyTopCandidates)
+            .if_missing([&]{ err += "Number missing after '-verify'!"; })
     )
+        %("Verify the top <#> candidates (of at most -maxcand) of each read "
+          "by aligning the read to the candidates' reference sequence "
+          "ranges. Candidates with lower alignment scores than the best "
+          "one are discarded before classification; all other candidates "
+          "keep their order by hits. Requires access to the reference "
+          "sequence files; candidates from unreadable files are kept "
+          "unverified and the first error of each file is reported.\n"
+          "This feature decreases the querying speed!\n"
+          "default: "s + (opt.verifyTopCandidates > 0
+                          ? to_string(opt.verifyTopCandidates) : "off"s))
     );
 }
 
@@ -1096,6 +1175,25 @@ performance_options_cli(performance_tuning_options& opt, error_messages& err)
         %("Process <#> many queries (reads or read pairs) per thread at once.\n"
           "default (on this machine): "s + to_string(opt.batchSize))
     ,
+    (   option("-parser-threads") &
+        integer("#", opt.numParsers)
+            .if_missing([&]{ err += "Number missing after '-parser-threads'!"; })
+    )
+        %("Use <#> of the threads for parsing input files that consist of "
+          "standard 4-line FASTQ records. Other input formats and runs with "
+          "a query limit are always parsed by a single thread.\n"
+          "default: automatic (1 per 16 threads)")
+    ,
+    (   option("-concurrent-files") &
+        integer("#", opt.concurrentFiles)
+            .if_missing([&]{ err += "Number missing after '-concurrent-files'!"; })
+    )
+        %("Classify reads from up to <#> input files (or file pairs) at the "
+          "same time using the same worker threads. Without '-split-out' "
+          "files are read one after another, but the worker threads are "
+          "kept busy across file boundaries if <#> is greater than 1.\n"
+          "default: "s + to_string(opt.concurrentFiles))
+    ,
     (   option("-query-limit", "-querylimit") &
         integer("#", opt.queryLimit)
             .if_missing([&]{ err += "Number missing after '-query-limit'!"; })
@@ -1128,6 +1226,29 @@ query_mode_cli(query_options& opt, error_messages& err)
     (
         database_parameter(opt.dbfile, opt.dbpart, err)
         ,
+        repeatable(
+            option("-add-db") &
+            value("database")
+                .call([&](const string& arg){
+                    string filename = arg;
+                    int part = -1;
+                    sanitize_database_name(filename, part);
+                    opt.addedDbFiles.push_back(std::move(filename));
+                })
+                .if_missing([&]{ err += "Database filename missing after '-add-db'!"; })
+        )
+            % "Query an additional, independently built database "
+              "(e.g., one partition of a set of reference genomes) together "
+              "with <database>. All databases must use the same sketching "
+              "scheme and taxonomy; hits to taxa that are not part of the "
+              "taxonomy of <database> are ignored. Each read is parsed and sketched only once and "
+              "classified based on the combined candidates of all databases, "
+              "which gives the same results as querying each database and "
+              "merging the results with mode 'merge'. "
+              "Candidates are combined on the lowest classification rank; "
+              "rank 'sequence' (the default) is raised to 'species'. "
+              "Option can be given several times."
+        ,
         opt_values(match::prefix_not{"-"}, "sequence file/directory", opt.infiles)
             % "FASTA or FASTQ files containing genomic sequences "
               "(short reads, long reads, contigs, complete genomes, ...) "
@@ -1140,23 +1261,35 @@ query_mode_cli(query_options& opt, error_messages& err)
               "query options."
     ),
     "MAPPING RESULTS OUTPUT" %
-    one_of(
-        (   option("-out") &
-            value("file", opt.queryMappingsFile)
-                .if_missing([&]{ err += "Output filename missing after '-out'!"; })
-        )
-            % "Redirect output to file <file>.\n"
-              "If not specified, output will be written to stdout. "
-              "If more than one input file was given all output "
-              "will be concatenated into one file."
-        ,
-        (   option("-split-out", "-splitout").set(opt.splitOutputPerInput) &
-            value("file", opt.queryMappingsFile)
-                .if_missing([&]{ err += "Output filename missing after '-split-out'!"; })
+    (   one_of(
+            (   option("-out") &
+                value("file", opt.queryMappingsFile)
+                    .if_missing([&]{ err += "Output filename missing after '-out'!"; })
+            )
+                % "Redirect output to file <file>.\n"
+                  "If not specified, output will be written to stdout. "
+                  "If more than one input file was given all output "
+                  "will be concatenated into one file."
+            ,
+            (   option("-split-out", "-splitout").set(opt.splitOutputPerInput) &
+                value("file", opt.queryMappingsFile)
+                    .if_missing([&]{ err += "Output filename missing after '-split-out'!"; })
+            )
+                % "Generate output and statistics for each input file "
+                  "separately. For each input file <in> an output file "
+                  "with name <file>_<in> will be written."
+        ),
+        (   option("-binary-out") &
+            value("file", opt.binaryMappingsFile)
+                .if_missing([&]{ err += "Output filename missing after '-binary-out'!"; })
         )
-            % "Generate output and statistics for each input file "
-              "separately. For each input file <in> an output file "
-              "with name <file>_<in> will be written."
+            % "Additionally write compact binary per-read results "
+              "(query id, header, top candidate taxa, targets, hits and "
+              "window ranges, classification) to file <file>. "
+              "Binary results can be rendered as text with mode 'convert' "
+              "and can be used directly as input for mode 'merge'. "
+              "In combination with '-split-out' one binary file with name "
+              "<file>_<in>.bin is written per input file."
     ),
     "PAIRED-END READ HANDLING" %
     (   one_of(
@@ -1198,8 +1331,10 @@ query_mode_cli(query_options& opt, error_messages& err)
               "default: no limit"
     )
     ,
-    "CLASSIFICATION" %
-        classification_params_cli(opt.classify, err)
+    "CLASSIFICATION" % (
+        classification_params_cli(opt.classify, err),
+        verification_cli(opt.classify, err)
+    )
     ,
     "GENERAL OUTPUT FORMATTING" % (
         option("-no-summary", "-nosummary").set(opt.output.showSummary,false)
@@ -1265,6 +1400,22 @@ void process_query_options(query_options& opt)
     }
 
 
+    // candidates of several databases can only be combined above sequence level
+    if (!opt.addedDbFiles.empty()) {
+        if (cl.lowestRank == taxon_rank::Sequence) cl.lowestRank = taxon_rank::Species;
+
+        const auto& ana = opt.output.analysis;
+        if (ana.showAllHits || ana.showLocations || ana.showAlignment ||
+            ana.showHitsPerTargetList || cl.covPercentile > 0 ||
+            cl.verifyTopCandidates > 0)
+        {
+            throw std::invalid_argument{
+                "Options that refer to single reference sequences "
+                "(-allhits, -locations, -align, -hits-per-ref, -cov-percentile, "
+                "-verify) can't be used with several databases!"};
+        }
+    }
+
     // classification rank consistency checks
     if (cl.lowestRank  > cl.highestRank) cl.lowestRank  = cl.highestRank;
     if (cl.highestRank < cl.lowestRank)  cl.highestRank = cl.lowestRank;
@@ -1273,7 +1424,10 @@ void process_query_options(query_options& opt)
     // processing option checks
     auto& perf = opt.performance;
     if (perf.numThreads < 1) perf.numThreads = 1;
+    if (perf.numParsers < 1) perf.numParsers = std::max(1U, perf.numThreads / 16);
+    if (perf.numParsers >= perf.numThreads) perf.numParsers = std::max(1U, perf.numThreads - 1);
     if (perf.batchSize  < 1) perf.batchSize  = 1;
+    if (perf.concurrentFiles < 1) perf.concurrentFiles = 1;
     if (perf.queryLimit < 0) perf.queryLimit = 0;
 
 
@@ -1282,6 +1436,15 @@ void process_query_options(query_options& opt)
     if (ana.targetMappingsFile == opt.queryMappingsFile) ana.targetMappingsFile.clear();
     if (ana.abundanceFile == opt.queryMappingsFile) ana.abundanceFile.clear();
 
+    if (!opt.binaryMappingsFile.empty() &&
+        (opt.binaryMappingsFile == opt.queryMappingsFile ||
+         opt.binaryMappingsFile == ana.targetMappingsFile ||
+         opt.binaryMappingsFile == ana.abundanceFile))
+    {
+        throw std::invalid_argument{
+            "Binary results file must differ from all text output files!"};
+    }
+
     // output option checks and consistency
 
     // always show query ids if hits per target list requested
@@ -1358,6 +1521,10 @@ string query_mode_examples() {
     "    Query multiple files and folder contents against database 'refseq':\n"
     "        metacache query refseq file1.fna folder1 file2.fna file3.fna folder2\n"
     "\n"
+    "    Query all sequences in 'myreads.fna' against two databases 'part1' and 'part2'\n"
+    "    that were built from different sets of reference genomes:\n"
+    "        metacache query part1 myreads.fna -add-db part2 -out results.txt\n"
+    "\n"
     "    Perform a precision test and show all ranks for each classification result:\n"
     "        metacache query refseq reads.fna -precision -allranks -out results.txt\n"
     "\n"
@@ -1523,23 +1690,35 @@ build_query_mode_cli(build_query_options& opt, error_messages& err)
               "query options."
     ),
     "MAPPING RESULTS OUTPUT" %
-    one_of(
-        (   option("-out") &
-            value("file", opt.query.queryMappingsFile)
-                .if_missing([&]{ err += "Output filename missing after '-out'!"; })
-        )
-            % "Redirect output to file <file>.\n"
-              "If not specified, output will be written to stdout. "
-              "If more than one input file was given all output "
-              "will be concatenated into one file."
-        ,
-        (   option("-split-out", "-splitout").set(opt.query.splitOutputPerInput) &
-            value("file", opt.query.queryMappingsFile)
-                .if_missing([&]{ err += "Output filename missing after '-split-out'!"; })
+    (   one_of(
+            (   option("-out") &
+                value("file", opt.query.queryMappingsFile)
+                    .if_missing([&]{ err += "Output filename missing after '-out'!"; })
+            )
+                % "Redirect output to file <file>.\n"
+                  "If not specified, output will be written to stdout. "
+                  "If more than one input file was given all output "
+                  "will be concatenated into one file."
+            ,
+            (   option("-split-out", "-splitout").set(opt.query.splitOutputPerInput) &
+                value("file", opt.query.queryMappingsFile)
+                    .if_missing([&]{ err += "Output filename missing after '-split-out'!"; })
+            )
+                % "Generate output and statistics for each input file "
+                  "separately. For each input file <in> an output file "
+                  "with name <file>_<in> will be written."
+        ),
+        (   option("-binary-out") &
+            value("file", opt.query.binaryMappingsFile)
+                .if_missing([&]{ err += "Output filename missing after '-binary-out'!"; })
         )
-            % "Generate output and statistics for each input file "
-              "separately. For each input file <in> an output file "
-              "with name <file>_<in> will be written."
+            % "Additionally write compact binary per-read results "
+              "(query id, header, top candidate taxa, targets, hits and "
+              "window ranges, classification) to file <file>. "
+              "Binary results can be rendered as text with mode 'convert' "
+              "and can be used directly as input for mode 'merge'. "
+              "In combination with '-split-out' one binary file with name "
+              "<file>_<in>.bin is written per input file."
     ),
     "PAIRED-END READ HANDLING" %
     (   one_of(
@@ -1567,8 +1746,10 @@ build_query_mode_cli(build_query_options& opt, error_messages& err)
               "default: sum of lengths of the individual reads"
     )
     ,
-    "CLASSIFICATION" %
-        classification_params_cli(opt.query.classify, err)
+    "CLASSIFICATION" % (
+        classification_params_cli(opt.query.classify, err),
+        verification_cli(opt.query.classify, err)
+    )
     ,
     "GENERAL OUTPUT FORMATTING" % (
         option("-no-summary", "-nosummary").set(opt.query.output.showSummary,false)
@@ -1621,6 +1802,9 @@ get_build_query_options(const cmdline_args& args, build_query_options opt)
     process_build_options(opt.build);
     process_query_options(opt.query);
 
+    // '-threads' limits building as well
+    opt.build.numThreads = opt.query.performance.numThreads;
+
     return opt;
 }
 
@@ -1720,6 +1904,9 @@ merge_mode_cli(merge_options& opt, error_messages& err)
               "    -tophits -queryids -lowest species\n"
               "and must NOT be run with options that suppress or alter the "
               "default output like, e.g.: -no-map, -no-summary, -separator, etc.\n"
+              "Binary result files (query option '-binary-out') only need "
+              "'-lowest species' (or higher) and can be mixed with text "
+              "result files.\n"
         ,
         (   required("-taxonomy")
                 .if_missing([&]{ err += "Taxonomy path missing. Use '-taxonomy <path>'!"; })
@@ -1772,8 +1959,11 @@ merge_mode_cli(merge_options& opt, error_messages& err)
     "ADVANCED: CUSTOM QUERY SKETCHING (SUBSAMPLING)" %
         sketching_options_cli(qry.sketching, err)
     ,
-    "ADVANCED: PERFORMANCE TUNING / TESTING" %
+    "ADVANCED: PERFORMANCE TUNING / TESTING" % (
         performance_options_cli(qry.performance, err)
+        ,
+        taxonomy_snapshot_cli(opt.taxonomy, err)
+    )
     ,
     catch_unknown(err)
     );
@@ -1858,6 +2048,24 @@ string merge_mode_docs() {
         "    and must NOT be run with options that suppress or alter default output\n"
         "    like, e.g.: -no-map, -no-summary, -separator, etc.\n"
         "\n"
+        "    Binary result files written with query option '-binary-out <file>'\n"
+        "    are read directly without text parsing. They only need to be produced\n"
+        "    with '-lowest species' (or a higher rank).\n"
+        "\n"
+        "    Text result files with query ids in ascending order (as written by\n"
+        "    the query mode) are memory-mapped and merged in chunks of reads that\n"
+        "    are parsed and classified concurrently.\n"
+        "    Pipes (e.g., named pipes or process substitutions) and binary result\n"
+        "    files are read in lockstep by query id; each read is classified as\n"
+        "    soon as all inputs have reported it. Partition queries can therefore\n"
+        "    run concurrently and write directly into the merge, e.g.:\n"
+        "        mkfifo p1 p2\n"
+        "        metacache query db1 reads.fq -tophits -queryids -lowest species -out p1 &\n"
+        "        metacache query db2 reads.fq -tophits -queryids -lowest species -out p2 &\n"
+        "        metacache merge p1 p2 -taxonomy ncbi_taxonomy\n"
+        "    Streamed results must be ordered by query id.\n"
+        "    Unordered text result files are loaded completely before classification.\n"
+        "\n"
         "    Possible Use Case:\n"
         "    If your system has not enough memory for one large database, you can\n"
         "    split up the set of reference genomes into several databases and query these\n"
@@ -1873,6 +2081,113 @@ string merge_mode_docs() {
 
 
 
+/*************************************************************************//**
+ *
+ *
+ *  C O N V E R T   M O D E
+ *
+ *
+ *****************************************************************************/
+// / @brief convert mode command-line options
+clipp::group
+convert_mode_cli(convert_options& opt, error_messages& err)
+{
+    using namespace clipp;
+
+    return (
+    "PARAMETERS" %
+    (
+        values(match::prefix_not{"-"}, "binary result file", opt.infiles)
+            .if_missing([&]{ err += "No result filenames provided!"; })
+            % "Binary result files written by query option '-binary-out'."
+        ,
+        (   option("-out") &
+            value("file", opt.outfile)
+                .if_missing([&]{ err += "Output filename missing after '-out'!"; })
+        )
+            % "Redirect output to file <file>.\n"
+              "If not specified, output will be written to stdout."
+    )
+    ,
+    catch_unknown(err)
+    );
+}
+
+
+
+//-------------------------------------------------------------------
+convert_options
+get_convert_options(const cmdline_args& args)
+{
+    convert_options opt;
+    error_messages err;
+
+    auto cli = convert_mode_cli(opt, err);
+
+    auto result = clipp::parse(args, cli);
+
+    if (!result || err.any()) {
+        raise_default_error(err, "convert", convert_mode_usage());
+    }
+
+    return opt;
+}
+
+
+
+//-------------------------------------------------------------------
+string convert_mode_usage() {
+    return
+    "    metacache convert <binary result file>... [-out <file>]";
+}
+
+
+
+//-------------------------------------------------------------------
+string convert_mode_examples() {
+    return
+    "    Render binary results of a query as text:\n"
+    "        metacache query refseq reads.fa -binary-out results.bin -no-map\n"
+    "        metacache convert results.bin -out results.txt\n";
+}
+
+
+
+//-------------------------------------------------------------------
+string convert_mode_docs() {
+
+    convert_options opt;
+    error_messages err;
+    auto cli = convert_mode_cli(opt, err);
+
+    string docs = "SYNOPSIS\n\n";
+
+    docs += convert_mode_usage();
+
+    docs += "\n\n\n"
+        "DESCRIPTION\n"
+        "\n"
+        "    Renders binary per-read result files (written with query option\n"
+        "    '-binary-out') as text. Each line contains:\n"
+        "    query_id | query_header | top_hits | top_targets | candidate_locations | rank:taxid\n"
+        "\n"
+        "    Top hits are listed as 'taxid:hits' on the rank that was set with\n"
+        "    '-lowest' during the query, top targets are the database's internal\n"
+        "    target ids of the same candidates and candidate locations are the\n"
+        "    reference sequence intervals covered by the candidates' windows.\n"
+        "\n\n";
+
+    docs += clipp::documentation(cli, cli_doc_formatting()).str();
+
+    docs += "\n\n\nEXAMPLES\n\n";
+    docs += convert_mode_examples();
+
+    return docs;
+}
+
+
+
+
 /*************************************************************************//**
  *
  *
@@ -58,6 +58,7 @@ struct taxonomy_options
     std::string nodesFile;
     std::string namesFile;
     std::string mergeFile;
+    std::string snapshotFile;
     std::vector<std::string> mappingPreFilesLocal;
     std::vector<std::string> mappingPreFilesGlobal;
     std::vector<std::string> mappingPostFiles;
@@ -120,6 +121,12 @@ struct build_options
     // default sequence id format (used for parsing sequence headers and filenames)
     sequence_id_type sequenceIdType = sequence_id_type::smart;
 
+    // write window sketches of all targets to file(s)
+    std::string sketchFile;
+
+    // maximum number of threads used for sketching
+    unsigned numThreads = std::thread::hardware_concurrency();
+
     info_level infoLevel = info_level::moderate;
 };
 
@@ -228,6 +235,11 @@ struct performance_tuning_options
     unsigned numThreads = std::min(std::thread::hardware_concurrency(), 8U);
     std::size_t batchSize = 8192;
 #endif
+    // number of threads that parse input FASTQ records; 0: automatic
+    unsigned numParsers = 0;
+    // number of input files (pairs) that are processed concurrently
+    // by one shared executor; 1: one executor per input file
+    unsigned concurrentFiles = 1;
     // limits number of reads per sequence source (file)
     std::int_least64_t queryLimit = std::numeric_limits<std::int_least64_t>::max();
 
@@ -254,6 +266,9 @@ struct classification_options
     std::size_t maxNumCandidatesPerQuery = 2;
 
     float covPercentile = 0.0f;
+
+    // number of top candidates to verify by alignment; 0 : off
+    std::size_t verifyTopCandidates = 0;
 };
 
 
@@ -391,6 +406,8 @@ struct query_options
 {
     std::string dbfile;
     int dbpart = -1;
+    // independent databases that are queried together with 'dbfile'
+    std::vector<std::string> addedDbFiles;
     std::vector<std::string> infiles;
 
     // how to pair up reads
@@ -400,6 +417,8 @@ struct query_options
     bool splitOutputPerInput = false;
     // output filename for mappings per read
     std::string queryMappingsFile;
+    // output filename for binary per-read results
+    std::string binaryMappingsFile;
 
     database_storage_options dbconfig;
 
@@ -527,6 +546,46 @@ std::string merge_mode_docs();
 
 
 
+
+/*************************************************************************//**
+ *
+ *
+ *  C O N V E R T   M O D E
+ *
+ *
+ *****************************************************************************/
+
+/*************************************************************************//**
+ *
+ * @brief binary results -> text conversion parameters
+ *
+ *****************************************************************************/
+struct convert_options
+{
+    std::vector<std::string> infiles;
+    // output filename; if empty, output goes to stdout
+    std::string outfile;
+};
+
+
+
+/*************************************************************************//**
+ * @brief command line args -> convert mode options
+ *****************************************************************************/
+convert_options get_convert_options(const cmdline_args&);
+
+
+
+/*************************************************************************//**
+ * @brief convert mode documentation
+ *****************************************************************************/
+std::string convert_mode_usage();
+std::string convert_mode_examples();
+std::string convert_mode_docs();
+
+
+
+
 /*************************************************************************//**
  *
  *
@@ -0,0 +1,243 @@
+/******************************************************************************
+ *
+ * MetaCache - Meta-Genomic Classification Tool
+ *
+ * Copyright (C) 2016-2024 André Müller (muellan@uni-mainz.de)
+ *                       & Robin Kobus  (kobus@uni-mainz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef MC_PACKED_SEQUENCE_H_
+#define MC_PACKED_SEQUENCE_H_
+
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+
+namespace mc {
+
+
+/*************************************************************************//**
+ *
+ * @brief DNA sequence with 2 bits per nucleotide (A=0, C=1, G=2, T=3)
+ *        plus a bitmap marking ambiguous characters (everything that is
+ *        not one of ACGTacgt); ambiguous characters are decoded as 'N'
+ *
+ *****************************************************************************/
+class packed_sequence
+{
+public:
+    using size_type  = std::size_t;
+    using word_type  = std::uint64_t;
+    using value_type = char;
+
+    static constexpr size_type bases_per_word = 32;
+
+
+    /****************************************************************
+     * @brief random access iterator that decodes to characters
+     */
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type        = char;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const char*;
+        using reference         = char;
+
+        const_iterator() noexcept : seq_{nullptr}, pos_{0} {}
+
+        const_iterator(const packed_sequence* seq, size_type pos) noexcept :
+            seq_{seq}, pos_{pos}
+        {}
+
+        char operator * () const noexcept { return (*seq_)[pos_]; }
+        char operator [] (difference_type n) const noexcept { return (*seq_)[pos_ + n]; }
+
+        /** @brief 2-bit code of current nucleotide */
+        word_type code() const noexcept { return seq_->code(pos_); }
+        /** @brief true, if current character is ambiguous */
+        bool ambiguous() const noexcept { return seq_->ambiguous(pos_); }
+
+        const packed_sequence* sequence() const noexcept { return seq_; }
+        size_type index() const noexcept { return pos_; }
+
+        const_iterator& operator ++ () noexcept { ++pos_; return *this; }
+        const_iterator& operator -- () noexcept { --pos_; return *this; }
+        const_iterator operator ++ (int) noexcept { auto i = *this; ++pos_; return i; }
+        const_iterator operator -- (int) noexcept { auto i = *this; --pos_; return i; }
+
+        const_iterator& operator += (difference_type n) noexcept { pos_ += n; return *this; }
+        const_iterator& operator -= (difference_type n) noexcept { pos_ -= n; return *this; }
+
+        friend const_iterator
+        operator + (const_iterator i, difference_type n) noexcept { return i += n; }
+        friend const_iterator
+        operator + (difference_type n, const_iterator i) noexcept { return i += n; }
+        friend const_iterator
+        operator - (const_iterator i, difference_type n) noexcept { return i -= n; }
+
+        friend difference_type
+        operator - (const const_iterator& a, const const_iterator& b) noexcept {
+            return difference_type(a.pos_) - difference_type(b.pos_);
+        }
+
+        friend bool operator == (const const_iterator& a, const const_iterator& b) noexcept { return a.pos_ == b.pos_; }
+        friend bool operator != (const const_iterator& a, const const_iterator& b) noexcept { return a.pos_ != b.pos_; }
+        friend bool operator <  (const const_iterator& a, const const_iterator& b) noexcept { return a.pos_ <  b.pos_; }
+        friend bool operator <= (const const_iterator& a, const const_iterator& b) noexcept { return a.pos_ <= b.pos_; }
+        friend bool operator >  (const const_iterator& a, const const_iterator& b) noexcept { return a.pos_ >  b.pos_; }
+        friend bool operator >= (const const_iterator& a, const const_iterator& b) noexcept { return a.pos_ >= b.pos_; }
+
+    private:
+        const packed_sequence* seq_;
+        size_type pos_;
+    };
+
+    using iterator = const_iterator;
+
+
+    //---------------------------------------------------------------
+    packed_sequence() : bases_{}, ambig_{}, size_{0} {}
+
+
+    //---------------------------------------------------------------
+    size_type size() const noexcept { return size_; }
+
+    bool empty() const noexcept { return size_ < 1; }
+
+    void clear() noexcept {
+        bases_.clear();
+        ambig_.clear();
+        size_ = 0;
+    }
+
+    void reserve(size_type n) {
+        bases_.reserve(words_for_bases(n));
+        ambig_.reserve(words_for_ambig(n));
+    }
+
+    /** @brief shrinks or grows; new positions are filled with 'A' */
+    void resize(size_type n) {
+        bases_.resize(words_for_bases(n), 0);
+        ambig_.resize(words_for_ambig(n), 0);
+        size_ = n;
+        // stamp out bits beyond new end, so that 'append' can use bitwise or
+        if (n % bases_per_word) {
+            bases_.back() &= ~word_type(0) >> (2 * (bases_per_word - n % bases_per_word));
+        }
+        if (n % (2*bases_per_word)) {
+            ambig_.back() &= ~word_type(0) >> (2*bases_per_word - n % (2*bases_per_word));
+        }
+    }
+
+
+    //---------------------------------------------------------------
+    void push_back(char c) {
+        append(&c, 1);
+    }
+
+    void append(const char* first, const char* last) {
+        append(first, size_type(last - first));
+    }
+
+    void append(const char* s, size_type n) {
+        const auto oldSize = size_;
+        bases_.resize(words_for_bases(oldSize + n), 0);
+        ambig_.resize(words_for_ambig(oldSize + n), 0);
+        size_ = oldSize + n;
+
+        const auto& table = encoding_table();
+        for (size_type i = 0, pos = oldSize; i < n; ++i, ++pos) {
+            const auto code = table[static_cast<unsigned char>(s[i])];
+            bases_[pos / bases_per_word] |=
+                word_type(code & 3) << (2 * (pos % bases_per_word));
+            ambig_[pos / (2*bases_per_word)] |=
+                word_type(code >> 2) << (pos % (2*bases_per_word));
+        }
+    }
+
+
+    //---------------------------------------------------------------
+    /** @brief 2-bit code of nucleotide at position 'pos' */
+    word_type code(size_type pos) const noexcept {
+        return (bases_[pos / bases_per_word] >> (2 * (pos % bases_per_word))) & 3;
+    }
+
+    /** @brief true, if character at position 'pos' is ambiguous */
+    bool ambiguous(size_type pos) const noexcept {
+        return (ambig_[pos / (2*bases_per_word)] >> (pos % (2*bases_per_word))) & 1;
+    }
+
+    char operator [] (size_type pos) const noexcept {
+        return ambiguous(pos) ? 'N' : "ACGT"[code(pos)];
+    }
+
+
+    //---------------------------------------------------------------
+    const_iterator  begin() const noexcept { return const_iterator{this, 0}; }
+    const_iterator cbegin() const noexcept { return begin(); }
+
+    const_iterator  end() const noexcept { return const_iterator{this, size_}; }
+    const_iterator cend() const noexcept { return end(); }
+
+
+private:
+    //---------------------------------------------------------------
+    static constexpr size_type
+    words_for_bases(size_type n) noexcept {
+        return (n + bases_per_word - 1) / bases_per_word;
+    }
+    static constexpr size_type
+    words_for_ambig(size_type n) noexcept {
+        return (n + 2*bases_per_word - 1) / (2*bases_per_word);
+    }
+
+    //---------------------------------------------------------------
+    /** @brief bits 0-1: 2-bit code; bit 2: ambiguity flag */
+    struct encoding {
+        encoding() noexcept {
+            for (auto& c : codes) c = 4;
+            codes['A'] = 0; codes['a'] = 0;
+            codes['C'] = 1; codes['c'] = 1;
+            codes['G'] = 2; codes['g'] = 2;
+            codes['T'] = 3; codes['t'] = 3;
+        }
+        std::uint8_t operator [] (unsigned char c) const noexcept { return codes[c]; }
+        std::uint8_t codes[256];
+    };
+
+    static const encoding& encoding_table() noexcept {
+        static const encoding table;
+        return table;
+    }
+
+
+    //---------------------------------------------------------------
+    std::vector<word_type> bases_;  // 32 nucleotides per word
+    std::vector<word_type> ambig_;  // 64 ambiguity flags per word
+    size_type size_;
+};
+
+
+} // namespace mc
+
+
+#endif
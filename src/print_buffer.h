@@ -0,0 +1,168 @@
+/******************************************************************************
+ *
+ * MetaCache - Meta-Genomic Classification Tool
+ *
+ * Copyright (C) 2016-2024 André Müller (muellan@uni-mainz.de)
+ *                       & Robin Kobus  (kobus@uni-mainz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef MC_PRINT_BUFFER_H_
+#define MC_PRINT_BUFFER_H_
+
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <type_traits>
+
+
+namespace mc {
+
+
+/*************************************************************************//**
+ *
+ * @brief character buffer with stream-like interface for fast text output;
+ *        integers are converted without locales or stream state,
+ *        output is identical to std::ostream's default formatting;
+ *        capacity is kept after 'clear', so buffers can be re-used
+ *        without allocations
+ *
+ *****************************************************************************/
+class print_buffer
+{
+public:
+    //---------------------------------------------------------------
+    void clear() noexcept { buf_.clear(); }
+
+    void reserve(std::size_t n) { buf_.reserve(n); }
+
+    bool empty() const noexcept { return buf_.empty(); }
+    std::size_t size() const noexcept { return buf_.size(); }
+    const char* data() const noexcept { return buf_.data(); }
+
+    const std::string& str() const noexcept { return buf_; }
+
+
+    //---------------------------------------------------------------
+    print_buffer& write(const char* s, std::size_t n) {
+        buf_.append(s, n);
+        return *this;
+    }
+
+    print_buffer& operator << (char c) {
+        buf_.push_back(c);
+        return *this;
+    }
+
+    print_buffer& operator << (const char* s) {
+        buf_.append(s);
+        return *this;
+    }
+
+    print_buffer& operator << (const std::string& s) {
+        buf_.append(s);
+        return *this;
+    }
+
+    /** @brief integers (except for bool and character types) */
+    template<class Int, class = std::enable_if_t<
+        std::is_integral<Int>::value && (sizeof(Int) > 1)>>
+    print_buffer& operator << (Int x) {
+        append_integer(x, std::is_signed<Int>{});
+        return *this;
+    }
+
+    /** @brief would otherwise be converted to 'char' */
+    print_buffer& operator << (bool) = delete;
+    print_buffer& operator << (signed char) = delete;
+    print_buffer& operator << (unsigned char) = delete;
+    print_buffer& operator << (float) = delete;
+    print_buffer& operator << (double) = delete;
+    print_buffer& operator << (long double) = delete;
+
+
+    //---------------------------------------------------------------
+    friend std::ostream&
+    operator << (std::ostream& os, const print_buffer& buf) {
+        return os.write(buf.data(), buf.size());
+    }
+
+
+private:
+    //---------------------------------------------------------------
+    template<class Int>
+    void append_integer(Int x, std::true_type /* signed */) {
+        if (x < 0) {
+            buf_.push_back('-');
+            append_unsigned(std::uint64_t(0) - std::uint64_t(x));
+        }
+        else {
+            append_unsigned(std::uint64_t(x));
+        }
+    }
+
+    template<class Int>
+    void append_integer(Int x, std::false_type /* unsigned */) {
+        append_unsigned(std::uint64_t(x));
+    }
+
+
+    //---------------------------------------------------------------
+    void append_unsigned(std::uint64_t x) {
+        static constexpr char digitPairs[] =
+            "00010203040506070809"
+            "10111213141516171819"
+            "20212223242526272829"
+            "30313233343536373839"
+            "40414243444546474849"
+            "50515253545556575859"
+            "60616263646566676869"
+            "70717273747576777879"
+            "80818283848586878889"
+            "90919293949596979899";
+
+        // 2^64 has 20 decimal digits
+        char digits[20];
+        char* p = digits + 20;
+
+        while (x >= 100) {
+            const auto i = (x % 100) * 2;
+            x /= 100;
+            *--p = digitPairs[i+1];
+            *--p = digitPairs[i];
+        }
+        if (x >= 10) {
+            const auto i = x * 2;
+            *--p = digitPairs[i+1];
+            *--p = digitPairs[i];
+        }
+        else {
+            *--p = char('0' + x);
+        }
+        buf_.append(p, digits + 20 - p);
+    }
+
+
+    //---------------------------------------------------------------
+    std::string buf_;
+};
+
+
+} // namespace mc
+
+
+#endif
@@ -172,7 +172,8 @@ void show_taxon_header (std::ostream& os,
 
 
 //-------------------------------------------------------------------
-void print_taxon (std::ostream& os,
+template<class Out>
+void print_taxon (Out& os,
                   const std::string& taxName,
                   taxon_id id,
                   taxon_rank rank,
@@ -201,7 +202,8 @@ void print_taxon (std::ostream& os,
 
 
 //-------------------------------------------------------------------
-void show_lineage (std::ostream& os,
+template<class Out>
+void show_lineage (Out& os,
                    const ranked_lineage& lineage,
                    taxon_print_style style, taxon_rank lowest, taxon_rank highest,
                    const formatting_tokens& fmt)
@@ -227,7 +229,8 @@ void show_lineage (std::ostream& os,
 
 
 //-------------------------------------------------------------------
-void show_blank_lineage (std::ostream& os,
+template<class Out>
+void show_blank_lineage (Out& os,
                          taxon_print_style style,
                          taxon_rank lowest, taxon_rank highest,
                          const formatting_tokens& fmt)
@@ -240,6 +243,29 @@ void show_blank_lineage (std::ostream& os,
 
 
 
+//-------------------------------------------------------------------
+template<class Out>
+void show_unclassified (Out& os, const classification_output_formatting& opt)
+{
+    if (opt.collapseUnclassifiedLineages) {
+        if (opt.taxonStyle.showId
+           && !opt.taxonStyle.showName
+           && !opt.taxonStyle.showRankName)
+        {
+            os << taxonomy::none_id();
+        }
+        else {
+            os << opt.tokens.none;
+        }
+    }
+    else {
+        const auto rmax = opt.showLineage ? opt.highestRank : opt.lowestRank;
+        show_blank_lineage(os, opt.taxonStyle, opt.lowestRank, rmax, opt.tokens);
+    }
+}
+
+
+
 //-------------------------------------------------------------------
 void show_taxon (std::ostream& os,
                  const taxonomy_cache& taxonomy,
@@ -247,21 +273,7 @@ void show_taxon (std::ostream& os,
                  const taxon* tax)
 {
     if (!tax || tax->rank() > opt.highestRank) {
-        if (opt.collapseUnclassifiedLineages) {
-            if (opt.taxonStyle.showId
-               && !opt.taxonStyle.showName
-               && !opt.taxonStyle.showRankName)
-            {
-                os << taxonomy::none_id();
-            }
-            else {
-                os << opt.tokens.none;
-            }
-        }
-        else {
-            const auto rmax = opt.showLineage ? opt.highestRank : opt.lowestRank;
-            show_blank_lineage(os, opt.taxonStyle, opt.lowestRank, rmax, opt.tokens);
-        }
+        show_unclassified(os, opt);
     }
     else {
         const auto rmin = opt.lowestRank < tax->rank() ? tax->rank() : opt.lowestRank;
@@ -274,10 +286,11 @@ void show_taxon (std::ostream& os,
 
 
 //-------------------------------------------------------------------
-void show_candidates (std::ostream& os,
-                      const taxonomy_cache& taxonomy,
-                      const span<const match_candidate> cand,
-                      taxon_rank lowest)
+template<class Out>
+void print_candidates (Out& os,
+                       const taxonomy_cache& taxonomy,
+                       const span<const match_candidate> cand,
+                       taxon_rank lowest)
 {
     using size_t = span<match_candidate>::size_type;
 
@@ -305,11 +318,30 @@ void show_candidates (std::ostream& os,
 
 
 
+void show_candidates (std::ostream& os,
+                      const taxonomy_cache& taxonomy,
+                      const span<const match_candidate> cand,
+                      taxon_rank lowest)
+{
+    print_candidates(os, taxonomy, cand, lowest);
+}
+
+void show_candidates (print_buffer& os,
+                      const taxonomy_cache& taxonomy,
+                      const span<const match_candidate> cand,
+                      taxon_rank lowest)
+{
+    print_candidates(os, taxonomy, cand, lowest);
+}
+
+
+
 //-------------------------------------------------------------------
-void show_matches (std::ostream& os,
-                   const taxonomy_cache& taxonomy,
-                   const span<const location> matches,
-                   taxon_rank lowest)
+template<class Out>
+void print_matches (Out& os,
+                    const taxonomy_cache& taxonomy,
+                    const span<const location> matches,
+                    taxon_rank lowest)
 {
     if (matches.empty()) return;
 
@@ -360,10 +392,29 @@ void show_matches (std::ostream& os,
 
 
 
+void show_matches (std::ostream& os,
+                   const taxonomy_cache& taxonomy,
+                   const span<const location> matches,
+                   taxon_rank lowest)
+{
+    print_matches(os, taxonomy, matches, lowest);
+}
+
+void show_matches (print_buffer& os,
+                   const taxonomy_cache& taxonomy,
+                   const span<const location> matches,
+                   taxon_rank lowest)
+{
+    print_matches(os, taxonomy, matches, lowest);
+}
+
+
+
 //-------------------------------------------------------------------
-void show_candidate_ranges (std::ostream& os,
-                            const sketching_opt& targetSketching,
-                            const span<const match_candidate> cand)
+template<class Out>
+void print_candidate_ranges (Out& os,
+                             const sketching_opt& targetSketching,
+                             const span<const match_candidate> cand)
 {
     const auto w = targetSketching.winstride;
 
@@ -373,6 +424,95 @@ void show_candidate_ranges (std::ostream& os,
     }
 }
 
+void show_candidate_ranges (std::ostream& os,
+                            const sketching_opt& targetSketching,
+                            const span<const match_candidate> cand)
+{
+    print_candidate_ranges(os, targetSketching, cand);
+}
+
+void show_candidate_ranges (print_buffer& os,
+                            const sketching_opt& targetSketching,
+                            const span<const match_candidate> cand)
+{
+    print_candidate_ranges(os, targetSketching, cand);
+}
+
+
+
+//-------------------------------------------------------------------
+taxon_formatter::taxon_formatter (const taxonomy_cache& taxonomy,
+                                  const classification_output_formatting& opt)
+:
+    taxonomy_(taxonomy), opt_(opt)
+{
+    print_buffer buf;
+
+    show_unclassified(buf, opt_);
+    unclassified_ = buf.str();
+
+    // placeholders for missing ranks in lineages
+    for (auto r = taxon_rank::Sequence; r <= taxon_rank::root; ++r) {
+        buf.clear();
+        print_taxon(buf, opt_.tokens.none, taxonomy::none_id(), r,
+                    opt_.taxonStyle, opt_.tokens);
+        noneOfRank_[int(r)] = buf.str();
+    }
+
+    // all taxa that can be part of a classification's lineage
+    taxa_.resize(taxonomy_.dense_index_size());
+    for (const auto& lineage : taxonomy_.target_lineages()) {
+        for (const taxon* tax : lineage) {
+            if (!tax) continue;
+            const auto i = taxonomy_.dense_index(*tax);
+            if (i < taxa_.size() && !taxa_[i].first) {
+                buf.clear();
+                print_taxon(buf, tax->name(), tax->id(), tax->rank(),
+                            opt_.taxonStyle, opt_.tokens);
+                taxa_[i] = {tax, buf.str()};
+            }
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+void taxon_formatter::print (print_buffer& os, const taxon* tax) const
+{
+    if (!tax || tax->rank() > opt_.highestRank) {
+        os << unclassified_;
+        return;
+    }
+
+    const auto lowest = opt_.lowestRank < tax->rank() ? tax->rank() : opt_.lowestRank;
+    auto highest = opt_.showLineage ? opt_.highestRank : lowest;
+
+    if (lowest == taxon_rank::none) return;
+    if (highest == taxon_rank::none) highest = taxon_rank::root;
+
+    const auto& lineage = taxonomy_.cached_ranks(tax);
+
+    for (auto r = lowest; r <= highest; ++r) {
+        const taxon* t = lineage[int(r)];
+        if (t) {
+            const auto i = taxonomy_.dense_index(*t);
+            // dense index might have changed since construction
+            if (i < taxa_.size() && taxa_[i].first == t) {
+                os << taxa_[i].second;
+            } else {
+                print_taxon(os, t->name(), t->id(), t->rank(),
+                            opt_.taxonStyle, opt_.tokens);
+            }
+        }
+        else {
+            os << noneOfRank_[int(r)];
+        }
+        if (r < highest) {
+            os << opt_.tokens.taxSeparator;
+        }
+    }
+}
+
 
 
 //-------------------------------------------------------------------
@@ -28,10 +28,14 @@
 #include "classification_statistics.h"
 #include "config.h"
 #include "matches_per_target.h"
+#include "print_buffer.h"
 #include "taxonomy.h"
 
+#include <array>
 #include <iosfwd>
 #include <string>
+#include <utility>
+#include <vector>
 
 
 namespace mc {
@@ -60,6 +64,31 @@ void show_taxon(std::ostream&,
                 const taxon* classified);
 
 
+/*************************************************************************//**
+ *
+ * @brief prints taxon information according to output options;
+ *        same output as 'show_taxon', but uses precomputed
+ *        strings for all taxa in lineages of targets
+ *
+ *****************************************************************************/
+class taxon_formatter
+{
+public:
+    taxon_formatter(const taxonomy_cache&,
+                    const classification_output_formatting&);
+
+    void print(print_buffer&, const taxon* classified) const;
+
+private:
+    const taxonomy_cache& taxonomy_;
+    const classification_output_formatting& opt_;
+    std::string unclassified_;
+    std::array<std::string,taxonomy::num_ranks> noneOfRank_;
+    // formatted taxa by position in the taxonomy's dense index
+    std::vector<std::pair<const taxon*,std::string>> taxa_;
+};
+
+
 /*************************************************************************//**
  *
  * @brief prints header for taxon information
@@ -80,6 +109,11 @@ void show_candidates(std::ostream&,
                      const span<const match_candidate>,
                      taxon_rank lowest = taxon_rank::Sequence);
 
+void show_candidates(print_buffer&,
+                     const taxonomy_cache&,
+                     const span<const match_candidate>,
+                     taxon_rank lowest = taxon_rank::Sequence);
+
 
 /*************************************************************************//**
  *
@@ -91,6 +125,11 @@ void show_matches(std::ostream&,
                   const span<const location>,
                   taxon_rank lowest = taxon_rank::Sequence);
 
+void show_matches(print_buffer&,
+                  const taxonomy_cache& taxonomy,
+                  const span<const location>,
+                  taxon_rank lowest = taxon_rank::Sequence);
+
 
 /*************************************************************************//**
  *
@@ -101,6 +140,10 @@ void show_candidate_ranges(std::ostream&,
                            const sketching_opt&,
                            const span<const match_candidate>);
 
+void show_candidate_ranges(print_buffer&,
+                           const sketching_opt&,
+                           const span<const match_candidate>);
+
 
 /*************************************************************************//**
  *
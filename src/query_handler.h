@@ -79,6 +79,8 @@ private:
     {
         if (offsets.size() < 3) return;
         temp.resize(inout.size());
+        // buffers are swapped, so matches before first chunk must be kept
+        std::copy(inout.begin(), inout.begin()+offsets.front(), temp.begin());
 
         int numChunks = offsets.size()-1;
         for (int s = 1; s < numChunks; s *= 2) {
@@ -114,19 +116,82 @@ struct query_handler {
 
     using location = Location;
     using sorter = matches_sorter<location>;
+    using accumulator = target_hits_accumulator<location>;
     using match_locations = typename sorter::match_locations;
 
+    // from this number of matches on, candidates are generated
+    // with a hash table instead of sorting all matches
+    static constexpr std::size_t min_matches_to_accumulate = 256;
+
     void clear() {
         matchesSorter.clear();
         classificationCandidates.clear();
+        partEnds_.clear();
+        sorted_ = true;
+    }
+
+    /**
+     * @brief concludes matches of current database part;
+     *        sorts them unless there are enough matches in total
+     *        to accumulate them in a hash table instead
+     */
+    void finish_part_matches() {
+        partEnds_.push_back(matchesSorter.size());
+
+        if (!sorted_) return;
+
+        if (sortAllMatches || matchesSorter.size() < min_matches_to_accumulate)
+            matchesSorter.sort();
+        else
+            sorted_ = false;
     }
 
+    /**
+     * @brief generates classification candidates from matches
+     */
+    void make_candidates(const taxonomy_cache& taxonomy,
+                         const candidate_generation_rules& rules)
+    {
+        if (sorted_) {
+            classificationCandidates.insert(
+                taxonomy, matchesSorter.locations(), rules);
+        }
+        else {
+            // parts are processed one after another, so that targets
+            // are visited in the same order as in sorted match lists
+            const auto& locs = matchesSorter.locations();
+            std::size_t beg = 0;
+            for (auto end : partEnds_) {
+                matchesAccumulator.for_all_contiguous_window_ranges(
+                    span<const location>(locs.data() + beg, end - beg),
+                    rules.maxWindowsInRange,
+                    [&,this] (const match_candidate& cand) {
+                        return classificationCandidates.insert(cand, taxonomy, rules);
+                    });
+                beg = end;
+            }
+        }
+    }
+
+    /** @brief matches are only sorted if 'sortAllMatches' is set */
     auto allhits() { return span<const location>(matchesSorter.locations()); }
     auto tophits() { return classificationCandidates.view(); }
 
     sketcher querySketcher;
     sorter matchesSorter;
+    accumulator matchesAccumulator;
     classification_candidates classificationCandidates;
+
+    // all matches are needed in sorted order (e.g., for output)
+    bool sortAllMatches = false;
+
+    // used when querying several databases
+    typename sketcher::sketch_type querySketch;
+    classification_candidates combinedCandidates;
+
+private:
+    std::vector<std::size_t> partEnds_;
+    bool sorted_ = true;
 };
 
 
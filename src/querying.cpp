@@ -31,7 +31,10 @@
 #include "printing.h"
 
 #include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -49,63 +52,99 @@ using std::endl;
 
 /*************************************************************************//**
  *
- * @brief runs classification on input files; sets output target streams
+ * @brief output target streams; opens output files if filenames are given
  *
  *****************************************************************************/
-void process_input_files(const vector<string>& infiles,
-                         const database& db, const query_options& opt,
-                         const string& queryMappingsFilename,
-                         const string& targetsFilename,
-                         const string& abundanceFilename)
+struct output_streams
 {
     std::ostream* perReadOut   = &cout;
     std::ostream* perTargetOut = &cout;
     std::ostream* perTaxonOut  = &cout;
-    std::ostream* status       = &cerr;
+    std::ostream* perReadBinaryOut = nullptr;
 
     std::ofstream mapFile;
-    if (!queryMappingsFilename.empty()) {
-        mapFile.open(queryMappingsFilename, std::ios::out);
-
-        if (mapFile.good()) {
-            cout << "Per-Read mappings will be written to file: " << queryMappingsFilename << endl;
-            perReadOut = &mapFile;
-            // default: auxiliary output same as mappings output
-            perTargetOut = perReadOut;
-            perTaxonOut  = perReadOut;
-        }
-        else {
-            throw file_write_error{"Could not write to file " + queryMappingsFilename};
-        }
-    }
-
     std::ofstream targetMappingsFile;
-    if (!targetsFilename.empty()) {
-        targetMappingsFile.open(targetsFilename, std::ios::out);
+    std::ofstream abundanceFile;
+    std::ofstream binaryFile;
 
-        if (targetMappingsFile.good()) {
-            cout << "Per-Target mappings will be written to file: " << targetsFilename << endl;
-            perTargetOut = &targetMappingsFile;
+    void open(const string& queryMappingsFilename,
+              const string& targetsFilename,
+              const string& abundanceFilename,
+              const string& binaryFilename)
+    {
+        if (!queryMappingsFilename.empty()) {
+            mapFile.open(queryMappingsFilename, std::ios::out);
+
+            if (mapFile.good()) {
+                cout << "Per-Read mappings will be written to file: " << queryMappingsFilename << endl;
+                perReadOut = &mapFile;
+                // default: auxiliary output same as mappings output
+                perTargetOut = perReadOut;
+                perTaxonOut  = perReadOut;
+            }
+            else {
+                throw file_write_error{"Could not write to file " + queryMappingsFilename};
+            }
         }
-        else {
-            throw file_write_error{"Could not write to file " + targetsFilename};
+
+        if (!targetsFilename.empty()) {
+            targetMappingsFile.open(targetsFilename, std::ios::out);
+
+            if (targetMappingsFile.good()) {
+                cout << "Per-Target mappings will be written to file: " << targetsFilename << endl;
+                perTargetOut = &targetMappingsFile;
+            }
+            else {
+                throw file_write_error{"Could not write to file " + targetsFilename};
+            }
         }
-    }
 
-    std::ofstream abundanceFile;
-    if (!abundanceFilename.empty()) {
-        abundanceFile.open(abundanceFilename, std::ios::out);
+        if (!abundanceFilename.empty()) {
+            abundanceFile.open(abundanceFilename, std::ios::out);
 
-        if (abundanceFile.good()) {
-            cout << "Per-Taxon mappings will be written to file: " << abundanceFilename << endl;
-            perTaxonOut = &abundanceFile;
+            if (abundanceFile.good()) {
+                cout << "Per-Taxon mappings will be written to file: " << abundanceFilename << endl;
+                perTaxonOut = &abundanceFile;
+            }
+            else {
+                throw file_write_error{"Could not write to file " + abundanceFilename};
+            }
         }
-        else {
-            throw file_write_error{"Could not write to file " + abundanceFilename};
+
+        if (!binaryFilename.empty()) {
+            binaryFile.open(binaryFilename, std::ios::out | std::ios::binary);
+
+            if (binaryFile.good()) {
+                cout << "Binary per-read results will be written to file: " << binaryFilename << endl;
+                perReadBinaryOut = &binaryFile;
+            }
+            else {
+                throw file_write_error{"Could not write to file " + binaryFilename};
+            }
         }
     }
+};
 
-    classification_results results {*perReadOut,*perTargetOut,*perTaxonOut,*status};
+
+
+/*************************************************************************//**
+ *
+ * @brief runs classification on input files; sets output target streams
+ *
+ *****************************************************************************/
+void process_input_files(const vector<string>& infiles,
+                         const database& db, const query_options& opt,
+                         const string& queryMappingsFilename,
+                         const string& targetsFilename,
+                         const string& abundanceFilename,
+                         const string& binaryFilename)
+{
+    output_streams out;
+    out.open(queryMappingsFilename, targetsFilename, abundanceFilename,
+             binaryFilename);
+
+    classification_results results {*out.perReadOut,*out.perTargetOut,*out.perTaxonOut,cerr};
+    results.perReadBinaryOut = out.perReadBinaryOut;
 
     if (opt.output.showQueryParams) {
         show_query_parameters(results.perReadOut, opt);
@@ -127,6 +166,90 @@ void process_input_files(const vector<string>& infiles,
 
 
 
+/*************************************************************************//**
+ *
+ * @brief input files with separate outputs
+ *
+ *****************************************************************************/
+struct split_input
+{
+    vector<string> infiles;
+    string queryMappingsFile;
+    string targetMappingsFile;
+    string abundanceFile;
+    string binaryMappingsFile;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief runs classification on several groups of input files concurrently;
+ *        each group has its own output target streams which are only
+ *        open while the group is processed
+ *
+ *****************************************************************************/
+void process_input_files(const vector<split_input>& inputs,
+                         const database& db, const query_options& opt)
+{
+    struct group_output {
+        output_streams out;
+        std::unique_ptr<classification_results> results;
+    };
+
+    vector<std::unique_ptr<group_output>> groups(inputs.size());
+    vector<vector<string>> inputGroups;
+    for (const auto& input : inputs) {
+        inputGroups.push_back(input.infiles);
+    }
+
+    // groups are opened and closed by different reader threads
+    std::mutex mtx;
+
+    const auto openGroup = [&] (std::size_t g) -> classification_results& {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        const auto& input = inputs[g];
+        groups[g] = std::make_unique<group_output>();
+        auto& out = groups[g]->out;
+        out.open(input.queryMappingsFile, input.targetMappingsFile,
+                 input.abundanceFile, input.binaryMappingsFile);
+
+        groups[g]->results = std::make_unique<classification_results>(
+            *out.perReadOut, *out.perTargetOut, *out.perTaxonOut, cerr);
+        auto& res = *groups[g]->results;
+        res.perReadBinaryOut = out.perReadBinaryOut;
+
+        if (opt.output.showQueryParams) {
+            show_query_parameters(res.perReadOut, opt);
+        }
+        res.flush_all_streams();
+
+        res.time.start();
+        return res;
+    };
+
+    const auto closeGroup = [&] (std::size_t g) {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        auto& res = *groups[g]->results;
+        res.time.stop();
+
+        if (opt.output.showSummary) show_summary(opt, res);
+
+        res.flush_all_streams();
+        // closes output files
+        groups[g].reset();
+    };
+
+    map_queries_to_targets(inputGroups, db, opt, openGroup, closeGroup);
+
+    clear_current_line(cerr);
+    cerr.flush();
+}
+
+
+
 /*************************************************************************//**
  *
  * @brief runs classification on input files;
@@ -156,47 +279,60 @@ void process_input_files(const database& db,
     const auto& ano = opt.output.analysis;
 
     if (opt.splitOutputPerInput) {
-        string queryMappingsFile;
-        string targetMappingsFile;
-        string abundanceFile;
         const size_t stride = (opt.pairing == pairing_mode::files) &&
                               (infiles.size() > 1) ? 2 : 1;
 
+        vector<split_input> inputs;
+
         for (std::size_t i = 0; i < infiles.size(); i += stride) {
-            string suffix;
-            vector<string> input;
+            string name;
+            split_input input;
 
             if (stride == 2) {
                 // process each input file pair separately
                 const auto& f1 = infiles[i];
                 const auto& f2 = infiles[i+1];
-                suffix = "_" + extract_filename(f1)
-                       + "_" + extract_filename(f2)
-                       + ".txt";
-                input = vector<string>{f1,f2};
+                name = "_" + extract_filename(f1)
+                     + "_" + extract_filename(f2);
+                input.infiles = vector<string>{f1,f2};
             }
             else {
                 // process each input file separately
                 const auto& f = infiles[i];
-                suffix = "_" + extract_filename(f) + ".txt";
-                input = vector<string>{f};
+                name = "_" + extract_filename(f);
+                input.infiles = vector<string>{f};
             }
+            const string suffix = name + ".txt";
 
             if (!opt.queryMappingsFile.empty()) {
-                queryMappingsFile = opt.queryMappingsFile + suffix;
+                input.queryMappingsFile = opt.queryMappingsFile + suffix;
             }
             if (!ano.targetMappingsFile.empty() &&
                 ano.targetMappingsFile != opt.queryMappingsFile)
             {
-                targetMappingsFile = ano.targetMappingsFile + suffix;
+                input.targetMappingsFile = ano.targetMappingsFile + suffix;
             }
             if (!ano.abundanceFile.empty() &&
                 ano.abundanceFile != opt.queryMappingsFile)
             {
-                abundanceFile = ano.abundanceFile + suffix;
+                input.abundanceFile = ano.abundanceFile + suffix;
+            }
+            if (!opt.binaryMappingsFile.empty()) {
+                input.binaryMappingsFile = opt.binaryMappingsFile + name + ".bin";
+            }
+            inputs.push_back(std::move(input));
+        }
+
+        if (opt.performance.concurrentFiles > 1 && inputs.size() > 1) {
+            // all inputs share one executor
+            process_input_files(inputs, db, opt);
+        }
+        else {
+            for (const auto& input : inputs) {
+                process_input_files(input.infiles, db, opt,
+                    input.queryMappingsFile, input.targetMappingsFile,
+                    input.abundanceFile, input.binaryMappingsFile);
             }
-            process_input_files(input, db, opt,
-                queryMappingsFile, targetMappingsFile, abundanceFile);
         }
     }
     // process all input files at once
@@ -204,7 +340,8 @@ void process_input_files(const database& db,
         process_input_files(infiles, db, opt,
                             opt.queryMappingsFile,
                             ano.targetMappingsFile,
-                            ano.abundanceFile);
+                            ano.abundanceFile,
+                            opt.binaryMappingsFile);
     }
 }
 
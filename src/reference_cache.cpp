@@ -0,0 +1,450 @@
+/******************************************************************************
+ *
+ * MetaCache - Meta-Genomic Classification Tool
+ *
+ * Copyright (C) 2016-2024 André Müller (muellan@uni-mainz.de)
+ *                       & Robin Kobus  (kobus@uni-mainz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "reference_cache.h"
+#include "io_error.h"
+#include "io_serialize.h"
+#include "sequence_io.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+
+namespace mc {
+
+
+//-------------------------------------------------------------------
+constexpr std::size_t reference_cache::block_size;
+
+// identifies reference index files
+static constexpr std::uint64_t reference_index_magic = 0x584449464552434d; // "MCREFIDX"
+
+
+
+//-------------------------------------------------------------------
+reference_cache::reference_cache(std::size_t maxBytes):
+    maxBytes_{std::max(maxBytes, block_size)}
+{}
+
+
+
+//-------------------------------------------------------------------
+reference_cache::~reference_cache() = default;
+
+
+
+//-------------------------------------------------------------------
+void reference_cache::read_index(const std::string& filename)
+{
+    std::ifstream is{filename, std::ios::in | std::ios::binary};
+    if (!is.good()) return;
+
+    std::uint64_t magic = 0;
+    read_binary(is, magic);
+    if (magic != reference_index_magic) return;
+
+    std::uint64_t numFiles = 0;
+    read_binary(is, numFiles);
+
+    std::lock_guard<std::mutex> lock{filesMtx_};
+
+    for (std::uint64_t i = 0; i < numFiles && is.good(); ++i) {
+        std::string name;
+        auto entry = std::make_unique<file_entry>();
+        read_binary(is, name);
+        read_binary(is, entry->size);
+        read_binary(is, entry->time);
+        read_binary(is, entry->records);
+        if (!is.good()) break;
+
+        // only use index if file didn't change
+        if (entry->size == std::int64_t(file_size(name)) &&
+            entry->time == file_modification_time(name) &&
+            files_.find(name) == files_.end())
+        {
+            entry->id = std::uint32_t(files_.size());
+            entry->indexed = true;
+            entry->mapped = true;
+            files_.emplace(std::move(name), std::move(entry));
+        }
+    }
+    modified_ = false;
+}
+
+
+
+//-------------------------------------------------------------------
+void reference_cache::write_index(const std::string& filename) const
+{
+    std::ofstream os{filename, std::ios::out | std::ios::binary};
+    if (!os.good()) {
+        throw file_access_error{"can't open file " + filename};
+    }
+
+    std::lock_guard<std::mutex> lock{filesMtx_};
+
+    std::uint64_t numFiles = 0;
+    for (const auto& f : files_) {
+        if (f.second->indexed && f.second->mapped) ++numFiles;
+    }
+
+    write_binary(os, reference_index_magic);
+    write_binary(os, numFiles);
+
+    for (const auto& f : files_) {
+        const auto& entry = *f.second;
+        if (entry.indexed && entry.mapped) {
+            write_binary(os, f.first);
+            write_binary(os, entry.size);
+            write_binary(os, entry.time);
+            write_binary(os, entry.records);
+        }
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+bool reference_cache::index_modified() const noexcept
+{
+    std::lock_guard<std::mutex> lock{filesMtx_};
+    return modified_;
+}
+
+
+
+//-------------------------------------------------------------------
+sequence
+reference_cache::subsequence(const std::string& filename, index_type index,
+                             std::size_t beg, std::size_t end)
+{
+    sequence seq;
+    if (beg >= end) return seq;
+
+    file_entry& file = indexed_file(filename);
+
+    for (std::uint64_t b = beg / block_size; b * block_size < end; ++b) {
+        const auto blk = block(file, filename, index, b);
+        const std::size_t blkBeg = b * block_size;
+        const std::size_t first = std::max(beg, blkBeg) - blkBeg;
+        const std::size_t last  = std::min(end - blkBeg, blk->size());
+        if (first < last) seq.append(blk->data() + first, last - first);
+        // end of sequence reached
+        if (blk->size() < block_size) break;
+    }
+    return seq;
+}
+
+
+
+//-------------------------------------------------------------------
+bool reference_cache::first_failure(const std::string& filename)
+{
+    std::lock_guard<std::mutex> lock{filesMtx_};
+
+    auto& entry = files_[filename];
+    if (!entry) {
+        entry = std::make_unique<file_entry>();
+        entry->id = std::uint32_t(files_.size() - 1);
+    }
+    if (entry->failed) return false;
+    entry->failed = true;
+    return true;
+}
+
+
+
+//-------------------------------------------------------------------
+reference_cache::file_entry&
+reference_cache::indexed_file(const std::string& filename)
+{
+    file_entry* file = nullptr;
+    {
+        std::lock_guard<std::mutex> lock{filesMtx_};
+        auto& entry = files_[filename];
+        if (!entry) {
+            entry = std::make_unique<file_entry>();
+            entry->id = std::uint32_t(files_.size() - 1);
+        }
+        file = entry.get();
+    }
+
+    std::lock_guard<std::mutex> lock{file->mtx};
+
+    // don't try again to index inaccessible or malformed files
+    if (file->error) std::rethrow_exception(file->error);
+
+    if (!file->indexed) {
+        try {
+            index_file(*file, filename);
+        }
+        catch (...) {
+            file->error = std::current_exception();
+            throw;
+        }
+        file->indexed = true;
+        if (file->mapped) {
+            std::lock_guard<std::mutex> lock{filesMtx_};
+            modified_ = true;
+        }
+    }
+    else if (file->mapped && file->map.empty() && file->size > 0) {
+        // index was loaded from file
+        file->map = mapped_file{filename};
+    }
+    return *file;
+}
+
+
+
+//-------------------------------------------------------------------
+reference_cache::block_ptr
+reference_cache::block(file_entry& file, const std::string& filename,
+                       index_type index, std::uint64_t blockId)
+{
+    const auto key = block_key{file.id, index, blockId};
+
+    auto blk = cached_block(key);
+    if (blk) return blk;
+
+    if (file.mapped) {
+        if (index >= file.records.size()) {
+            throw io_format_error{"sequence #" + std::to_string(index) +
+                                  " not found in " + filename};
+        }
+        const auto& rec = file.records[index];
+        const std::uint64_t beg = blockId * block_size;
+
+        if (rec.lineBases > 0) {
+            // regular line layout => decode only requested block
+            blk = std::make_shared<const std::string>(
+                      decode(file, rec, beg, beg + block_size));
+            insert_block(key, blk);
+            return blk;
+        }
+        // irregular line layout => decode entire sequence
+        auto seq = decode(file, rec, 0, rec.length);
+        for (std::uint64_t b = 0; b * block_size <= seq.size(); ++b) {
+            const auto k = block_key{file.id, index, b};
+            const auto p = std::make_shared<const std::string>(
+                               seq.substr(b * block_size, block_size));
+            insert_block(k, p);
+            if (b == blockId) blk = p;
+        }
+    }
+    else {
+        // not indexable => read file sequentially up to sequence
+        std::lock_guard<std::mutex> lock{file.mtx};
+
+        // might have been read by another thread in the meantime
+        blk = cached_block(key);
+        if (blk) return blk;
+
+        // continue from previous position if possible
+        if (!file.reader || file.reader->index() > index) {
+            file.reader.reset();
+            file.reader = std::make_unique<sequence_reader>(filename);
+        }
+        auto& reader = *file.reader;
+        reader.skip(index - reader.index());
+        if (!reader.has_next()) {
+            throw io_format_error{"sequence #" + std::to_string(index) +
+                                  " not found in " + filename};
+        }
+        const auto seq = reader.next_data();
+        for (std::uint64_t b = 0; b * block_size <= seq.size(); ++b) {
+            const auto k = block_key{file.id, index, b};
+            const std::size_t first = b * block_size;
+            const std::size_t n = std::min(block_size, seq.size() - first);
+            const auto p = std::make_shared<const std::string>(
+                               seq.begin() + first, n);
+            insert_block(k, p);
+            if (b == blockId) blk = p;
+        }
+    }
+
+    if (!blk) blk = std::make_shared<const std::string>();
+    return blk;
+}
+
+
+
+//-------------------------------------------------------------------
+reference_cache::block_ptr
+reference_cache::cached_block(const block_key& key)
+{
+    std::lock_guard<std::mutex> lock{cacheMtx_};
+
+    auto it = blocks_.find(key);
+    if (it == blocks_.end()) return nullptr;
+
+    // mark as most recently used
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->second;
+}
+
+
+
+//-------------------------------------------------------------------
+void reference_cache::insert_block(const block_key& key, block_ptr blk)
+{
+    std::lock_guard<std::mutex> lock{cacheMtx_};
+
+    if (blocks_.find(key) != blocks_.end()) return;
+
+    bytes_ += blk->size();
+    lru_.emplace_front(key, std::move(blk));
+    blocks_.emplace(key, lru_.begin());
+
+    // evict least recently used blocks
+    while (bytes_ > maxBytes_ && lru_.size() > 1) {
+        bytes_ -= lru_.back().second->size();
+        blocks_.erase(lru_.back().first);
+        lru_.pop_back();
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+/**
+ * @brief records the sequence locations of all records in a FASTA/FASTQ
+ *        file; follows the same parsing rules as 'sequence_reader'
+ */
+void reference_cache::index_file(file_entry& file, const std::string& filename)
+{
+    file.records.clear();
+    file.mapped = false;
+
+    file.size = std::int64_t(file_size(filename));
+    file.time = file_modification_time(filename);
+
+    // throws, if file is not accessible
+    auto map = mapped_file{filename};
+
+    const char* p = map.begin();
+    const char* const end = map.end();
+
+    // compressed or not a FASTA/FASTQ file => sequential reading
+    if (p == end || (*p != '>' && *p != '@')) return;
+
+    const auto next_line = [end] (const char* q) {
+        q = static_cast<const char*>(std::memchr(q, '\n', end - q));
+        return q ? q + 1 : end;
+    };
+
+    while (p < end) {
+        // forward to next header (skip malformed lines)
+        while (p < end && *p != '>' && *p != '@') p = next_line(p);
+        if (p >= end) break;
+        p = next_line(p);
+
+        record_location rec;
+        rec.offset = std::uint64_t(p - map.begin());
+        bool regular = true;
+        bool shortLine = false;
+
+        // sequence lines
+        while (p < end && *p != '>' && *p != '+') {
+            const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if (!eol) eol = end;
+            std::uint64_t n = eol - p;
+            const std::uint64_t width = (eol < end ? eol + 1 : eol) - p;
+            if (n > 0 && p[n-1] == '\r') --n;
+
+            if (n == 0) {
+                regular = false;
+            }
+            else if (rec.lineBases == 0) {
+                rec.lineBases = n;
+                rec.lineWidth = width;
+            }
+            else if (shortLine || n > rec.lineBases ||
+                     width - n != rec.lineWidth - rec.lineBases)
+            {
+                regular = false;
+            }
+            else if (n < rec.lineBases) {
+                // only last line may be shorter
+                shortLine = true;
+            }
+            rec.length += n;
+            p = (eol < end) ? eol + 1 : end;
+        }
+
+        // FASTQ: skip '+' line and quality line
+        if (p < end && *p == '+') p = next_line(next_line(p));
+
+        if (!regular) rec.lineBases = 0;
+        file.records.push_back(rec);
+    }
+
+    file.map = std::move(map);
+    file.mapped = true;
+}
+
+
+
+//-------------------------------------------------------------------
+std::string
+reference_cache::decode(const file_entry& file, const record_location& rec,
+                        std::uint64_t beg, std::uint64_t end)
+{
+    std::string seq;
+    end = std::min(end, rec.length);
+    if (beg >= end) return seq;
+
+    seq.reserve(end - beg);
+    const char* data = file.map.begin() + rec.offset;
+
+    if (rec.lineBases > 0) {
+        for (std::uint64_t i = beg; i < end; ) {
+            const std::uint64_t col = i % rec.lineBases;
+            const std::uint64_t n = std::min(rec.lineBases - col, end - i);
+            seq.append(data + (i / rec.lineBases) * rec.lineWidth + col, n);
+            i += n;
+        }
+    }
+    else {
+        // scan lines (skipping empty lines and line breaks)
+        const char* fileEnd = file.map.end();
+        std::uint64_t i = 0;
+        for (const char* p = data; p < fileEnd && i < end; ) {
+            const char* eol = static_cast<const char*>(
+                              std::memchr(p, '\n', fileEnd - p));
+            if (!eol) eol = fileEnd;
+            std::uint64_t n = eol - p;
+            if (n > 0 && p[n-1] == '\r') --n;
+            // overlap of line [i,i+n) with [beg,end)
+            const std::uint64_t first = std::max(i, beg);
+            const std::uint64_t last  = std::min(i + n, end);
+            if (first < last) seq.append(p + (first - i), last - first);
+            i += n;
+            p = eol + 1;
+        }
+    }
+    return seq;
+}
+
+
+} // namespace mc
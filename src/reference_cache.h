@@ -0,0 +1,198 @@
+/******************************************************************************
+ *
+ * MetaCache - Meta-Genomic Classification Tool
+ *
+ * Copyright (C) 2016-2024 André Müller (muellan@uni-mainz.de)
+ *                       & Robin Kobus  (kobus@uni-mainz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef MC_REFERENCE_CACHE_H_
+#define MC_REFERENCE_CACHE_H_
+
+
+#include "config.h"
+#include "filesys_utility.h"
+
+#include <cstdint>
+#include <exception>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace mc {
+
+
+class sequence_reader;
+
+
+/*************************************************************************//**
+ *
+ * @brief random access to (parts of) reference sequences in FASTA/FASTQ files
+ *
+ *        Uncompressed files are memory-mapped and indexed once (record
+ *        offsets and line layout, similar to samtools' '.fai' files);
+ *        sequence ranges are then decoded directly from the mapping.
+ *        Compressed files are read sequentially up to the requested record;
+ *        one reader per file is kept open, so that requests for ascending
+ *        records continue from the position of the previous one.
+ *
+ *        Decoded sequence data is kept in fixed-size blocks in a bounded
+ *        LRU cache that is shared by all threads; concurrency safe
+ *
+ *****************************************************************************/
+class reference_cache
+{
+public:
+    using index_type = std::uint_least64_t;
+
+    /// number of sequence characters per cache block
+    static constexpr std::size_t block_size = std::size_t(1) << 16;
+
+    //---------------------------------------------------------------
+    explicit
+    reference_cache(std::size_t maxBytes = std::size_t(1) << 28);
+
+    reference_cache(const reference_cache&) = delete;
+    reference_cache& operator = (const reference_cache&) = delete;
+
+    ~reference_cache();
+
+
+    //---------------------------------------------------------------
+    /**
+     * @brief loads record indices of reference files;
+     *        entries of files that changed since are ignored
+     */
+    void read_index(const std::string& filename);
+
+    /** @brief writes record indices of all indexed files */
+    void write_index(const std::string& filename) const;
+
+    /** @return true, if files were indexed since construction/read_index */
+    bool index_modified() const noexcept;
+
+
+    //---------------------------------------------------------------
+    /**
+     * @brief returns characters [beg,end) of sequence #index
+     *        (0-based, like taxon::file_source::index)
+     *        in a FASTA/FASTQ file; range is clamped to sequence size
+     * @throws file_access_error, io_format_error
+     */
+    sequence
+    subsequence(const std::string& filename, index_type index,
+                std::size_t beg, std::size_t end);
+
+    /**
+     * @brief marks a file as failed (e.g. after 'subsequence' threw)
+     * @return true, if it hasn't been marked before
+     *         (so that each failure only needs to be reported once)
+     */
+    bool first_failure(const std::string& filename);
+
+
+private:
+    //---------------------------------------------------------------
+    /// location of sequence data of one record in a file
+    struct record_location {
+        std::uint64_t offset = 0;    // first sequence character
+        std::uint64_t length = 0;    // number of sequence characters
+        // characters and bytes (incl. line break) per line;
+        // lineBases = 0: irregular line layout
+        std::uint64_t lineBases = 0;
+        std::uint64_t lineWidth = 0;
+    };
+
+    //---------------------------------------------------------------
+    struct file_entry {
+        std::mutex mtx;
+        std::uint32_t id = 0;
+        bool indexed = false;
+        // false: compressed or otherwise not indexable
+        bool mapped = false;
+        std::int64_t size = 0;
+        std::int64_t time = 0;
+        mapped_file map;
+        std::vector<record_location> records;
+        // failure of indexing; rethrown on every access
+        std::exception_ptr error;
+        // sequential reader of files that are not mapped
+        std::unique_ptr<sequence_reader> reader;
+        // failure was reported; guarded by filesMtx_
+        bool failed = false;
+    };
+
+    using block_ptr = std::shared_ptr<const std::string>;
+
+    //---------------------------------------------------------------
+    struct block_key {
+        std::uint32_t file;
+        index_type record;
+        std::uint64_t block;
+
+        friend bool operator == (const block_key& a, const block_key& b) noexcept {
+            return a.file == b.file && a.record == b.record && a.block == b.block;
+        }
+    };
+
+    struct block_key_hash {
+        std::size_t operator () (const block_key& k) const noexcept {
+            return std::hash<std::uint64_t>{}(
+                (std::uint64_t(k.file) << 48) ^ (k.record << 24) ^ k.block);
+        }
+    };
+
+    using lru_list = std::list<std::pair<block_key,block_ptr>>;
+
+
+    //---------------------------------------------------------------
+    file_entry& indexed_file(const std::string& filename);
+
+    block_ptr block(file_entry&, const std::string& filename,
+                    index_type index, std::uint64_t blockId);
+
+    block_ptr cached_block(const block_key&);
+
+    void insert_block(const block_key&, block_ptr);
+
+    static void index_file(file_entry&, const std::string& filename);
+
+    static std::string decode(const file_entry&, const record_location&,
+                              std::uint64_t beg, std::uint64_t end);
+
+
+    //---------------------------------------------------------------
+    mutable std::mutex filesMtx_;
+    std::unordered_map<std::string,std::unique_ptr<file_entry>> files_;
+    bool modified_ = false;
+
+    std::mutex cacheMtx_;
+    lru_list lru_;
+    std::unordered_map<block_key,lru_list::iterator,block_key_hash> blocks_;
+    std::size_t bytes_ = 0;
+    std::size_t maxBytes_;
+};
+
+
+} // namespace mc
+
+
+#endif
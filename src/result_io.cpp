@@ -0,0 +1,294 @@
+/******************************************************************************
+ *
+ * MetaCache - Meta-Genomic Classification Tool
+ *
+ * Copyright (C) 2016-2024 André Müller (muellan@uni-mainz.de)
+ *                       & Robin Kobus  (kobus@uni-mainz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+#include "result_io.h"
+#include "database_query.h"
+#include "io_serialize.h"
+
+#include <algorithm>
+
+
+namespace mc {
+
+
+//-------------------------------------------------------------------
+// file layout:
+//   magic string, format version, candidate rank, target sketching options
+//   per query:
+//     record marker, query id, header length + header,
+//     classification taxid + rank, candidate count,
+//     per candidate: taxid, target id, hits, first window, window count - 1
+//   end-of-file marker
+// all numbers in query records are variable-length encoded;
+// taxids are zigzag encoded, because sequence-level taxids are negative
+static const std::string result_file_magic = "MetaCacheResults";
+static constexpr std::uint64_t result_file_version = 2;
+static constexpr std::uint8_t  query_record_marker = 1;
+static constexpr std::uint8_t  end_of_file_marker = 0;
+
+
+
+//-------------------------------------------------------------------
+// the length is checked first, so that arbitrary files
+// never cause huge allocations
+static bool
+read_result_file_magic(std::istream& is)
+{
+    std::uint64_t n = 0;
+    read_binary(is, n);
+    if (!is.good() || n != result_file_magic.size()) return false;
+
+    std::string magic(n, ' ');
+    is.read(&magic[0], n);
+
+    return is.good() && magic == result_file_magic;
+}
+
+
+
+//-------------------------------------------------------------------
+// 7 bits per byte, high bit is set if more bytes follow
+inline void
+append_varint(print_buffer& buf, std::uint64_t x)
+{
+    char bytes[10];
+    int n = 0;
+    while (x >= 0x80) {
+        bytes[n++] = char((x & 0x7f) | 0x80);
+        x >>= 7;
+    }
+    bytes[n++] = char(x);
+    buf.write(bytes, n);
+}
+
+inline void
+append_varint(print_buffer& buf, std::int64_t x)
+{
+    append_varint(buf, (std::uint64_t(x) << 1) ^ std::uint64_t(x >> 63));
+}
+
+
+//-------------------------------------------------------------------
+inline std::uint64_t
+read_varint(std::istream& is)
+{
+    std::uint64_t x = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        const auto c = is.get();
+        if (c == std::char_traits<char>::eof()) break;
+        x |= std::uint64_t(c & 0x7f) << shift;
+        if (!(c & 0x80)) break;
+    }
+    return x;
+}
+
+inline std::int64_t
+read_signed_varint(std::istream& is)
+{
+    const auto x = read_varint(is);
+    return std::int64_t(x >> 1) ^ -std::int64_t(x & 1);
+}
+
+
+
+//-------------------------------------------------------------------
+void write_result_file_header(std::ostream& os,
+                              const result_file_properties& props)
+{
+    write_binary(os, result_file_magic);
+    write_binary(os, result_file_version);
+    write_binary(os, std::uint8_t(props.candidateRank));
+    write_binary(os, props.sketching);
+}
+
+
+//-------------------------------------------------------------------
+void write_result_file_footer(std::ostream& os)
+{
+    write_binary(os, end_of_file_marker);
+}
+
+
+//-------------------------------------------------------------------
+void append_query_result(print_buffer& buf,
+                         const sequence_query& query,
+                         const taxon* cls,
+                         const span<const match_candidate> cand,
+                         const taxonomy_cache& taxonomy,
+                         taxon_rank candidateRank)
+{
+    using size_t = span<match_candidate>::size_type;
+
+    // first contiguous string of header
+    const auto headerEnd = std::find(query.header.begin(), query.header.end(), ' ');
+    const auto headerSize = std::uint32_t(headerEnd - query.header.begin());
+
+    size_t numCand = 0;
+    while (numCand < cand.size() && cand[numCand].hits > 0) ++numCand;
+
+    buf << char(query_record_marker);
+    append_varint(buf, std::uint64_t(query.id));
+    append_varint(buf, std::uint64_t(headerSize));
+    buf.write(query.header.begin(), headerSize);
+    append_varint(buf, std::int64_t(cls ? cls->id() : taxonomy::none_id()));
+    buf << char(cls ? cls->rank() : taxon_rank::none);
+    append_varint(buf, std::uint64_t(numCand));
+
+    for (size_t i = 0; i < numCand; ++i) {
+        // same taxa as in text output column 'top_hits'
+        const taxon* tax = (candidateRank != taxon_rank::Sequence &&
+                            cand[i].tax->rank() < candidateRank) ?
+                           taxonomy.cached_ancestor(cand[i].tgt, candidateRank) :
+                           cand[i].tax;
+        if (!tax) tax = cand[i].tax;
+
+        append_varint(buf, std::int64_t(tax->id()));
+        append_varint(buf, std::uint64_t(cand[i].tgt));
+        append_varint(buf, std::uint64_t(cand[i].hits));
+        append_varint(buf, std::uint64_t(cand[i].pos.beg));
+        append_varint(buf, std::uint64_t(cand[i].pos.end - cand[i].pos.beg));
+    }
+}
+
+
+
+
+//-------------------------------------------------------------------
+result_reader::result_reader(const std::string& filename) :
+    file_{filename, std::ios::in | std::ios::binary},
+    is_{file_},
+    filename_{filename},
+    props_{},
+    hasNext_{false}
+{
+    if (!is_.good()) {
+        throw file_access_error{"Could not read result file '" + filename + "'"};
+    }
+    read_header();
+}
+
+
+//-------------------------------------------------------------------
+result_reader::result_reader(std::istream& is, const std::string& name) :
+    file_{},
+    is_{is},
+    filename_{name},
+    props_{},
+    hasNext_{false}
+{
+    if (!is_.good()) {
+        throw file_access_error{"Could not read result file '" + name + "'"};
+    }
+    read_header();
+}
+
+
+//-------------------------------------------------------------------
+void result_reader::read_header()
+{
+    const bool validMagic = read_result_file_magic(is_);
+
+    std::uint64_t version = 0;
+    std::uint8_t rank = 0;
+
+    if (validMagic) {
+        read_binary(is_, version);
+        read_binary(is_, rank);
+    }
+
+    if (!validMagic || version != result_file_version ||
+        rank > std::uint8_t(taxon_rank::none))
+    {
+        throw io_format_error{"Result file '" + filename_ + "' is incompatible "
+                              "with this version of MetaCache"};
+    }
+
+    props_.candidateRank = taxon_rank(rank);
+    read_binary(is_, props_.sketching);
+
+    peek();
+}
+
+
+//-------------------------------------------------------------------
+void result_reader::peek()
+{
+    using traits = std::char_traits<char>;
+
+    const auto c = is_.peek();
+    hasNext_ = is_.good() && c == traits::to_int_type(query_record_marker);
+
+    if (!hasNext_ && (!is_.good() || c != traits::to_int_type(end_of_file_marker))) {
+        throw io_format_error{"Result file '" + filename_ + "' is truncated"};
+    }
+}
+
+
+//-------------------------------------------------------------------
+void result_reader::next(query_result& res)
+{
+    res.candidates.clear();
+
+    if (!hasNext_) return;
+
+    std::uint8_t marker = 0;
+    std::uint8_t rank = 0;
+
+    read_binary(is_, marker);
+    res.id = read_varint(is_);
+    res.header.resize(read_varint(is_));
+    if (!res.header.empty()) is_.read(&res.header[0], res.header.size());
+    res.taxid = read_signed_varint(is_);
+    read_binary(is_, rank);
+    res.rank = taxon_rank(rank);
+
+    const auto numCand = read_varint(is_);
+    for (std::uint64_t i = 0; i < numCand && is_.good(); ++i) {
+        result_candidate c;
+        c.taxid   = read_signed_varint(is_);
+        c.tgt     = target_id(read_varint(is_));
+        c.hits    = match_candidate::count_type(read_varint(is_));
+        c.pos.beg = window_id(read_varint(is_));
+        c.pos.end = window_id(c.pos.beg + read_varint(is_));
+        res.candidates.push_back(c);
+    }
+
+    if (!is_.good()) {
+        throw io_format_error{"Result file '" + filename_ + "' is truncated"};
+    }
+
+    peek();
+}
+
+
+
+
+//-------------------------------------------------------------------
+bool is_result_file(const std::string& filename)
+{
+    std::ifstream is{filename, std::ios::in | std::ios::binary};
+    if (!is.good()) return false;
+
+    return read_result_file_magic(is);
+}
+
+
+} // namespace mc
@@ -0,0 +1,176 @@
+/******************************************************************************
+ *
+ * MetaCache - Meta-Genomic Classification Tool
+ *
+ * Copyright (C) 2016-2024 André Müller (muellan@uni-mainz.de)
+ *                       & Robin Kobus  (kobus@uni-mainz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef MC_RESULT_IO_H_
+#define MC_RESULT_IO_H_
+
+#include "candidate_structs.h"
+#include "config.h"
+#include "io_error.h"
+#include "print_buffer.h"
+#include "span.h"
+#include "taxonomy.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+namespace mc {
+
+// / @brief forward declarations
+struct sequence_query;
+
+
+/*************************************************************************//**
+ *
+ * @brief properties of a binary per-read result file
+ *
+ *****************************************************************************/
+struct result_file_properties
+{
+    // rank on which candidate taxa are reported
+    taxon_rank candidateRank = taxon_rank::Sequence;
+    // target sketching of the queried database (window -> position)
+    sketching_opt sketching;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief top candidate of a query as stored in a binary result file
+ *
+ *****************************************************************************/
+struct result_candidate
+{
+    // candidate taxon on the file's candidate rank
+    taxon_id taxid = taxonomy::none_id();
+    target_id tgt = 0;
+    match_candidate::count_type hits = 0;
+    window_range pos;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief per-read result as stored in a binary result file
+ *
+ *****************************************************************************/
+struct query_result
+{
+    query_id id = 0;
+    // first contiguous string of query header
+    std::string header;
+    // classification result (none_id, if unclassified)
+    taxon_id taxid = taxonomy::none_id();
+    taxon_rank rank = taxon_rank::none;
+    std::vector<result_candidate> candidates;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief writes file header of binary per-read result file
+ *
+ *****************************************************************************/
+void write_result_file_header(std::ostream&, const result_file_properties&);
+
+
+/*************************************************************************//**
+ *
+ * @brief marks binary per-read result file as complete;
+ *        files without footer are rejected by 'result_reader'
+ *
+ *****************************************************************************/
+void write_result_file_footer(std::ostream&);
+
+
+/*************************************************************************//**
+ *
+ * @brief appends binary record of one classified query to a buffer;
+ *        candidates are stored until the first one without hits
+ *
+ *****************************************************************************/
+void append_query_result(print_buffer&,
+                         const sequence_query&,
+                         const taxon* classification,
+                         span<const match_candidate>,
+                         const taxonomy_cache&,
+                         taxon_rank candidateRank);
+
+
+
+/*************************************************************************//**
+ *
+ * @brief reads per-read results from file written with
+ *        'write_result_file_header' + 'append_query_result'
+ *        + 'write_result_file_footer';
+ *        NOT concurrency safe
+ *
+ *****************************************************************************/
+class result_reader
+{
+public:
+    explicit
+    result_reader(const std::string& filename);
+
+    /** @brief reads from already opened stream (e.g., a pipe);
+     *         'name' is only used in error messages */
+    result_reader(std::istream&, const std::string& name);
+
+    const result_file_properties& properties() const noexcept { return props_; }
+
+    bool has_next() const noexcept { return hasNext_; }
+
+    /** @brief read next query result re-using external storage */
+    void next(query_result&);
+
+private:
+    void read_header();
+    void peek();
+
+    std::ifstream file_;
+    std::istream& is_;
+    std::string filename_;
+    result_file_properties props_;
+    bool hasNext_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @return true, if file is a binary per-read result file
+ *
+ *****************************************************************************/
+bool is_result_file(const std::string& filename);
+
+
+
+} // namespace mc
+
+
+#endif
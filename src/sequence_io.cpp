@@ -24,6 +24,7 @@
 #include "io_error.h"
 #include "string_utils.h"
 
+#include <cstring>
 #include <regex>
 
 
@@ -34,12 +35,14 @@ using std::string;
 
 
 //-----------------------------------------------------------------------------
-sequence_reader::sequence_reader (const std::string& filename) :
+sequence_reader::sequence_reader (const std::string& filename,
+                                  unsigned maxThreads)
+:
     stream_{},
     index_{0}
 {
     if (!filename.empty()) {
-        stream_.open(filename.c_str());
+        stream_.open(filename.c_str(), maxThreads);
 
         if (!stream_.good()) {
             throw file_access_error{"can't open file " + filename};
@@ -88,7 +91,7 @@ sequence_reader::next_header ()
 
     ++index_;
     header_type header;
-    read_next(&header, nullptr, nullptr);
+    read_next<data_type>(&header, nullptr, nullptr);
     return header;
 }
 
@@ -142,6 +145,24 @@ sequence_reader::next_header_and_data (sequence::header_type& header,
 
 
 
+//-------------------------------------------------------------------
+sequence_reader::index_type
+sequence_reader::next_header_and_data (sequence::header_type& header,
+                                       packed_sequence& data)
+{
+    if (!has_next()) {
+        header.clear();
+        data.clear();
+        return index();
+    }
+
+    ++index_;
+    read_next(&header, &data, nullptr);
+    return index_;
+}
+
+
+
 //-------------------------------------------------------------------
 void sequence_reader::skip (index_type skip)
 {
@@ -156,8 +177,9 @@ void sequence_reader::skip (index_type skip)
 
 
 //-------------------------------------------------------------------
+template<class Data>
 void sequence_reader::read_next (header_type* header,
-                                 data_type* data,
+                                 Data* data,
                                  qualities_type* qualities)
 {
     if (header) header->clear();
@@ -210,8 +232,8 @@ void sequence_reader::read_next (header_type* header,
     stream_.skip_line();
 
     if (qualities) {
-        // qualities->reserve_exactly(data->capacity());
-        qualities->reserve(data->capacity());
+        // qualities->reserve_exactly(data->size());
+        if (data) qualities->reserve(data->size());
         // read quality string
         stream_.append_line(*qualities);
     }
@@ -231,7 +253,7 @@ void sequence_reader::read_next (header_type* header,
 //-------------------------------------------------------------------
 void sequence_reader::skip_next ()
 {
-    read_next(nullptr, nullptr, nullptr);
+    read_next<data_type>(nullptr, nullptr, nullptr);
 }
 
 
@@ -451,6 +473,543 @@ void sequence_pair_reader::index_offset (index_type index)
 
 
 
+
+
+
+//-----------------------------------------------------------------------------
+// R E C O R D   R E A D E R
+//-----------------------------------------------------------------------------
+namespace {
+
+/*************************************************************************//**
+ *
+ * @brief emulates the 'char_istream' operations used by
+ *        'sequence_reader::read_next' on an in-memory range;
+ *        all operations return false, if more input is needed
+ *
+ *****************************************************************************/
+struct record_cursor
+{
+    char* pos;
+    char* end;
+    bool eof;   // no more input after 'end'
+    bool good;
+    char lastChar;
+
+    bool peek_char () noexcept {
+        if (good && pos < end) {
+            lastChar = *pos;
+            return true;
+        }
+        if (good && !eof) return false;
+        good = false;
+        lastChar = 0;
+        return true;
+    }
+
+    bool read_char () noexcept {
+        if (!peek_char()) return false;
+        if (good) ++pos;
+        return true;
+    }
+
+    /** @brief line [first,last) without line separator and trailing '\r' */
+    bool next_line (char*& first, char*& last) noexcept {
+        first = pos;
+        last  = pos;
+        if (!good) return true;
+
+        auto sep = static_cast<char*>(std::memchr(pos, '\n', end - pos));
+        if (sep) {
+            last = sep;
+            pos  = sep + 1;
+        }
+        else {
+            if (!eof) return false;
+            last = end;
+            pos  = end;
+            good = false;
+        }
+        if (last > first && last[-1] == '\r') --last;
+        return true;
+    }
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief parses one record with the same state transitions as
+ *        'sequence_reader::read_next'; joins multi-line sequences in place
+ *
+ * @return false, if record is incomplete (cursor is invalid then)
+ *
+ *****************************************************************************/
+bool parse_record (record_cursor& cur,
+                   std::vector<std::pair<char*,char*>>& lines,
+                   bool withHeaders, bool withQualities,
+                   sequence_record& rec)
+{
+    char* first = nullptr;
+    char* last  = nullptr;
+    char* headerFirst = nullptr;
+    char* headerLast  = nullptr;
+    char* qualFirst   = nullptr;
+    char* qualLast    = nullptr;
+    lines.clear();
+
+    const bool complete = [&] {
+        while (cur.good && cur.lastChar != '>' && cur.lastChar != '@') {
+            // malformed fastx file, try to recover at next line
+            if (!cur.next_line(first, last) || !cur.read_char()) return false;
+        }
+        if (!cur.good) return true; // end of file or error
+
+        if (!cur.next_line(headerFirst, headerLast)) return false;
+        if (!cur.good) return true;
+
+        // first character of next line
+        if (!cur.peek_char()) return false;
+        // sequence lines
+        while (cur.good && cur.lastChar != '>' && cur.lastChar != '+') {
+            // skip empty lines
+            if (cur.lastChar == '\n') {
+                if (!cur.read_char() || !cur.peek_char()) return false;
+                continue;
+            }
+            if (!cur.next_line(first, last)) return false;
+            if (last > first) lines.emplace_back(first, last);
+            if (!cur.peek_char()) return false;
+        }
+        if (!cur.read_char()) return false;
+        if (!cur.good) return true;
+
+        // check for 3rd FASTQ line
+        if (cur.lastChar != '+') return true; // FASTA
+
+        // skip 3rd FASTQ line, get quality line
+        if (!cur.next_line(first, last)) return false;
+        if (!cur.next_line(qualFirst, qualLast)) return false;
+        if (!cur.good) return true;
+
+        // first character of next line
+        return cur.read_char();
+    }();
+
+    if (!complete) return false;
+
+    // join lines of multi-line sequences in place
+    char* dataFirst = nullptr;
+    char* dataLast  = nullptr;
+    if (!lines.empty()) {
+        dataFirst = lines.front().first;
+        dataLast  = lines.front().second;
+        for (std::size_t i = 1; i < lines.size(); ++i) {
+            const auto n = lines[i].second - lines[i].first;
+            std::memmove(dataLast, lines[i].first, n);
+            dataLast += n;
+        }
+    }
+
+    using view_type = sequence_record::view_type;
+
+    rec.header    = withHeaders ? view_type{headerFirst, headerLast} : view_type{};
+    rec.data      = view_type{dataFirst, dataLast};
+    rec.qualities = withQualities ? view_type{qualFirst, qualLast} : view_type{};
+
+    return true;
+}
+
+
+} // namespace
+
+
+
+//-------------------------------------------------------------------
+sequence_record_reader::sequence_record_reader (const std::string& filename,
+                                                bool withHeaders,
+                                                bool withQualities,
+                                                unsigned maxThreads)
+:
+    withHeaders_{withHeaders},
+    withQualities_{withQualities}
+{
+    if (!filename.empty()) {
+        stream_.open(filename.c_str(), maxThreads);
+
+        if (!stream_.good()) {
+            throw file_access_error{"can't open file " + filename};
+        }
+    }
+    else {
+        throw file_access_error{"no filename was given"};
+    }
+
+    eof_  = false;
+    good_ = true;
+    refill(0);
+    read_char();
+
+    if (lastChar_ != '>' && lastChar_ != '@')
+        throw io_format_error{"malformed fasta/fastq file - "
+                              "expected header char '>' or '@' not found"};
+}
+
+
+
+//-------------------------------------------------------------------
+sequence_record_reader::index_type
+sequence_record_reader::next (sequence_record& rec)
+{
+    if (!has_next()) {
+        rec.clear();
+        return index();
+    }
+
+    ++index_;
+    rec.index = index_;
+    // record might be incomplete => get more input and retry
+    while (!parse_next(rec)) {
+        refill(pos_);
+    }
+    return index_;
+}
+
+
+
+//-------------------------------------------------------------------
+bool sequence_record_reader::parse_next (sequence_record& rec)
+{
+    record_cursor cur{block_->data() + pos_, block_->data() + block_->size(),
+                      eof_, good_, lastChar_};
+
+    if (!parse_record(cur, lines_, withHeaders_, withQualities_, rec)) {
+        return false;
+    }
+
+    pos_      = cur.pos - block_->data();
+    good_     = cur.good;
+    lastChar_ = cur.lastChar;
+    rec.block = block_;
+
+    return true;
+}
+
+
+
+//-------------------------------------------------------------------
+void sequence_record_reader::refill (std::size_t keepFrom)
+{
+    const std::size_t tail = block_ ? block_->size() - keepFrom : 0;
+
+    std::size_t capacity = default_block_size();
+    while (tail > capacity / 2) capacity *= 2;
+
+    if (block_ && block_.use_count() == 1 && block_->capacity() == capacity) {
+        // no record views into current block left => re-use it
+        std::memmove(block_->data(), block_->data() + keepFrom, tail);
+    }
+    else {
+        auto block = std::make_shared<sequence_block>(capacity);
+        if (tail > 0) {
+            std::memcpy(block->data(), block_->data() + keepFrom, tail);
+        }
+        block_ = std::move(block);
+    }
+
+    const auto n = stream_.read(block_->data() + tail, capacity - tail);
+    block_->resize(tail + n);
+    pos_ = 0;
+    eof_ = !stream_.good();
+}
+
+
+
+//-------------------------------------------------------------------
+void sequence_record_reader::read_char ()
+{
+    if (pos_ >= block_->size() && !eof_) refill(pos_);
+
+    if (pos_ < block_->size()) {
+        lastChar_ = block_->data()[pos_++];
+    }
+    else {
+        lastChar_ = 0;
+        good_ = false;
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+std::size_t sequence_record_reader::count_chunk_records (std::size_t n,
+                                                        std::size_t minCount)
+{
+    if (!good_ || lastChar_ != '@') return 0;
+
+    for (;;) {
+        const char* p   = block_->data() + pos_;
+        const char* end = block_->data() + block_->size();
+
+        const auto skip_line = [&] {
+            auto sep = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if (!sep) return false;
+            p = sep + 1;
+            return true;
+        };
+
+        std::size_t count = 0;
+        bool valid = true;
+        while (count < n) {
+            // header line (header char of 1st record was already read)
+            if (count > 0) {
+                if (p >= end) break;
+                if (*p != '@') { valid = false; break; }
+            }
+            if (!skip_line()) break;
+            // sequence line
+            if (p >= end) break;
+            if (*p == '>' || *p == '+') { valid = false; break; }
+            if (!skip_line()) break;
+            // 3rd line
+            if (p >= end) break;
+            if (*p != '+') { valid = false; break; }
+            if (!skip_line()) break;
+            // quality line
+            if (!skip_line()) break;
+            ++count;
+        }
+
+        if (count >= minCount || count >= n || !valid || eof_) return count;
+
+        // not enough complete records in current block
+        refill(pos_);
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+sequence_record_reader::chunk_range
+sequence_record_reader::take_chunk_records (std::size_t n)
+{
+    chunk_range chunk;
+    chunk.block = block_;
+    chunk.first = block_->data() + pos_;
+
+    // records were already validated by 'count_chunk_records'
+    char* p = chunk.first;
+    char* end = block_->data() + block_->size();
+    for (std::size_t i = 0; i < 4*n; ++i) {
+        p = static_cast<char*>(std::memchr(p, '\n', end - p)) + 1;
+    }
+    chunk.last = p;
+
+    pos_ = p - block_->data();
+    index_ += n;
+    // first character of next record
+    read_char();
+
+    return chunk;
+}
+
+
+
+
+
+
+//-----------------------------------------------------------------------------
+// C H U N K
+//-----------------------------------------------------------------------------
+sequence_chunk::index_type
+sequence_chunk::next (sequence_record& rec1, sequence_record& rec2)
+{
+    if (empty()) return index_;
+
+    --count_;
+    ++index_;
+
+    switch (pairing_) {
+        case pairing_mode::none :
+            next(first_, rec1, withHeaders_);
+            rec2.clear();
+            break;
+        case pairing_mode::files :
+            next(first_, rec1, withHeaders_);
+            next(second_, rec2, false);
+            break;
+        case pairing_mode::sequences :
+            next(first_, rec1, withHeaders_);
+            next(first_, rec2, withHeaders_);
+            break;
+    }
+    rec1.index = index_;
+    rec2.index = index_;
+
+    return index_;
+}
+
+
+
+//-------------------------------------------------------------------
+void sequence_chunk::next (part& p, sequence_record& rec, bool withHeaders)
+{
+    // chunks only contain complete 4-line FASTQ records
+    // => header char of each record was already read
+    record_cursor cur{p.pos, p.end, true, p.good, '@'};
+
+    parse_record(cur, lines_, withHeaders, withQualities_, rec);
+
+    p.pos  = cur.pos;
+    p.good = cur.good;
+    rec.block = p.block;
+}
+
+
+
+
+
+
+//-----------------------------------------------------------------------------
+// R E C O R D   P A I R    R E A D E R
+//-----------------------------------------------------------------------------
+sequence_record_pair_reader::sequence_record_pair_reader (
+    const std::string& filename1, const std::string& filename2,
+    bool withHeaders, bool withQualities, unsigned maxThreads)
+:
+    reader1_{},
+    reader2_{},
+    pairing_{pairing_mode::none}
+{
+    if (!filename1.empty()) {
+        reader1_ = sequence_record_reader(filename1, withHeaders, withQualities,
+                                          maxThreads);
+
+        if (!filename2.empty()) {
+            if (filename1 != filename2) {
+                pairing_ = pairing_mode::files;
+                reader2_ = sequence_record_reader(filename2, false, withQualities,
+                                                  maxThreads);
+            }
+            else {
+                pairing_ = pairing_mode::sequences;
+            }
+        }
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+bool sequence_record_pair_reader::has_next () const noexcept
+{
+    if (!reader1_.has_next()) return false;
+    if (pairing_ != pairing_mode::files) return true;
+    if (!reader2_.has_next()) return false;
+    return true;
+}
+
+
+
+//-------------------------------------------------------------------
+sequence_record_pair_reader::index_type
+sequence_record_pair_reader::next (sequence_record& rec1,
+                                   sequence_record& rec2)
+{
+    if (!has_next()) return index();
+
+    switch (pairing_) {
+        case pairing_mode::none :
+            // only one sequence per call
+            rec2.clear();
+            return reader1_.next(rec1);
+        case pairing_mode::files :
+            // pair = single sequences from 2 separate files (read in lockstep)
+            reader1_.next(rec1);
+            return reader2_.next(rec2);
+        default :
+        // case pairing_mode::sequences :
+            // pair = 2 consecutive sequences from same file
+            const auto idx = reader1_.index();
+            reader1_.next(rec1);
+            // make sure the index is only increased after the 2nd 'next()'
+            reader1_.index_offset(idx);
+            return reader1_.next(rec2);
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+bool sequence_record_pair_reader::next_chunk (sequence_chunk& chunk,
+                                              std::size_t n)
+{
+    chunk.count_ = 0;
+
+    if (!has_next() || n < 1) return false;
+
+    chunk.pairing_       = pairing_;
+    chunk.withHeaders_   = reader1_.withHeaders_;
+    chunk.withQualities_ = reader1_.withQualities_;
+
+    const auto assign = [] (sequence_chunk::part& part,
+                            sequence_record_reader::chunk_range&& range)
+    {
+        part.block = std::move(range.block);
+        part.pos   = range.first;
+        part.end   = range.last;
+        part.good  = true;
+    };
+
+    switch (pairing_) {
+        case pairing_mode::none : {
+            const auto count = reader1_.count_chunk_records(n);
+            if (count < 1) return false;
+            chunk.index_ = reader1_.index();
+            chunk.count_ = count;
+            assign(chunk.first_, reader1_.take_chunk_records(count));
+            return true;
+        }
+        case pairing_mode::files : {
+            // same number of records from both files
+            auto count = reader1_.count_chunk_records(n);
+            if (count > 0) count = reader2_.count_chunk_records(count);
+            if (count < 1) return false;
+            chunk.index_ = reader2_.index();
+            chunk.count_ = count;
+            assign(chunk.first_,  reader1_.take_chunk_records(count));
+            assign(chunk.second_, reader2_.take_chunk_records(count));
+            return true;
+        }
+        default :
+        // case pairing_mode::sequences :
+            // even number of records; an odd record that ends a block
+            // is kept for the next chunk
+            const auto count = reader1_.count_chunk_records(2*n, 2) & ~std::size_t(1);
+            if (count < 1) return false;
+            const auto idx = reader1_.index();
+            chunk.index_ = idx;
+            chunk.count_ = count / 2;
+            assign(chunk.first_, reader1_.take_chunk_records(count));
+            // one index per pair
+            reader1_.index_offset(idx + count / 2);
+            return true;
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+void sequence_record_pair_reader::index_offset (index_type index)
+{
+    reader1_.index_offset(index);
+    if (pairing_ == pairing_mode::files)
+        reader2_.index_offset(index);
+}
+
+
+
+
 /*************************************************************************//**
  *
  *****************************************************************************/
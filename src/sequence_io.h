@@ -27,12 +27,14 @@
 #define MC_FASTX_READER_H_
 
 #include "sequence_iostream.h"
+#include "sequence_view.h"
 #include "io_error.h"
 
 #include <cstdint>
 #include <fstream>
 #include <memory>
 #include <string>
+#include <vector>
 
 
 namespace mc {
@@ -67,7 +69,9 @@ public:
 
     sequence_reader () : stream_{}, index_{0} {};
 
-    sequence_reader (const std::string& filename);
+    /** @param maxThreads  max. number of threads used for reading
+     *                     (including the calling thread) */
+    sequence_reader (const std::string& filename, unsigned maxThreads = 1);
 
     sequence_reader (const sequence_reader&) = delete;
     sequence_reader& operator = (const sequence_reader&) = delete;
@@ -100,6 +104,10 @@ public:
     /** @brief read next sequence data & header, re-uses external storage */
     index_type next_header_and_data (header_type&, data_type&);
 
+    /** @brief read next header & sequence data as 2-bit packed nucleotides,
+     *         re-uses external storage */
+    index_type next_header_and_data (header_type&, packed_sequence&);
+
     /** @brief skip n sequences */
     void skip (index_type n);
 
@@ -110,7 +118,8 @@ public:
     void index_offset (index_type index) { index_ = index; }
 
 private:
-    void read_next (header_type*, data_type*, qualities_type*);
+    template<class Data>
+    void read_next (header_type*, Data*, qualities_type*);
 
     void skip_next ();
 
@@ -196,6 +205,256 @@ private:
 
 
 
+/*************************************************************************//**
+ *
+ * @brief reference-counted chunk of raw input data;
+ *        record views handed out by 'sequence_record_reader' point into it
+ *
+ *****************************************************************************/
+class sequence_block
+{
+public:
+    using size_type = std::size_t;
+
+    explicit
+    sequence_block (size_type capacity) :
+        data_{new char[capacity]}, size_{0}, capacity_{capacity}
+    {}
+
+    /** @brief makes block with a copy of [first,last) */
+    sequence_block (const char* first, const char* last) :
+        sequence_block(size_type(last - first))
+    {
+        std::copy(first, last, data_.get());
+        size_ = capacity_;
+    }
+
+    size_type size ()     const noexcept { return size_; }
+    size_type capacity () const noexcept { return capacity_; }
+
+    void resize (size_type n) noexcept { size_ = n; }
+
+          char* data ()       noexcept { return data_.get(); }
+    const char* data () const noexcept { return data_.get(); }
+
+private:
+    std::unique_ptr<char[]> data_;
+    size_type size_;
+    size_type capacity_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief views of one FASTA/FASTQ record's header, data and qualities;
+ *        valid as long as the referenced block is alive
+ *
+ *****************************************************************************/
+struct sequence_record
+{
+    using index_type = sequence_reader::index_type;
+    using view_type  = sequence_view<const char*>;
+
+    void clear () noexcept {
+        header    = view_type{};
+        data      = view_type{};
+        qualities = view_type{};
+        block.reset();
+    }
+
+    index_type index = 0;
+    view_type  header;      // meta information (FASTA >, FASTQ @)
+    view_type  data;        // actual sequence data
+    view_type  qualities;   // quality scores (FASTQ)
+    std::shared_ptr<const sequence_block> block;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief file reader for bio-sequences that reads large input blocks
+ *        and parses records in place without copying them;
+ *        headers and qualities can be skipped entirely;
+ *        yields the same records as 'sequence_reader'
+ *        NOT concurrency safe
+ *
+ *****************************************************************************/
+class sequence_record_reader
+{
+public:
+    using index_type = sequence_reader::index_type;
+
+    static constexpr std::size_t default_block_size() noexcept {
+        return std::size_t(1) << 22;
+    }
+
+    sequence_record_reader () = default;
+
+    /** @param maxThreads  max. number of threads used for reading
+     *                     (including the calling thread) */
+    explicit
+    sequence_record_reader (const std::string& filename,
+                            bool withHeaders = true,
+                            bool withQualities = true,
+                            unsigned maxThreads = 1);
+
+    sequence_record_reader (const sequence_record_reader&) = delete;
+    sequence_record_reader& operator = (const sequence_record_reader&) = delete;
+    sequence_record_reader (sequence_record_reader&&) = default;
+    sequence_record_reader& operator = (sequence_record_reader&&) = default;
+
+
+    /** @brief read next record re-using external storage */
+    index_type next (sequence_record&);
+
+    bool has_next () const noexcept { return good_; }
+
+    index_type index () const noexcept { return index_; }
+
+    void index_offset (index_type index) { index_ = index; }
+
+private:
+    friend class sequence_record_pair_reader;
+
+    /** @brief range of complete records that can be parsed independently */
+    struct chunk_range {
+        std::shared_ptr<sequence_block> block;
+        char* first = nullptr;
+        char* last  = nullptr;
+    };
+
+    bool parse_next (sequence_record&);
+    void refill (std::size_t keepFrom);
+    void read_char ();
+
+    /** @brief number of 4-line FASTQ records (max. n) that directly follow
+     *         in the current input block; reads more input if there are
+     *         less than 'minCount' complete records in the current block;
+     *         0 if the input doesn't continue with standard 4-line
+     *         FASTQ records */
+    std::size_t count_chunk_records (std::size_t n, std::size_t minCount = 1);
+
+    /** @brief cut off n records counted by 'count_chunk_records' */
+    chunk_range take_chunk_records (std::size_t n);
+
+    char_istream stream_;
+    std::shared_ptr<sequence_block> block_;
+    std::size_t pos_ = 0;
+    bool eof_ = true;
+    bool good_ = false;
+    char lastChar_ = 0;
+    bool withHeaders_ = true;
+    bool withQualities_ = true;
+    index_type index_ = 0;
+    // line ranges of multi-line sequences
+    std::vector<std::pair<char*,char*>> lines_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief complete records (pairs) cut from the input blocks of
+ *        'sequence_record_pair_reader'; parsing the records of different
+ *        chunks can be done concurrently
+ *        NOT concurrency safe
+ *
+ *****************************************************************************/
+class sequence_chunk
+{
+public:
+    using index_type   = sequence_record_reader::index_type;
+    using pairing_mode = sequence_pair_reader::pairing_mode;
+
+    /** @brief number of records (pairs) left */
+    std::size_t size () const noexcept { return count_; }
+
+    bool empty () const noexcept { return count_ < 1; }
+
+    /** @brief parse next record (pair) re-using external storage;
+     *         returns the same index as 'sequence_record_pair_reader::next' */
+    index_type next (sequence_record&, sequence_record&);
+
+private:
+    friend class sequence_record_pair_reader;
+
+    struct part {
+        std::shared_ptr<sequence_block> block;
+        char* pos = nullptr;
+        char* end = nullptr;
+        bool good = false;
+    };
+
+    void next (part&, sequence_record&, bool withHeaders);
+
+    part first_;
+    part second_;
+    pairing_mode pairing_ = pairing_mode::none;
+    index_type index_ = 0;
+    std::size_t count_ = 0;
+    bool withHeaders_ = true;
+    bool withQualities_ = true;
+    std::vector<std::pair<char*,char*>> lines_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief zero-copy file reader for (pairs of) bio-sequences
+ *        with the same pairing semantics as 'sequence_pair_reader'
+ *        NOT concurrency safe
+ *
+ *****************************************************************************/
+class sequence_record_pair_reader
+{
+public:
+    using pairing_mode = sequence_pair_reader::pairing_mode;
+    using index_type   = sequence_record_reader::index_type;
+
+    /** @brief if filename2 empty : single sequence mode
+     *         if filename1 == filename2 : read consecutive pairs in one file
+     *         else : read from 2 files in lockstep
+     *         headers are only read for the 1st sequence of a pair;
+     *         each file is read by at most 'maxThreads' threads
+     *         (including the calling thread)
+     */
+    sequence_record_pair_reader (const std::string& filename1,
+                                 const std::string& filename2,
+                                 bool withHeaders = true,
+                                 bool withQualities = true,
+                                 unsigned maxThreads = 1);
+
+    sequence_record_pair_reader (const sequence_record_pair_reader&) = delete;
+    sequence_record_pair_reader& operator = (const sequence_record_pair_reader&) = delete;
+
+
+    /** @brief read next record (pair) re-using external storage */
+    index_type next (sequence_record&, sequence_record&);
+
+    /** @brief cut off up to n record (pairs) that can be parsed
+     *         independently (by another thread) from the next input block;
+     *         returns false, if the input does not continue with standard
+     *         4-line FASTQ records; 'next' must be used in this case */
+    bool next_chunk (sequence_chunk&, std::size_t n);
+
+    bool has_next () const noexcept;
+
+    index_type index () const noexcept { return reader1_.index(); }
+
+    void index_offset (index_type index);
+
+private:
+    sequence_record_reader reader1_;
+    sequence_record_reader reader2_;
+    pairing_mode pairing_;
+};
+
+
+
+
 /*************************************************************************//**
  *
  *
@@ -27,11 +27,12 @@
 #define CHAR_ISTREAM_H
 
 #ifndef MC_NO_ZLIB
-#include <zlib.h>
+#include "gzip_stream.h"
 #else
 #include <cstdio>
 #endif
 
+#include <algorithm>
 #include <cctype>
 #include <cstring>
 #include <cstdlib>
@@ -39,6 +40,8 @@
 #include <memory>
 #include <string>
 
+#include "packed_sequence.h"
+
 
 
 namespace mc {
@@ -135,11 +138,11 @@ public:
         data_[oldSize] = c;
     }
 
-    void append(char_type* first, char_type* last) {
+    void append(const char_type* first, const char_type* last) {
         append(first, last - first);
     }
 
-    void append(char_type* first, size_type n) {
+    void append(const char_type* first, size_type n) {
         const auto oldSize = size_;
         resize(oldSize + n);
         memcpy(data_ + oldSize, first, n);
@@ -184,36 +187,39 @@ public:
 
     struct filehandle
     {
-        filehandle() : file_{NULL} {}
+        filehandle() : file_{} {}
         filehandle(filehandle&& other) :
-            file_{other.file_}
+            file_{std::move(other.file_)}
         {
-            other.file_ = NULL;
+            other.file_ = nullptr;
         }
         ~filehandle() {
             if (file_) close();
         }
 
 #ifndef MC_NO_ZLIB
-        gzFile file_;
+        // may decompress on separate thread(s)
+        std::unique_ptr<gzip_reader> file_;
 
-        Status open(const char *filename) {
+        Status open(const char *filename, unsigned maxThreads) {
             if (file_) close();
-            file_ = gzopen(filename, "r");
-            if (file_ == Z_NULL)
+            file_ = std::make_unique<gzip_reader>();
+            if (!file_->open(filename, maxThreads)) {
+                file_ = nullptr;
                 return Status::err;
+            }
             return Status::no_err;
         }
         void close() {
-            gzclose(file_);
+            file_ = nullptr;
         }
         int read(void *buffer, size_t size) {
-            return gzread(file_, buffer, size);
+            return file_->read(buffer, size);
         }
 #else
         FILE* file_;
 
-        Status open(const char *filename) {
+        Status open(const char *filename, unsigned) {
             if (file_) close();
             file_ = fopen(filename, "r");
             if (file_ == NULL)
@@ -263,7 +269,7 @@ public:
         lastChar_{other.lastChar_},
         status_{other.status_}
     {
-        other.filehandle_.file_ = NULL;
+        other.filehandle_.file_ = nullptr;
         other.buf_ = nullptr;
         other.begin_ = 0;
         other.end_ = 0;
@@ -282,8 +288,10 @@ public:
         return *this;
     }
 
-    void open(const char* filename) {
-        status_ = filehandle_.open(filename);
+    /** @param maxThreads  max. number of threads used for reading
+     *                     (including the calling thread) */
+    void open(const char* filename, unsigned maxThreads = 1) {
+        status_ = filehandle_.open(filename, maxThreads);
         buf_ = std::make_unique<unsigned char[]>(bufsize());
         begin_ = 0;
         end_ = 0;
@@ -343,11 +351,16 @@ public:
         append_line_impl(str);
     }
 
+    void append_line(packed_sequence& str) {
+        append_line_impl(str);
+    }
+
 private:
     template<class StringT>
     void append_line_impl(StringT& str)
     {
-        bool gotany = false;
+        // last character of line (before '\n')
+        char lastChar = 0;
         for (;;) {
             if (!validate_buffer()) break;
 
@@ -359,7 +372,7 @@ private:
             // append to str
             str.append((char*)buf_.get() + begin_, lineEnd - begin_);
 
-            gotany = true;
+            if (lineEnd > begin_) lastChar = buf_[lineEnd-1];
 
             // advance buffer begin
             begin_ = lineEnd + 1;
@@ -369,12 +382,37 @@ private:
             }
             // else: line continues
         }
-        if (gotany && str.size() > 0 && str[str.size()-1] == '\r') {
+        if (lastChar == '\r') {
             str.resize(str.size()-1);
         }
     }
 
 public:
+    /** @brief reads up to n characters into external buffer;
+     *         returns number of characters read */
+    std::size_t read(char* dest, std::size_t n) {
+        std::size_t count = 0;
+        // drain internal buffer first
+        if (!buffer_empty()) {
+            count = std::min(n, std::size_t(end_ - begin_));
+            memcpy(dest, buf_.get() + begin_, count);
+            begin_ += count;
+        }
+        while (count < n && status_ == Status::no_err) {
+            const int r = filehandle_.read(dest + count, n - count);
+            if (r == 0) {
+                status_ = Status::eof;
+            }
+            else if (r < 0) {
+                status_ = Status::err;
+            }
+            else {
+                count += r;
+            }
+        }
+        return count;
+    }
+
     void skip_line() {
         for (;;) {
             if (!validate_buffer()) break;
@@ -45,6 +45,8 @@ public:
     using value_type = std::decay_t<decltype(*std::declval<iterator>())>;
 
     //---------------------------------------------------------------
+    sequence_view() noexcept : beg_{}, end_{} {}
+
     explicit
     sequence_view(iterator begin, iterator end) noexcept :
        beg_{begin}, end_{end}
@@ -0,0 +1,235 @@
+/******************************************************************************
+ *
+ * MetaCache - Meta-Genomic Classification Tool
+ *
+ * Copyright (C) 2016-2024 André Müller (muellan@uni-mainz.de)
+ *                       & Robin Kobus  (kobus@uni-mainz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "sketch_io.h"
+#include "io_serialize.h"
+
+#include <limits>
+
+
+namespace mc {
+
+
+//-------------------------------------------------------------------
+// file layout:
+//   magic string, format version, feature size, sketching options
+//   per target:
+//     record marker, name, parent taxid, source filename, source index,
+//     per window: feature count + features,
+//     end-of-target marker
+//   end-of-file marker
+static const std::string sketch_file_magic = "MetaCacheSketches";
+static constexpr std::uint64_t sketch_file_version = 2;
+static constexpr std::uint8_t  target_record_marker = 1;
+static constexpr std::uint8_t  end_of_file_marker = 0;
+static constexpr std::uint32_t end_of_target_marker =
+    std::numeric_limits<std::uint32_t>::max();
+
+
+
+//-------------------------------------------------------------------
+// the length is checked first, so that arbitrary files
+// never cause huge allocations
+static bool
+read_sketch_file_magic(std::istream& is)
+{
+    std::uint64_t n = 0;
+    read_binary(is, n);
+    if (!is.good() || n != sketch_file_magic.size()) return false;
+
+    std::string magic(n, ' ');
+    is.read(&magic[0], n);
+
+    return is.good() && magic == sketch_file_magic;
+}
+
+
+
+//-------------------------------------------------------------------
+sketch_writer::sketch_writer(const std::string& filename,
+                             const sketching_opt& sketching)
+:
+    os_{filename, std::ios::out | std::ios::binary},
+    filename_{filename}
+{
+    if (!os_.good()) {
+        throw file_access_error{"Could not write sketch file '" + filename + "'"};
+    }
+
+    write_binary(os_, sketch_file_magic);
+    write_binary(os_, sketch_file_version);
+    write_binary(os_, std::uint8_t(sizeof(target_sketches::feature)));
+    write_binary(os_, sketching);
+}
+
+
+//-------------------------------------------------------------------
+void sketch_writer::begin_target(const taxonomy::taxon_name& name,
+                                 taxon_id parentTaxid,
+                                 const taxonomy::file_source& source)
+{
+    write_binary(os_, target_record_marker);
+    write_binary(os_, name);
+    write_binary(os_, std::int64_t(parentTaxid));
+    write_binary(os_, source.filename);
+    write_binary(os_, std::uint64_t(source.index));
+}
+
+
+//-------------------------------------------------------------------
+void sketch_writer::add_window(const sketch& sk)
+{
+    write_binary(os_, std::uint32_t(sk.size()));
+    write_binary(os_, sk.data(), sk.size());
+}
+
+
+//-------------------------------------------------------------------
+void sketch_writer::end_target()
+{
+    write_binary(os_, end_of_target_marker);
+
+    if (!os_.good()) {
+        throw file_write_error{"Could not write sketch file '" + filename_ + "'"};
+    }
+}
+
+
+//-------------------------------------------------------------------
+void sketch_writer::finish()
+{
+    write_binary(os_, end_of_file_marker);
+    os_.flush();
+
+    if (!os_.good()) {
+        throw file_write_error{"Could not write sketch file '" + filename_ + "'"};
+    }
+}
+
+
+
+
+//-------------------------------------------------------------------
+sketch_reader::sketch_reader(const std::string& filename) :
+    is_{filename, std::ios::in | std::ios::binary},
+    filename_{filename},
+    sketching_{},
+    hasNext_{false}
+{
+    if (!is_.good()) {
+        throw file_access_error{"Could not read sketch file '" + filename + "'"};
+    }
+
+    const bool validMagic = read_sketch_file_magic(is_);
+
+    std::uint64_t version = 0;
+    std::uint8_t featureSize = 0;
+
+    if (validMagic) {
+        read_binary(is_, version);
+        read_binary(is_, featureSize);
+    }
+
+    if (!validMagic || version != sketch_file_version ||
+        featureSize != sizeof(target_sketches::feature))
+    {
+        throw io_format_error{"Sketch file '" + filename + "' is incompatible "
+                              "with this version of MetaCache"};
+    }
+
+    read_binary(is_, sketching_);
+
+    peek();
+}
+
+
+//-------------------------------------------------------------------
+void sketch_reader::peek()
+{
+    using traits = std::char_traits<char>;
+
+    const auto c = is_.peek();
+    hasNext_ = is_.good() && c == traits::to_int_type(target_record_marker);
+
+    if (!hasNext_ && (!is_.good() || c != traits::to_int_type(end_of_file_marker))) {
+        throw io_format_error{"Sketch file '" + filename_ + "' is truncated"};
+    }
+}
+
+
+//-------------------------------------------------------------------
+void sketch_reader::next(target_sketches& target)
+{
+    target.clear();
+
+    if (!hasNext_) return;
+
+    std::uint8_t marker = 0;
+    std::int64_t parentTaxid = 0;
+    std::uint64_t index = 0;
+
+    read_binary(is_, marker);
+    read_binary(is_, target.name);
+    read_binary(is_, parentTaxid);
+    read_binary(is_, target.source.filename);
+    read_binary(is_, index);
+
+    target.parentTaxid = parentTaxid;
+    target.source.index = index;
+
+    std::uint32_t n = 0;
+    read_binary(is_, n);
+    while (is_.good() && n != end_of_target_marker) {
+        if (n > sketching_.sketchlen) {
+            throw io_format_error{"Sketch file '" + filename_ + "' is corrupted"};
+        }
+        const auto offset = target.features.size();
+        target.features.resize(offset + n);
+        read_binary(is_, target.features.data() + offset, n);
+        target.sizes.push_back(n);
+
+        read_binary(is_, n);
+    }
+
+    if (!is_.good()) {
+        throw io_format_error{"Sketch file '" + filename_ + "' is truncated"};
+    }
+
+    target.source.windows = target.window_count();
+
+    peek();
+}
+
+
+
+
+//-------------------------------------------------------------------
+bool is_sketch_file(const std::string& filename)
+{
+    std::ifstream is{filename, std::ios::in | std::ios::binary};
+    if (!is.good()) return false;
+
+    return read_sketch_file_magic(is);
+}
+
+
+} // namespace mc
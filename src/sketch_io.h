@@ -0,0 +1,164 @@
+/******************************************************************************
+ *
+ * MetaCache - Meta-Genomic Classification Tool
+ *
+ * Copyright (C) 2016-2024 André Müller (muellan@uni-mainz.de)
+ *                       & Robin Kobus  (kobus@uni-mainz.de)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#ifndef MC_SKETCH_IO_H_
+#define MC_SKETCH_IO_H_
+
+#include "config.h"
+#include "io_error.h"
+#include "taxonomy.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+namespace mc {
+
+
+/*************************************************************************//**
+ *
+ * @brief window sketches of one reference target together with
+ *        the target's metadata
+ *
+ *****************************************************************************/
+struct target_sketches
+{
+    using feature     = sketcher::feature_type;
+    using sketch      = sketcher::sketch_type;
+    using file_source = taxonomy::file_source;
+    using size_type   = std::uint32_t;
+
+    void clear() {
+        features.clear();
+        sizes.clear();
+    }
+
+    std::size_t window_count() const noexcept { return sizes.size(); }
+
+    /** @brief calls 'consume(first,last)' for the features of each window */
+    template<class Consumer>
+    void for_each_sketch(Consumer&& consume) const {
+        auto first = features.begin();
+        for (auto n : sizes) {
+            consume(first, first + n);
+            first += n;
+        }
+    }
+
+    taxonomy::taxon_name name;
+    taxon_id parentTaxid = 0;
+    file_source source;
+
+    // features of all windows in window order
+    std::vector<feature> features;
+    // number of features per window
+    std::vector<size_type> sizes;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief writes window sketches of reference targets to a binary file
+ *        that can be used as build input instead of sequence files;
+ *        NOT concurrency safe
+ *
+ *****************************************************************************/
+class sketch_writer
+{
+public:
+    using sketch = target_sketches::sketch;
+
+    sketch_writer(const std::string& filename, const sketching_opt&);
+
+    sketch_writer(const sketch_writer&) = delete;
+    sketch_writer& operator = (const sketch_writer&) = delete;
+
+    /** @brief starts new target record */
+    void begin_target(const taxonomy::taxon_name& name, taxon_id parentTaxid,
+                      const taxonomy::file_source& source);
+
+    /** @brief appends sketch of next window to current target record */
+    void add_window(const sketch&);
+
+    /** @brief finishes current target record */
+    void end_target();
+
+    /**
+     * @brief marks file as complete;
+     *        files that are not finished are rejected by readers
+     */
+    void finish();
+
+private:
+    std::ofstream os_;
+    std::string filename_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief reads target sketches from file written by 'sketch_writer';
+ *        NOT concurrency safe
+ *
+ *****************************************************************************/
+class sketch_reader
+{
+public:
+    explicit
+    sketch_reader(const std::string& filename);
+
+    /** @brief sketching parameters that were used for the file's sketches */
+    const sketching_opt& sketching() const noexcept { return sketching_; }
+
+    bool has_next() const noexcept { return hasNext_; }
+
+    /** @brief read next target re-using external storage */
+    void next(target_sketches&);
+
+private:
+    void peek();
+
+    std::ifstream is_;
+    std::string filename_;
+    sketching_opt sketching_;
+    bool hasNext_;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @return true, if file was written by 'sketch_writer'
+ *
+ *****************************************************************************/
+bool is_sketch_file(const std::string& filename);
+
+
+
+} // namespace mc
+
+
+#endif
@@ -24,15 +24,18 @@
 #define MC_TAXONOMY_H_
 
 
-#include "io_serialize.h"
 #include "config.h"
+#include "io_error.h"
+#include "io_serialize.h"
 
 #include <algorithm>
 #include <array>
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <future>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <mutex>
 #include <shared_mutex>
@@ -44,6 +47,9 @@
 namespace mc {
 
 
+class ranked_lineages_cache;
+
+
 /*************************************************************************//**
  *
  * @brief id-based taxonomy
@@ -262,6 +268,7 @@ public:
      ************************************************************/
     class taxon {
         friend class taxonomy;
+        friend class mc::ranked_lineages_cache;
     public:
         //-----------------------------------------------------
         using rank_type = taxonomy::rank;
@@ -354,6 +361,10 @@ public:
         taxon_name name_;
         file_source source_;
         rank_type rank_;
+        // position in taxonomy's dense index (not serialized)
+        mutable std::uint32_t index_ = std::numeric_limits<std::uint32_t>::max();
+        // row in dense lineage cache (not serialized)
+        mutable std::uint32_t cacheIndex_ = std::numeric_limits<std::uint32_t>::max();
     };
 
     struct taxon_hash
@@ -391,11 +402,18 @@ public:
 
 
     //-------------------------------------------------------------------
+    /** @brief pre-allocates space for bulk insertion of non-target taxa */
+    void reserve_non_target_taxa(size_type n) {
+        taxa_.reserve(n);
+    }
+    //-----------------------------------------------------
     void clear_non_target_taxa() {
+        denseValid_ = false;
         taxa_.clear();
     }
     //-----------------------------------------------------
     void clear_target_taxa() {
+        denseValid_ = false;
         targets_.clear();
     }
     //-----------------------------------------------------
@@ -408,6 +426,7 @@ public:
      * @brief erase all taxa with rank > r (except taxon with id = 0)
      */
     void erase_above(rank r) {
+        denseValid_ = false;
         auto i = taxa_.begin();
         while (i != taxa_.end()) {
             if (i->rank() > r) {
@@ -441,6 +460,7 @@ public:
     {
         if (taxonId == none_id()) return {taxa_.end(),false};
 
+        denseValid_ = false;
         return taxa_.emplace(
             taxonId, parentId, std::move(taxonName),
             rank, std::move(source));
@@ -456,6 +476,7 @@ public:
 
         const rank rank = rank::Sequence;
 
+        denseValid_ = false;
         return targets_.emplace(
             taxonId, parentId, std::move(taxonName),
             rank, std::move(source));
@@ -465,11 +486,13 @@ public:
     //---------------------------------------------------------------
     const_iterator
     insert_non_target_taxon(const taxon& t) {
+        denseValid_ = false;
         return taxa_.insert(t).first;
     }
     //-----------------------------------------------------
     const_iterator
     insert_non_target_taxon(taxon&& t) {
+        denseValid_ = false;
         return taxa_.insert(std::move(t)).first;
     }
 
@@ -478,6 +501,7 @@ public:
     const_iterator
     insert_or_replace_non_target_taxon(const taxon& t)
     {
+        denseValid_ = false;
         auto i = taxa_.find(taxon{t.id()});
         if (i != taxa_.end()) {
             taxa_.erase(i);
@@ -490,6 +514,7 @@ public:
     const_iterator
     insert_or_replace_non_target_taxon(taxon&& t)
     {
+        denseValid_ = false;
         auto i = taxa_.find(taxon{t.id()});
         if (i != taxa_.end()) {
             taxa_.erase(i);
@@ -506,6 +531,7 @@ public:
         if (id == none_id()) return false;
         auto i = targets_.find(taxon{id});
         if (i == targets_.end()) return false;
+        denseValid_ = false;
         const_cast<taxon*>(&*i)->parent_ = parent;
         return true;
     }
@@ -517,6 +543,7 @@ public:
         if (id == none_id()) return false;
         auto i = taxa_.find(taxon{id});
         if (i == taxa_.end()) return false;
+        denseValid_ = false;
         const_cast<taxon*>(&*i)->rank_ = rank;
         return true;
     }
@@ -532,6 +559,11 @@ public:
      */
     const taxon*
     get_non_target_taxon(taxon_id id) const {
+        if (denseValid_ && !idToIndex_.empty()) {
+            if (id < 0 || std::uint64_t(id) >= idToIndex_.size()) return nullptr;
+            const auto i = idToIndex_[id];
+            return i != no_index ? dense_[i] : nullptr;
+        }
         auto i = find_non_target_taxon(id);
         if (i == taxa_.end()) return nullptr;
         return &(*i);
@@ -563,6 +595,14 @@ public:
     const taxon*
     next_ranked_ancestor(taxon_id id) const
     {
+        if (denseValid_) {
+            const taxon* tax = get_non_target_taxon(id);
+            if (!tax) return nullptr;
+            for (auto i = tax->index_; i != no_index; i = parents_[i]) {
+                if (ranks_[i] != rank::none) return dense_[i];
+            }
+            return nullptr;
+        }
         while (id != none_id()) {
             auto it = taxa_.find(taxon{id});
             if (it == taxa_.end()) break;
@@ -586,6 +626,15 @@ public:
             lin[static_cast<int>(tax.rank())] = &(tax);
         }
 
+        if (in_dense_index(tax)) {
+            for (auto i = parents_[tax.index_]; i != no_index; i = parents_[i]) {
+                if (ranks_[i] != rank::none) {
+                    lin[static_cast<int>(ranks_[i])] = dense_[i];
+                }
+            }
+            return lin;
+        }
+
         taxon_id id = tax.parent_id();
 
         while (id != none_id()) {
@@ -603,6 +652,11 @@ public:
     ranked_lineage
     make_ranks(taxon_id id) const
     {
+        if (denseValid_) {
+            const taxon* tax = is_target(id) ? get_target_taxon(id)
+                                             : get_non_target_taxon(id);
+            return tax ? make_ranks(*tax) : ranked_lineage{};
+        }
         if (is_target(id)) {
             auto it = targets_.find(taxon{id});
             if (it == targets_.end())
@@ -626,7 +680,14 @@ public:
         auto lin = full_lineage{};
 
         if (tax.rank() != rank::none) {
-            lin[static_cast<int>(tax.rank())] = &(tax);
+            lin.push_back(&tax);
+        }
+
+        if (in_dense_index(tax)) {
+            for (auto i = parents_[tax.index_]; i != no_index; i = parents_[i]) {
+                lin.push_back(dense_[i]);
+            }
+            return lin;
         }
 
         taxon_id id = tax.parent_id();
@@ -701,6 +762,87 @@ public:
     }
 
 
+    //---------------------------------------------------------------
+    /**
+     * @brief  renumbers all taxa into a dense contiguous index and stores
+     *         parent indices and ranks as flat arrays;
+     *         lineages and id lookups use these arrays (instead of hashing)
+     *         until the taxonomy is modified;
+     *         must not run concurrently with any other member function
+     */
+    void update_dense_index() const
+    {
+        if (denseValid_) return;
+
+        const auto numTaxa = taxa_.size();
+        const auto numTotal = numTaxa + targets_.size();
+
+        dense_.clear();
+        dense_.reserve(numTotal);
+        for (const auto& t : taxa_) dense_.push_back(&t);
+
+        // target ids are usually -1...-n, so targets can be placed in id order
+        targetsById_ = true;
+        for (const auto& t : targets_) {
+            if (-(t.id() + 1) >= taxon_id(targets_.size())) {
+                targetsById_ = false;
+                break;
+            }
+        }
+        dense_.resize(numTotal, nullptr);
+        if (targetsById_) {
+            for (const auto& t : targets_) dense_[numTaxa - (t.id() + 1)] = &t;
+        } else {
+            std::size_t i = numTaxa;
+            for (const auto& t : targets_) dense_[i++] = &t;
+        }
+
+        // direct id -> index table, unless ids are very sparse
+        taxon_id maxId = 0;
+        for (const auto& t : taxa_) maxId = std::max(maxId, t.id());
+        idToIndex_.clear();
+        if (std::uint64_t(maxId) < 16 * std::uint64_t(numTaxa) + 1024) {
+            idToIndex_.resize(maxId + 1, index_type(no_index));
+        }
+
+        for (index_type i = 0; i < numTotal; ++i) {
+            dense_[i]->index_ = i;
+            if (i < numTaxa && !idToIndex_.empty() && dense_[i]->id() >= 0) {
+                idToIndex_[dense_[i]->id()] = i;
+            }
+        }
+
+        ranks_.resize(numTotal);
+        parents_.resize(numTotal);
+        for (index_type i = 0; i < numTotal; ++i) {
+            const taxon& t = *dense_[i];
+            ranks_[i] = t.rank();
+            parents_[i] = no_index;
+            // self-references mark the root
+            if (t.parent_ != none_id() && t.parent_ != t.id()) {
+                auto p = taxa_.find(taxon{t.parent_});
+                if (p != taxa_.end()) parents_[i] = p->index_;
+            }
+        }
+
+        denseValid_ = true;
+    }
+
+    //---------------------------------------------------------------
+    /**
+     * @return position of taxon in the dense index or 'dense_index_size()'
+     *         if the dense index is outdated or doesn't contain the taxon;
+     *         positions are only valid until the taxonomy is modified
+     */
+    std::size_t dense_index(const taxon& tax) const noexcept {
+        return in_dense_index(tax) ? tax.index_ : dense_index_size();
+    }
+
+    std::size_t dense_index_size() const noexcept {
+        return denseValid_ ? dense_.size() : 0;
+    }
+
+
     //---------------------------------------------------------------
     friend void
     read_binary(std::istream& is, taxonomy& tax)
@@ -733,10 +875,260 @@ public:
     }
 
 
+    /****************************************************************
+     * @brief compact binary snapshot of all taxa:
+     *        dense arrays (one entry per taxon) + string pool;
+     *        all sections are 8-byte aligned, so a snapshot can be
+     *        used directly from a memory-mapped file
+     */
+    friend void
+    write_snapshot(std::ostream& os, const taxonomy& tax)
+    {
+        std::vector<const taxon*> all;
+        all.reserve(tax.taxa_.size() + tax.targets_.size());
+        for (const auto& t : tax.taxa_)    all.push_back(&t);
+        for (const auto& t : tax.targets_) all.push_back(&t);
+
+        const std::uint64_t n = all.size();
+
+        std::vector<std::int64_t> ids (n);
+        std::vector<std::int64_t> parents (n);
+        std::vector<std::uint64_t> windows (n);
+        std::vector<std::uint64_t> indices (n);
+        std::vector<std::uint64_t> nameOffs (n+1);
+        std::vector<std::uint32_t> fileIdx (n);
+        std::vector<std::uint8_t> ranks (n);
+
+        // source filenames are shared by many targets => stored only once
+        std::unordered_map<std::string,std::uint32_t> fileIds;
+        std::vector<const std::string*> files;
+
+        std::string pool;
+        for (std::uint64_t i = 0; i < n; ++i) {
+            const taxon& t = *all[i];
+            ids[i]      = t.id();
+            parents[i]  = t.parent_id();
+            windows[i]  = t.source().windows;
+            indices[i]  = t.source().index;
+            ranks[i]    = std::uint8_t(t.rank());
+            nameOffs[i] = pool.size();
+            pool += t.name();
+
+            auto f = fileIds.emplace(t.source().filename, std::uint32_t(files.size()));
+            if (f.second) files.push_back(&f.first->first);
+            fileIdx[i] = f.first->second;
+        }
+        nameOffs[n] = pool.size();
+
+        std::vector<std::uint64_t> fileOffs (files.size()+1);
+        for (std::size_t i = 0; i < files.size(); ++i) {
+            fileOffs[i] = pool.size();
+            pool += *files[i];
+        }
+        fileOffs[files.size()] = pool.size();
+
+        const auto layout = snapshot_layout{n, files.size(), pool.size()};
+
+        os.write(snapshot_layout::magic(), 8);
+        write_binary(os, std::uint64_t(layout.size));
+        write_binary(os, n);
+        write_binary(os, std::uint64_t(files.size()));
+        write_binary(os, std::uint64_t(pool.size()));
+
+        const auto write_section = [&] (const auto& v, std::uint64_t bytes) {
+            write_binary(os, v.data(), v.size());
+            const char pad[8] = {0};
+            os.write(pad, bytes - v.size() * sizeof(v[0]));
+        };
+        write_section(ids,      layout.parents  - layout.ids);
+        write_section(parents,  layout.windows  - layout.parents);
+        write_section(windows,  layout.indices  - layout.windows);
+        write_section(indices,  layout.nameOffs - layout.indices);
+        write_section(nameOffs, layout.fileOffs - layout.nameOffs);
+        write_section(fileOffs, layout.fileIdx  - layout.fileOffs);
+        write_section(fileIdx,  layout.ranks    - layout.fileIdx);
+        write_section(ranks,    layout.pool     - layout.ranks);
+        write_section(pool,     layout.size     - layout.pool);
+    }
+
+    //-----------------------------------------------------
+    /**
+     * @brief replaces all taxa with the content of a snapshot
+     *        that starts at 8-byte aligned address 'beg'
+     * @return false, if memory range doesn't contain a valid snapshot
+     */
+    friend bool
+    read_snapshot(const char* beg, const char* end, taxonomy& tax)
+    {
+        tax.clear_all();
+
+        if (std::size_t(end - beg) < snapshot_layout::header_size ||
+            std::memcmp(beg, snapshot_layout::magic(), 8) != 0)
+        {
+            return false;
+        }
+        const auto header = reinterpret_cast<const std::uint64_t*>(beg);
+        const std::uint64_t n = header[2];
+        const std::uint64_t numFiles = header[3];
+        const std::uint64_t poolSize = header[4];
+
+        // corrupted counts must not overflow the layout computation
+        const std::uint64_t maxSize = std::uint64_t(end - beg);
+        if (n > maxSize / 8 || numFiles > maxSize / 8 || poolSize > maxSize) {
+            return false;
+        }
+        const auto layout = snapshot_layout{n, numFiles, poolSize};
+
+        if (header[1] != layout.size ||
+            std::uint64_t(end - beg) < layout.size)
+        {
+            return false;
+        }
+
+        const auto ids      = reinterpret_cast<const std::int64_t*>(beg + layout.ids);
+        const auto parents  = reinterpret_cast<const std::int64_t*>(beg + layout.parents);
+        const auto windows  = reinterpret_cast<const std::uint64_t*>(beg + layout.windows);
+        const auto indices  = reinterpret_cast<const std::uint64_t*>(beg + layout.indices);
+        const auto nameOffs = reinterpret_cast<const std::uint64_t*>(beg + layout.nameOffs);
+        const auto fileOffs = reinterpret_cast<const std::uint64_t*>(beg + layout.fileOffs);
+        const auto fileIdx  = reinterpret_cast<const std::uint32_t*>(beg + layout.fileIdx);
+        const auto ranks    = reinterpret_cast<const std::uint8_t*>(beg + layout.ranks);
+        const char* pool    = beg + layout.pool;
+
+        // validate offsets
+        if (nameOffs[0] != 0 || nameOffs[n] > poolSize) return false;
+        if (fileOffs[0] != nameOffs[n] || fileOffs[numFiles] > poolSize) return false;
+        for (std::uint64_t i = 0; i < n; ++i) {
+            if (nameOffs[i] > nameOffs[i+1] || fileIdx[i] >= numFiles ||
+                ranks[i] > std::uint8_t(rank::none))
+            {
+                return false;
+            }
+        }
+        for (std::uint64_t i = 0; i < numFiles; ++i) {
+            if (fileOffs[i] > fileOffs[i+1]) return false;
+        }
+
+        std::size_t numTargets = 0;
+        for (std::uint64_t i = 0; i < n; ++i) {
+            if (is_target(ids[i])) ++numTargets;
+        }
+        tax.taxa_.reserve(n - numTargets);
+        tax.targets_.reserve(numTargets);
+
+        for (std::uint64_t i = 0; i < n; ++i) {
+            const auto f = fileIdx[i];
+            auto t = taxon{ids[i], parents[i],
+                std::string(pool + nameOffs[i], pool + nameOffs[i+1]),
+                rank(ranks[i]),
+                file_source{
+                    std::string(pool + fileOffs[f], pool + fileOffs[f+1]),
+                    indices[i], windows[i]} };
+
+            if (t.is_target())
+                tax.targets_.insert(std::move(t));
+            else
+                tax.taxa_.insert(std::move(t));
+        }
+        return true;
+    }
+
+    //-----------------------------------------------------
+    /**
+     * @brief reads snapshot from stream
+     * @return false, if stream doesn't contain a valid snapshot
+     */
+    friend bool
+    read_snapshot(std::istream& is, taxonomy& tax)
+    {
+        // 8-byte aligned buffer
+        constexpr std::size_t hs = snapshot_layout::header_size / 8;
+        std::vector<std::uint64_t> buf (hs);
+        is.read(reinterpret_cast<char*>(buf.data()), hs * 8);
+        if (!is.good()) return false;
+
+        const std::uint64_t size = buf[1];
+        if (size < hs * 8 || size % 8 != 0) return false;
+
+        buf.resize(size / 8);
+        is.read(reinterpret_cast<char*>(buf.data() + hs), size - hs * 8);
+        if (!is.good()) return false;
+
+        const char* beg = reinterpret_cast<const char*>(buf.data());
+        return read_snapshot(beg, beg + size, tax);
+    }
+
+
 private:
+    //---------------------------------------------------------------
+    /// @brief byte offsets of snapshot sections
+    struct snapshot_layout
+    {
+        static const char* magic() noexcept { return "MCTAXSN1"; }
+        static constexpr std::uint64_t header_size = 5 * 8;
+
+        snapshot_layout(std::uint64_t n, std::uint64_t numFiles,
+                        std::uint64_t poolSize) noexcept
+        {
+            const auto aligned = [](std::uint64_t x) { return (x + 7) & ~std::uint64_t(7); };
+            ids      = header_size;
+            parents  = ids      + 8 * n;
+            windows  = parents  + 8 * n;
+            indices  = windows  + 8 * n;
+            nameOffs = indices  + 8 * n;
+            fileOffs = nameOffs + 8 * (n + 1);
+            fileIdx  = fileOffs + 8 * (numFiles + 1);
+            ranks    = fileIdx  + aligned(4 * n);
+            pool     = ranks    + aligned(n);
+            size     = pool     + aligned(poolSize);
+        }
+
+        std::uint64_t ids;
+        std::uint64_t parents;
+        std::uint64_t windows;
+        std::uint64_t indices;
+        std::uint64_t nameOffs;
+        std::uint64_t fileOffs;
+        std::uint64_t fileIdx;
+        std::uint64_t ranks;
+        std::uint64_t pool;
+        std::uint64_t size;
+    };
+
+    //---------------------------------------------------------------
+    using index_type = std::uint32_t;
+
+    static constexpr index_type no_index = std::numeric_limits<index_type>::max();
+
+    //---------------------------------------------------------------
+    bool in_dense_index(const taxon& tax) const noexcept {
+        return denseValid_ && tax.index_ < dense_.size() && dense_[tax.index_] == &tax;
+    }
+
+    //---------------------------------------------------------------
+    /** @pre dense index must be valid */
+    const taxon*
+    get_target_taxon(taxon_id id) const {
+        if (targetsById_) {
+            const auto i = -(id + 1);
+            if (i < 0 || i >= taxon_id(targets_.size())) return nullptr;
+            return dense_[taxa_.size() + i];
+        }
+        auto it = targets_.find(taxon{id});
+        return it != targets_.end() ? &(*it) : nullptr;
+    }
+
     //---------------------------------------------------------------
     taxon_store taxa_;
     taxon_store targets_;
+
+    // dense index (struct of arrays); rebuilt by 'update_dense_index'
+    mutable std::vector<const taxon*> dense_;
+    mutable std::vector<index_type> parents_;
+    mutable std::vector<rank> ranks_;
+    mutable std::vector<index_type> idToIndex_;
+    mutable bool targetsById_ = false;
+    mutable bool denseValid_ = false;
 };
 
 
@@ -746,6 +1138,9 @@ private:
  *
  * @brief ranked lineage cache
  *
+ * @details lineages are stored densely; each cached taxon knows its row,
+ *          so lookups (and ranked LCA queries) don't need any hashing
+ *
  *****************************************************************************/
 class ranked_lineages_cache
 {
@@ -765,7 +1160,7 @@ public:
     ranked_lineages_cache(const taxonomy& taxa)
     :
         taxa_(taxa), highestRank_{taxon_rank::Sequence},
-        empty_{nullptr}, lins_{},
+        empty_{nullptr}, owners_{}, lins_{},
         outdated_(true)
     {}
 
@@ -775,6 +1170,8 @@ public:
 
     ranked_lineages_cache(ranked_lineages_cache&& src):
         taxa_(src.taxa_), highestRank_{src.highestRank_},
+        empty_{nullptr},
+        owners_{std::move(src.owners_)},
         lins_{std::move(src.lins_)},
         outdated_(src.outdated_)
     {}
@@ -798,6 +1195,23 @@ public:
     }
 
 private:
+    //---------------------------------------------------------------
+    static constexpr std::uint32_t no_row = std::numeric_limits<std::uint32_t>::max();
+
+    //---------------------------------------------------------------
+    /** @return row of taxon or no_row */
+    std::uint32_t find(const taxon& tax) const noexcept {
+        const auto row = tax.cacheIndex_;
+        return (row < owners_.size() && owners_[row] == &tax) ? row : no_row;
+    }
+
+    //---------------------------------------------------------------
+    void emplace(const taxon& tax, const ranked_lineage& lin) {
+        tax.cacheIndex_ = std::uint32_t(owners_.size());
+        owners_.push_back(&tax);
+        lins_.push_back(lin);
+    }
+
     //---------------------------------------------------------------
     /**
      * @brief  insert lineage for all its ranked ancestors
@@ -811,8 +1225,8 @@ private:
             const taxon* tax = lin[i];
             if (tax) {
                 // insert if not present
-                if (lins_.find(tax) == lins_.end())
-                    lins_.emplace(tax, lin);
+                if (find(*tax) == no_row)
+                    emplace(*tax, lin);
                 // remove this rank for next ancestor
                 lin[i] = nullptr;
             }
@@ -825,9 +1239,9 @@ private:
      */
     void
     insert(const taxon& tax) {
-        auto i = lins_.find(&tax);
-        if (i == lins_.end()) {
-            auto lin = lins_.emplace(&tax, taxa_.make_ranks(tax)).first->second;
+        if (find(tax) == no_row) {
+            const auto lin = taxa_.make_ranks(tax);
+            emplace(tax, lin);
             insert_lineage(lin);
         }
     }
@@ -864,6 +1278,7 @@ public:
 
     //---------------------------------------------------------------
     void clear() {
+        owners_.clear();
         lins_.clear();
         outdated_ = true;
     }
@@ -898,9 +1313,8 @@ public:
     const ranked_lineage&
     operator [](const taxon& tax) const {
         assert(outdated_ == false);
-        auto i = lins_.find(&tax);
-        if (i != lins_.end()) return i->second;
-        return empty_;
+        const auto row = find(tax);
+        return row != no_row ? lins_[row] : empty_;
     }
 
 
@@ -909,7 +1323,8 @@ private:
     const taxonomy& taxa_;
     taxon_rank highestRank_;
     ranked_lineage empty_;
-    mutable std::unordered_map<const taxon*,ranked_lineage> lins_;
+    std::vector<const taxon*> owners_;
+    std::vector<ranked_lineage> lins_;
     bool outdated_;
 };
 
@@ -1214,6 +1629,15 @@ public:
         return targetLineages_[tgt];
     }
 
+    //---------------------------------------------------------------
+    std::size_t dense_index(const taxon& tax) const noexcept {
+        return taxa_.dense_index(tax);
+    }
+    //-----------------------------------------------------
+    std::size_t dense_index_size() const noexcept {
+        return taxa_.dense_index_size();
+    }
+
     //---------------------------------------------------------------
     const taxon*
     parent(const taxon* tax) const noexcept {
@@ -1380,6 +1804,7 @@ public:
         for (auto& t : tax.non_target_taxa()) {
             taxa_.insert_or_replace_non_target_taxon(std::move(t));
         }
+        taxa_.update_dense_index();
         // re-initialize ranks cache
         targetLineages_.reset();
         taxonLineages_.init_from_targets(targetLineages_.lineages());
@@ -1388,6 +1813,8 @@ public:
 
     //---------------------------------------------------------------
     void initialize_caches() {
+        taxa_.update_dense_index();
+
         auto thread = std::async(std::launch::async, [&] {
             for (const auto& t : target_taxa()) {
                 name2tax_.insert({t.name(), &t});
@@ -1411,20 +1838,32 @@ public:
      * @details if target count is 0, the prvious target count will be used
      */
     void update_cached_lineages(taxon_rank rank, std::uint64_t targetCount = 0) const {
+        taxa_.update_dense_index();
         taxonLineages_.update(rank);
         targetLineages_.update(targetCount);
     }
 
 
+    /// @throws file_read_error if stream contains no valid taxonomy snapshot
     friend void
     read_binary(std::istream& is, taxonomy_cache& taxonomyCache) {
         taxonomyCache.clear();
-        read_binary(is, taxonomyCache.taxa_);
+        if (!read_snapshot(is, taxonomyCache.taxa_)) {
+            taxonomyCache.clear();
+            throw file_read_error{"Invalid taxonomy snapshot"};
+        }
     }
 
     friend void
     write_binary(std::ostream& os, const taxonomy_cache& taxonomyCache) {
-        write_binary(os, taxonomyCache.taxa_);
+        write_snapshot(os, taxonomyCache.taxa_);
+    }
+
+    /// @brief reads per-taxon serialization of older database versions
+    friend void
+    read_legacy_binary(std::istream& is, taxonomy_cache& taxonomyCache) {
+        taxonomyCache.clear();
+        read_binary(is, taxonomyCache.taxa_);
     }
 
 private:
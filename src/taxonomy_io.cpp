@@ -23,11 +23,21 @@
 
 #include "cmdline_utility.h"
 #include "filesys_utility.h"
+#include "io_error.h"
 #include "taxonomy_io.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <future>
+#include <iterator>
 #include <limits>
 #include <sstream>
+#include <unordered_map>
+
+#include <unistd.h> // getpid
 
 
 namespace mc {
@@ -53,46 +63,307 @@ forward(std::istream& is, char c)
 
 
 
-//-------------------------------------------------------------------
+/*************************************************************************//**
+ *
+ * @brief splits memory range into at most 'n' chunks ending at line breaks
+ *
+ * @return chunk boundaries (n+1 pointers at most)
+ *
+ *****************************************************************************/
+std::vector<const char*>
+line_aligned_chunks(const char* beg, const char* end, std::size_t n)
+{
+    std::vector<const char*> bounds {beg};
+    const std::size_t size = end - beg;
+
+    for (std::size_t i = 1; i < n; ++i) {
+        const char* p = std::max(beg + size * i / n, bounds.back());
+        p = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!p) break;
+        if (++p > bounds.back() && p < end) bounds.push_back(p);
+    }
+    bounds.push_back(end);
+
+    return bounds;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief parses all lines in a memory range in parallel;
+ *        'parse' must return true for lines that yield a record;
+ *        large ranges are processed in consecutive segments after each of
+ *        which 'progress' is called with the fraction of processed bytes
+ *
+ * @return records in file order
+ *
+ *****************************************************************************/
+template<class Record, class LineParser, class ProgressHandler>
+std::vector<Record>
+parse_lines_in_parallel(const char* beg, const char* end, unsigned maxThreads,
+                        LineParser parse, ProgressHandler progress)
+{
+    const std::size_t size = end - beg;
+
+    // at least 4 MB per thread
+    const std::size_t numThreads = std::max(std::size_t(1), std::min(
+        std::size_t(maxThreads), size / (std::size_t(1) << 22)));
+
+    // 256 MB per thread and segment
+    const std::size_t segmentSize = numThreads << 28;
+
+    std::vector<Record> records;
+    std::vector<std::vector<Record>> chunkRecords;
+
+    for (const char* segBeg = beg; segBeg < end; ) {
+        const char* segEnd = end;
+        if (std::size_t(end - segBeg) > segmentSize) {
+            segEnd = static_cast<const char*>(std::memchr(
+                         segBeg + segmentSize, '\n', end - segBeg - segmentSize));
+            segEnd = segEnd ? segEnd + 1 : end;
+        }
+
+        const auto bounds = line_aligned_chunks(segBeg, segEnd, numThreads);
+        const std::size_t numChunks = bounds.size() - 1;
+
+        chunkRecords.resize(numChunks);
+
+        const auto parseChunk = [&] (std::size_t c) {
+            Record rec;
+            const char* chunkEnd = bounds[c+1];
+            for (const char* p = bounds[c]; p < chunkEnd; ) {
+                const char* eol = static_cast<const char*>(
+                                  std::memchr(p, '\n', chunkEnd - p));
+                if (!eol) eol = chunkEnd;
+                if (parse(p, eol, rec)) chunkRecords[c].push_back(std::move(rec));
+                p = eol + 1;
+            }
+        };
+
+        std::vector<std::future<void>> threads;
+        for (std::size_t c = 1; c < numChunks; ++c) {
+            threads.emplace_back(std::async(std::launch::async, parseChunk, c));
+        }
+        parseChunk(0);
+        for (auto& t : threads) t.get();
+
+        std::size_t numRecords = records.size();
+        for (const auto& recs : chunkRecords) numRecords += recs.size();
+
+        records.reserve(numRecords);
+        for (auto& recs : chunkRecords) {
+            std::move(recs.begin(), recs.end(), std::back_inserter(records));
+            recs.clear();
+        }
+
+        segBeg = segEnd;
+        progress((segEnd - beg) / float(size));
+    }
+    return records;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief text file contents; regular files are memory-mapped,
+ *        other files (pipes, process substitutions, ...) are read
+ *        sequentially into memory
+ *
+ *****************************************************************************/
+class text_file
+{
+public:
+    text_file() = default;
+
+    /** @throws file_access_error if file could not be opened */
+    explicit
+    text_file(const string& filename)
+    {
+        // pipes must not be opened twice, so check type beforehand
+        if (is_regular_file(filename)) {
+            mapped_ = mapped_file{filename};
+            return;
+        }
+        std::ifstream is {filename, std::ios::in | std::ios::binary};
+        if (!is.good()) {
+            throw file_access_error{"Could not open file '" + filename + "'"};
+        }
+        buffer_.assign(std::istreambuf_iterator<char>{is},
+                       std::istreambuf_iterator<char>{});
+    }
+
+    const char* begin() const noexcept {
+        return mapped_.begin() ? mapped_.begin() : buffer_.data();
+    }
+    const char* end() const noexcept {
+        return mapped_.begin() ? mapped_.end() : buffer_.data() + buffer_.size();
+    }
+
+    std::size_t size() const noexcept { return std::size_t(end() - begin()); }
+
+private:
+    mapped_file mapped_;
+    string buffer_;
+};
+
+//---------------------------------------------------------
+template<class Record, class LineParser>
+std::vector<Record>
+parse_lines_in_parallel(const text_file& file, unsigned maxThreads,
+                        LineParser parse)
+{
+    return parse_lines_in_parallel<Record>(file.begin(), file.end(), maxThreads,
+                                           parse, [](float) {});
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief field parsing helpers (same behavior as stream extraction)
+ *
+ *****************************************************************************/
+inline void
+skip_space(const char*& p, const char* end) noexcept
+{
+    while (p < end && std::isspace(static_cast<unsigned char>(*p))) ++p;
+}
+
+//---------------------------------------------------------
+inline bool
+parse_taxon_id(const char*& p, const char* end, taxon_id& id) noexcept
+{
+    skip_space(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    if (p >= end || !std::isdigit(static_cast<unsigned char>(*p))) return false;
+
+    id = 0;
+    while (p < end && std::isdigit(static_cast<unsigned char>(*p))) {
+        id = id * 10 + (*p - '0');
+        ++p;
+    }
+    if (negative) id = -id;
+    return true;
+}
+
+//---------------------------------------------------------
+inline void
+skip_chars(const char*& p, const char* end, std::size_t n) noexcept
+{
+    p = (std::size_t(end - p) > n) ? p + n : end;
+}
+
+//---------------------------------------------------------
+/** @brief moves p behind next occurrence of c or to end */
+inline void
+forward(const char*& p, const char* end, char c) noexcept
+{
+    const char* q = static_cast<const char*>(std::memchr(p, c, end - p));
+    p = q ? q + 1 : end;
+}
+
+//---------------------------------------------------------
+/** @return characters up to (excluding) c; moves p behind c */
+inline std::string
+read_until(const char*& p, const char* end, char c)
+{
+    const char* q = static_cast<const char*>(std::memchr(p, c, end - p));
+    if (!q) q = end;
+    std::string s {p, q};
+    p = (q < end) ? q + 1 : end;
+    return s;
+}
+
+
+
+/*************************************************************************//**
+ *
+ * @brief records of NCBI taxonomy dump files
+ *
+ *****************************************************************************/
+struct taxon_name_record {
+    taxon_id id = 0;
+    string name;
+};
+
+struct taxon_merge_record {
+    taxon_id oldId = 0;
+    taxon_id newId = 0;
+};
+
+struct taxon_node_record {
+    taxon_id id = 0;
+    taxon_id parentId = 0;
+    taxonomy::rank rank = taxonomy::rank::none;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief reads taxonomic tree + names from NCBI's taxnonomy dump files
+ *
+ *****************************************************************************/
 taxonomy
-make_taxonomic_hierarchy(const string& taxNodesFile,
-                         const string& taxNamesFile,
-                         const string& mergeTaxFile,
-                         info_level infoLvl)
+parse_taxonomic_hierarchy(const string& taxNodesFile,
+                          const string& taxNamesFile,
+                          const string& mergeTaxFile,
+                          info_level infoLvl,
+                          unsigned maxThreads)
 {
     using taxon_id = taxonomy::taxon_id;
 
     const bool showInfo = infoLvl != info_level::silent;
 
+    // all files are memory-mapped (or read if not regular files),
+    // split into line-aligned chunks and parsed in parallel;
+    // the taxonomy is then built in bulk
+    const auto open_file = [] (const string& filename, text_file& file) {
+        try {
+            file = text_file{filename};
+            return true;
+        }
+        catch (file_access_error&) {
+            return false;
+        }
+    };
+
     // read scientific taxon names
     // failure to do so will not be fatal
-    auto taxonNames = std::map<taxon_id,string>{};
+    auto taxonNames = std::unordered_map<taxon_id,string>{};
 
-    std::ifstream is{taxNamesFile};
+    text_file namesFile;
     // each line consists of taxonId, name, uniqueName and category
     // field terminator is "\t|\t"
     // row terminator is "\t|\n"
-    if (is.good()) {
+    if (open_file(taxNamesFile, namesFile)) {
         if (showInfo) cout << "Reading taxon names ... " << std::flush;
-        taxon_id lastId = 0;
-        taxon_id taxonId = 0;
-        string name;
-        string category;
-
-        while (is.good()) {
-            is >> taxonId;
-            if (taxonId != lastId) {
-                is.ignore(3);
-                getline(is, name, '\t');
-                is.ignore(2);
-                forward(is, '|');
-                is >> category;
-                if (category.find("scientific") != string::npos) {
-                    lastId = taxonId;
-                    taxonNames.insert({taxonId,std::move(name)});
-                }
-            }
-            forward(is, '\n');
+
+        auto names = parse_lines_in_parallel<taxon_name_record>(
+            namesFile, maxThreads,
+            [] (const char* p, const char* end, taxon_name_record& rec) {
+                if (!parse_taxon_id(p, end, rec.id)) return false;
+                skip_chars(p, end, 3);
+                rec.name = read_until(p, end, '\t');
+                skip_chars(p, end, 2);
+                forward(p, end, '|');
+                skip_space(p, end);
+                const char* cat = p;
+                while (p < end && !std::isspace(static_cast<unsigned char>(*p))) ++p;
+                return string{cat, p}.find("scientific") != string::npos;
+            });
+        namesFile = text_file{};
+
+        // first scientific name of a taxon is used
+        taxonNames.reserve(names.size());
+        for (auto& rec : names) {
+            taxonNames.emplace(rec.id, std::move(rec.name));
         }
         if (showInfo) cout << "done." << std::endl;
     }
@@ -101,57 +372,66 @@ make_taxonomic_hierarchy(const string& taxNodesFile,
              << taxNamesFile
              << "; continuing with ids only." << std::endl;
     }
-    is.close();
 
     // read merged taxa
     taxonomy tax;
-    auto mergedTaxa = std::map<taxon_id,taxon_id>{};
+    auto mergedTaxa = std::unordered_map<taxon_id,taxon_id>{};
 
-    is.open(mergeTaxFile);
+    text_file mergeFile;
     // each line consists of oldId and newId
     // field terminator is "\t|\t"
     // row terminator is "\t|\n"
-    if (is.good()) {
+    if (open_file(mergeTaxFile, mergeFile)) {
         if (showInfo) cout << "Reading taxonomic node mergers ... " << std::flush;
-        taxon_id oldId;
-        taxon_id newId;
-
-        while (is.good()) {
-            is >> oldId;
-            forward(is, '|');
-            is >> newId;
-            forward(is, '\n');
-            mergedTaxa.insert({oldId,newId});
 
-            tax.emplace_non_target_taxon(oldId, newId, "", "");
+        auto merges = parse_lines_in_parallel<taxon_merge_record>(
+            mergeFile, maxThreads,
+            [] (const char* p, const char* end, taxon_merge_record& rec) {
+                if (!parse_taxon_id(p, end, rec.oldId)) return false;
+                forward(p, end, '|');
+                return parse_taxon_id(p, end, rec.newId);
+            });
+        mergeFile = text_file{};
+
+        mergedTaxa.reserve(merges.size());
+        tax.reserve_non_target_taxa(merges.size());
+        for (const auto& rec : merges) {
+            mergedTaxa.emplace(rec.oldId, rec.newId);
+            tax.emplace_non_target_taxon(rec.oldId, rec.newId, "", "");
         }
         if (showInfo) cout << "done." << std::endl;
     }
-    is.close();
 
     // read taxonomic structure
-    is.open(taxNodesFile);
+    text_file nodesFile;
     // each line consists of taxonId, parentId, rank, ...
     // field terminator is "\t|\t"
     // row terminator is "\t|\n"
-    if (is.good()) {
+    if (open_file(taxNodesFile, nodesFile)) {
         if (showInfo) cout << "Reading taxonomic tree ... " << std::flush;
-        taxon_id taxonId;
-        taxon_id parentId;
-        string rankName;
-
-        while (is.good()) {
-            is >> taxonId;
-            is.ignore(3);
-            is >> parentId;
-            is.ignore(3);
-            getline(is, rankName, '\t');
-            forward(is, '\n');
+
+        auto nodes = parse_lines_in_parallel<taxon_node_record>(
+            nodesFile, maxThreads,
+            [] (const char* p, const char* end, taxon_node_record& rec) {
+                if (!parse_taxon_id(p, end, rec.id)) return false;
+                skip_chars(p, end, 3);
+                if (!parse_taxon_id(p, end, rec.parentId)) return false;
+                skip_chars(p, end, 3);
+                rec.rank = taxonomy::rank_from_name(read_until(p, end, '\t'));
+                return true;
+            });
+        nodesFile = text_file{};
+
+        tax.reserve_non_target_taxa(tax.non_target_taxon_count() + nodes.size());
+
+        for (const auto& rec : nodes) {
+            taxon_id taxonId = rec.id;
+            taxon_id parentId = rec.parentId;
 
             // get taxon name
             auto it = taxonNames.find(taxonId);
             auto taxonName = (it != taxonNames.end())
-                             ? it->second : string("--");
+                             ? std::move(it->second) : string("--");
             if (taxonName.empty()) {
                 taxonName = "<" + std::to_string(taxonId) + ">";
             }
@@ -163,7 +443,8 @@ make_taxonomic_hierarchy(const string& taxNodesFile,
             mi = mergedTaxa.find(parentId);
             if (mi != mergedTaxa.end()) parentId = mi->second;
 
-            tax.emplace_non_target_taxon(taxonId, parentId, taxonName, rankName);
+            tax.emplace_non_target_taxon(taxonId, parentId,
+                                         std::move(taxonName), rec.rank);
         }
         if (showInfo) cout << tax.non_target_taxon_count() << " taxa read." << std::endl;
     }
@@ -184,6 +465,125 @@ make_taxonomic_hierarchy(const string& taxNodesFile,
 
 
 
+/*************************************************************************//**
+ *
+ * @brief identifies the dump files from which a taxonomy snapshot was made
+ *        by their sizes and modification times
+ *
+ *****************************************************************************/
+struct taxonomy_snapshot_source
+{
+    static const char* magic() noexcept { return "MCTAXSRC"; }
+
+    static constexpr int num_files = 3;
+    // magic + (size, time) of each file
+    static constexpr std::size_t header_size = 8 + num_files * 16;
+
+    explicit
+    taxonomy_snapshot_source(const string& taxNodesFile,
+                             const string& taxNamesFile,
+                             const string& mergeTaxFile)
+    {
+        const string* files[num_files] {&taxNodesFile, &taxNamesFile, &mergeTaxFile};
+        for (int i = 0; i < num_files; ++i) {
+            stats[2*i]   = std::int64_t(file_size(*files[i]));
+            stats[2*i+1] = file_modification_time(*files[i]);
+        }
+    }
+
+    bool matches(const char* beg, const char* end) const noexcept {
+        return std::size_t(end - beg) >= header_size &&
+               std::memcmp(beg, magic(), 8) == 0 &&
+               std::memcmp(beg + 8, stats, sizeof(stats)) == 0;
+    }
+
+    void write(std::ostream& os) const {
+        os.write(magic(), 8);
+        write_binary(os, stats, 2 * num_files);
+    }
+
+    std::int64_t stats[2 * num_files];
+};
+
+
+
+//-------------------------------------------------------------------
+taxonomy
+make_taxonomic_hierarchy(const string& taxNodesFile,
+                         const string& taxNamesFile,
+                         const string& mergeTaxFile,
+                         const string& snapshotFile,
+                         info_level infoLvl,
+                         unsigned maxThreads)
+{
+    const bool showInfo = infoLvl != info_level::silent;
+
+    // pipes, process substitutions, ... can only be read once and
+    // have no meaningful size or modification time
+    const auto not_regular = [] (const string& filename) {
+        return file_modification_time(filename) != 0 &&
+               !is_regular_file(filename);
+    };
+
+    if (snapshotFile.empty() || not_regular(taxNodesFile) ||
+        not_regular(taxNamesFile) || not_regular(mergeTaxFile))
+    {
+        return parse_taxonomic_hierarchy(taxNodesFile, taxNamesFile,
+                                         mergeTaxFile, infoLvl, maxThreads);
+    }
+
+    const auto source = taxonomy_snapshot_source{
+                            taxNodesFile, taxNamesFile, mergeTaxFile};
+
+    // re-use snapshot if dump files haven't changed since it was made
+    taxonomy tax;
+    try {
+        const auto file = mapped_file{snapshotFile};
+
+        if (source.matches(file.begin(), file.end()) &&
+            read_snapshot(file.begin() + source.header_size, file.end(), tax))
+        {
+            if (showInfo) {
+                cout << "Read taxonomy snapshot " << snapshotFile << ": "
+                     << tax.non_target_taxon_count() << " taxa." << std::endl;
+            }
+            return tax;
+        }
+    }
+    catch (file_access_error&) {}
+
+    tax = parse_taxonomic_hierarchy(taxNodesFile, taxNamesFile,
+                                    mergeTaxFile, infoLvl, maxThreads);
+
+    if (tax.non_target_taxon_count() < 1) return tax;
+
+    // write to temporary file first, so that concurrent runs
+    // never see incomplete snapshots; failure to do so is not fatal
+    const string tmpFile = snapshotFile + ".tmp" + std::to_string(::getpid());
+    {
+        std::ofstream os{tmpFile, std::ios::out | std::ios::binary};
+        if (os.good()) {
+            source.write(os);
+            write_snapshot(os, tax);
+        }
+        if (!os.good()) {
+            os.close();
+            std::remove(tmpFile.c_str());
+            return tax;
+        }
+    }
+    if (std::rename(tmpFile.c_str(), snapshotFile.c_str()) != 0) {
+        std::remove(tmpFile.c_str());
+    }
+    else if (showInfo) {
+        cout << "Taxonomy snapshot written to " << snapshotFile << std::endl;
+    }
+
+    return tax;
+}
+
+
+
 //-------------------------------------------------------------------
 void read_sequence_to_taxon_id_mapping(const string& mappingFile,
                                        std::map<string,taxon_id>& map,
@@ -315,4 +715,131 @@ make_sequence_to_taxon_id_map(const std::vector<string>& localMappingFilenames,
 
 
 
+
+/*************************************************************************//**
+ *
+ * @brief lookup of whitespace-delimited tokens in a sorted list of strings
+ *        without creating temporary strings
+ *
+ *****************************************************************************/
+class sorted_accession_lookup
+{
+public:
+    explicit
+    sorted_accession_lookup(const std::vector<string>& accessions) noexcept :
+        acc_(accessions)
+    {}
+
+    static constexpr std::size_t npos = std::size_t(-1);
+
+    /** @return index of exact match or npos */
+    std::size_t
+    find(const char* beg, const char* end) const noexcept {
+        const std::size_t n = end - beg;
+        if (n < 1) return npos;
+        auto i = std::lower_bound(acc_.begin(), acc_.end(), n,
+            [&](const string& a, std::size_t) {
+                return a.compare(0, string::npos, beg, n) < 0;
+            });
+        if (i == acc_.end() || i->compare(0, string::npos, beg, n) != 0) {
+            return npos;
+        }
+        return std::size_t(i - acc_.begin());
+    }
+
+    /** @return index of nearest greater entry that has the token as prefix
+     *          (e.g. accession.version for accession) or npos
+     *          (same as taxonomy_cache::taxon_with_similar_name) */
+    std::size_t
+    find_similar(const char* beg, const char* end) const noexcept {
+        const std::size_t n = end - beg;
+        if (n < 1) return npos;
+        auto i = std::upper_bound(acc_.begin(), acc_.end(), n,
+            [&](std::size_t, const string& a) {
+                return a.compare(0, string::npos, beg, n) > 0;
+            });
+        if (i == acc_.end() || i->compare(0, n, beg, n) != 0) return npos;
+        return std::size_t(i - acc_.begin());
+    }
+
+private:
+    const std::vector<string>& acc_;
+};
+
+
+
+//-------------------------------------------------------------------
+std::vector<accession_taxon_match>
+read_accession_to_taxon_id_mapping(const string& mappingFile,
+                                   const std::vector<string>& accessions,
+                                   info_level infoLvl,
+                                   unsigned maxThreads)
+{
+    const bool showInfo = infoLvl != info_level::silent;
+
+    if (accessions.empty()) return {};
+
+    text_file file;
+    try {
+        file = text_file{mappingFile};
+    }
+    catch (file_access_error&) {
+        return {};
+    }
+
+    if (showInfo) {
+        cout << "Try to map sequences to taxa using '" << mappingFile
+             << "' (" << std::max(std::size_t(1), file.size()/(1024*1024))
+             << " MB)" << std::endl;
+    }
+
+    // skip header
+    const char* beg = static_cast<const char*>(
+                      std::memchr(file.begin(), '\n', file.size()));
+    if (!beg) return {};
+    ++beg;
+
+    const bool showProgress = showInfo && file.size() > 100000000;
+    if (showProgress) show_progress_indicator(cout, 0);
+
+    const sorted_accession_lookup lookup {accessions};
+
+    const auto next_token = [] (const char*& p, const char* end) {
+        skip_space(p, end);
+        const char* tokBeg = p;
+        while (p < end && !std::isspace(static_cast<unsigned char>(*p))) ++p;
+        return tokBeg;
+    };
+
+    // each line consists of accession, accession.version, taxid [, gi];
+    // only rows that match one of the given accessions are kept
+    auto matches = parse_lines_in_parallel<accession_taxon_match>(
+        beg, file.end(), maxThreads,
+        [&] (const char* p, const char* end, accession_taxon_match& m) {
+            const char* acc = next_token(p, end);
+            const char* accEnd = p;
+            const char* accver = next_token(p, end);
+            const char* accverEnd = p;
+            if (!parse_taxon_id(p, end, m.taxonId)) return false;
+            const char* gi = next_token(p, end);
+            const char* giEnd = p;
+
+            // accession.version is the default
+            m.index = lookup.find(accver, accverEnd);
+            if (m.index == lookup.npos) {
+                m.index = lookup.find_similar(acc, accEnd);
+                if (m.index == lookup.npos) m.index = lookup.find(gi, giEnd);
+            }
+            return m.index != lookup.npos;
+        },
+        [&] (float done) {
+            if (showProgress) show_progress_indicator(cout, done);
+        });
+
+    if (showProgress) clear_current_line(cout);
+
+    return matches;
+}
+
+
 } // namespace mc
@@ -39,12 +39,21 @@ namespace mc {
  *
  * @brief reads taxonomic tree + names from NCBI's taxnonomy files
  *
+ * @param snapshotFile  binary taxonomy snapshot that is used instead of the
+ *                      dump files if they haven't changed since it was made;
+ *                      otherwise the dump files are parsed and a new snapshot
+ *                      is written (if possible); empty: no snapshot;
+ *                      not used if a dump file is not a regular file
+ * @param maxThreads    maximum number of threads used for parsing
+ *
  *****************************************************************************/
 taxonomy
 make_taxonomic_hierarchy(const std::string& taxNodesFile,
                          const std::string& taxNamesFile = "",
                          const std::string& mergeTaxFile = "",
-                         info_level info = info_level::moderate);
+                         const std::string& snapshotFile = "",
+                         info_level info = info_level::moderate,
+                         unsigned maxThreads = 1);
 
 
 
@@ -80,6 +89,43 @@ make_sequence_to_taxon_id_map(const std::vector<std::string>& mappingFilenames,
                               info_level infoLvl);
 
 
+
+/*************************************************************************//**
+ *
+ * @brief row of an accession to taxon id mapping file that matched
+ *        an accession of interest
+ *
+ *****************************************************************************/
+struct accession_taxon_match
+{
+    /// index into list of accessions of interest
+    std::size_t index = 0;
+    taxonomy::taxon_id taxonId = 0;
+};
+
+
+
+/*************************************************************************//**
+ *
+ * @brief Reads an NCBI "*.accession2taxid" file with lines in the format
+ *            accession  accession.version  taxid  gi
+ *        The file is memory-mapped (or read, if it is not a regular file)
+ *        and parsed by at most 'maxThreads' threads; only rows
+ *        that match one of the given (sorted!) accessions are kept.
+ *        Rows are matched by accession.version, then by accession
+ *        (as prefix of an accession of interest) and finally by gi.
+ *
+ * @return matching rows in file order
+ *
+ *****************************************************************************/
+std::vector<accession_taxon_match>
+read_accession_to_taxon_id_mapping(
+    const std::string& mappingFile,
+    const std::vector<std::string>& accessions,
+    info_level info = info_level::moderate,
+    unsigned maxThreads = 1);
+
+
 } // namespace mc
 
 
@@ -26,7 +26,10 @@
 
 #define MC_VERSION 20250220
 
-#define MC_DB_VERSION 20200820
+#define MC_DB_VERSION 20261018
+
+// last database version with per-taxon serialization of the taxonomy
+#define MC_DB_VERSION_PER_TAXON 20200820
 
 #define MC_VERSION_STRING "2.5.0"
 
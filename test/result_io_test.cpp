@@ -0,0 +1,255 @@
+
+#include "../src/result_io.h"
+#include "../src/database_query.h"
+#include "../src/io_error.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+using namespace mc;
+
+
+//-------------------------------------------------------------------
+/// @brief writes a few queries with and without candidates
+std::vector<query_result>
+write_test_results(std::ostream& os, const result_file_properties& props)
+{
+    using view_type = sequence_query::view_type;
+
+    const taxonomy_cache taxonomy;
+
+    // sequence-level taxa have negative ids
+    const std::vector<taxon> taxa {
+        taxon{-1, 562, "NC_000913.3", taxon_rank::Sequence},
+        taxon{-2, 562, "NC_002695.2", taxon_rank::Sequence},
+        taxon{-300000, 1280, "NC_007795.1", taxon_rank::Sequence}
+    };
+
+    const std::vector<std::string> headers {
+        "read1 some description", "read2", "", "read4/1"
+    };
+
+    std::vector<query_result> expected;
+
+    write_result_file_header(os, props);
+
+    print_buffer buf;
+    for (std::size_t i = 0; i < headers.size(); ++i) {
+        const auto& header = headers[i];
+        const auto qid = query_id(1000 * i + 1);
+        const auto query = sequence_query{qid,
+            view_type{header.data(), header.data() + header.size()}};
+
+        // query #i has i candidates (the last one without hits)
+        std::vector<match_candidate> cands;
+        for (std::size_t j = 0; j < i; ++j) {
+            const auto hits = match_candidate::count_type(j + 1 < i ? 100 - j : 0);
+            match_candidate c{&taxa[j % taxa.size()], hits};
+            c.tgt = target_id(j);
+            c.pos = window_range{window_id(10 * j), window_id(10 * j + i)};
+            cands.push_back(c);
+        }
+        const taxon* cls = cands.empty() ? nullptr : cands.front().tax;
+
+        append_query_result(buf, query, cls,
+                            span<const match_candidate>{cands}, taxonomy,
+                            props.candidateRank);
+
+        query_result res;
+        res.id = qid;
+        res.header = header.substr(0, header.find(' '));
+        res.taxid = cls ? cls->id() : taxonomy::none_id();
+        res.rank = cls ? cls->rank() : taxon_rank::none;
+        for (const auto& c : cands) {
+            if (c.hits < 1) break;
+            res.candidates.push_back(
+                result_candidate{c.tax->id(), c.tgt, c.hits, c.pos});
+        }
+        expected.push_back(std::move(res));
+    }
+    os.write(buf.data(), buf.size());
+
+    write_result_file_footer(os);
+
+    return expected;
+}
+
+
+
+//-------------------------------------------------------------------
+std::vector<query_result>
+read_test_results(const std::string& filename)
+{
+    std::vector<query_result> results;
+    result_reader reader{filename};
+    while (reader.has_next()) {
+        results.emplace_back();
+        reader.next(results.back());
+    }
+    return results;
+}
+
+
+
+//-------------------------------------------------------------------
+void result_file_check_round_trip(const std::string& filename)
+{
+    result_file_properties props;
+    props.candidateRank = taxon_rank::Sequence;
+    props.sketching.kmerlen = 16;
+    props.sketching.sketchlen = 16;
+    props.sketching.winlen = 127;
+    props.sketching.winstride = 112;
+
+    std::vector<query_result> expected;
+    {
+        std::ofstream os {filename, std::ios::binary};
+        expected = write_test_results(os, props);
+    }
+
+    if (!is_result_file(filename)) {
+        throw std::runtime_error{"result file not recognized"};
+    }
+
+    result_reader reader{filename};
+    const auto& p = reader.properties();
+    if (p.candidateRank != props.candidateRank ||
+        p.sketching.kmerlen != props.sketching.kmerlen ||
+        p.sketching.winlen != props.sketching.winlen ||
+        p.sketching.winstride != props.sketching.winstride)
+    {
+        throw std::runtime_error{"file properties inconsistent after reading"};
+    }
+
+    const auto results = read_test_results(filename);
+
+    if (results.size() != expected.size()) {
+        throw std::runtime_error{"number of results inconsistent after reading"};
+    }
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const auto& res = results[i];
+        const auto& exp = expected[i];
+        if (res.id != exp.id || res.header != exp.header ||
+            res.taxid != exp.taxid || res.rank != exp.rank ||
+            res.candidates.size() != exp.candidates.size())
+        {
+            throw std::runtime_error{"query result inconsistent after reading"};
+        }
+        for (std::size_t j = 0; j < res.candidates.size(); ++j) {
+            const auto& c = res.candidates[j];
+            const auto& e = exp.candidates[j];
+            if (c.taxid != e.taxid || c.tgt != e.tgt || c.hits != e.hits ||
+                c.pos.beg != e.pos.beg || c.pos.end != e.pos.end)
+            {
+                throw std::runtime_error{"candidate inconsistent after reading"};
+            }
+        }
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+bool result_file_rejected(const std::string& filename)
+{
+    try {
+        read_test_results(filename);
+    }
+    catch (io_format_error&) {
+        return true;
+    }
+    return false;
+}
+
+
+
+//-------------------------------------------------------------------
+void result_file_check_damaged_input(const std::string& filename)
+{
+    std::string content;
+    {
+        std::ifstream is {filename, std::ios::binary};
+        content.assign(std::istreambuf_iterator<char>{is},
+                       std::istreambuf_iterator<char>{});
+    }
+
+    const std::string damaged = filename + ".damaged";
+
+    // every proper prefix of a result file must be rejected
+    for (std::size_t n = 0; n < content.size(); ++n) {
+        {
+            std::ofstream os {damaged, std::ios::binary};
+            os.write(content.data(), n);
+        }
+        if (is_result_file(damaged) && !result_file_rejected(damaged)) {
+            std::remove(damaged.c_str());
+            throw std::runtime_error{
+                "truncated result file with " + std::to_string(n) +
+                " of " + std::to_string(content.size()) + " bytes not rejected"};
+        }
+    }
+
+    // wrong magic string
+    {
+        auto corrupted = content;
+        corrupted[8] = 'X';
+        std::ofstream os {damaged, std::ios::binary};
+        os.write(corrupted.data(), corrupted.size());
+    }
+    if (is_result_file(damaged) || !result_file_rejected(damaged)) {
+        std::remove(damaged.c_str());
+        throw std::runtime_error{"result file with wrong magic not rejected"};
+    }
+
+    // huge magic string length
+    {
+        auto corrupted = content;
+        corrupted[7] = char(0x7f);
+        std::ofstream os {damaged, std::ios::binary};
+        os.write(corrupted.data(), corrupted.size());
+    }
+    if (is_result_file(damaged) || !result_file_rejected(damaged)) {
+        std::remove(damaged.c_str());
+        throw std::runtime_error{"result file with wrong magic length not rejected"};
+    }
+
+    // trailing garbage instead of end-of-file marker
+    {
+        std::ofstream os {damaged, std::ios::binary};
+        os.write(content.data(), content.size() - 1);
+        os.put('X');
+    }
+    if (!result_file_rejected(damaged)) {
+        std::remove(damaged.c_str());
+        throw std::runtime_error{"result file with garbage at end not rejected"};
+    }
+
+    std::remove(damaged.c_str());
+}
+
+
+
+//-------------------------------------------------------------------
+int main()
+{
+    const std::string filename = "test.results";
+    try {
+        result_file_check_round_trip(filename);
+        result_file_check_damaged_input(filename);
+        std::remove(filename.c_str());
+
+        std::cout << "result file tests passed" << std::endl;
+        return 0;
+    }
+    catch (std::exception& e) {
+        std::remove(filename.c_str());
+        std::cout << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+}
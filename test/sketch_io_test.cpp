@@ -0,0 +1,238 @@
+
+#include "../src/sketch_io.h"
+#include "../src/io_error.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+using namespace mc;
+
+
+//-------------------------------------------------------------------
+struct test_target
+{
+    taxonomy::taxon_name name;
+    taxon_id parentTaxid = 0;
+    taxonomy::file_source source;
+    std::vector<sketch_writer::sketch> windows;
+};
+
+
+
+//-------------------------------------------------------------------
+std::vector<test_target>
+make_test_targets(const sketching_opt& sketching, std::size_t seed = 0)
+{
+    std::mt19937_64 urng{seed};
+    std::uniform_int_distribution<target_sketches::feature> featureDistr;
+    std::uniform_int_distribution<std::size_t> sizeDistr{0, sketching.sketchlen};
+
+    std::vector<test_target> targets(5);
+    for (std::size_t i = 0; i < targets.size(); ++i) {
+        auto& tgt = targets[i];
+        tgt.name = "NC_00000" + std::to_string(i) + ".1";
+        tgt.parentTaxid = taxon_id(1000 + i);
+        tgt.source = taxonomy::file_source{"ref" + std::to_string(i % 2) + ".fa", i};
+        // last target has no windows
+        const std::size_t numWindows = i + 1 < targets.size() ? 10 * i + 1 : 0;
+        for (std::size_t w = 0; w < numWindows; ++w) {
+            sketch_writer::sketch sk(sizeDistr(urng));
+            for (auto& f : sk) f = featureDistr(urng);
+            tgt.windows.push_back(std::move(sk));
+        }
+    }
+    return targets;
+}
+
+
+
+//-------------------------------------------------------------------
+void write_test_targets(const std::string& filename,
+                        const sketching_opt& sketching,
+                        const std::vector<test_target>& targets)
+{
+    sketch_writer writer{filename, sketching};
+    for (const auto& tgt : targets) {
+        writer.begin_target(tgt.name, tgt.parentTaxid, tgt.source);
+        for (const auto& sk : tgt.windows) writer.add_window(sk);
+        writer.end_target();
+    }
+    writer.finish();
+}
+
+
+
+//-------------------------------------------------------------------
+std::vector<target_sketches>
+read_test_targets(const std::string& filename)
+{
+    std::vector<target_sketches> targets;
+    sketch_reader reader{filename};
+    while (reader.has_next()) {
+        targets.emplace_back();
+        reader.next(targets.back());
+    }
+    return targets;
+}
+
+
+
+//-------------------------------------------------------------------
+void sketch_file_check_round_trip(const std::string& filename)
+{
+    sketching_opt sketching;
+    sketching.kmerlen = 16;
+    sketching.sketchlen = 16;
+    sketching.winlen = 127;
+    sketching.winstride = 112;
+
+    const auto expected = make_test_targets(sketching);
+    write_test_targets(filename, sketching, expected);
+
+    if (!is_sketch_file(filename)) {
+        throw std::runtime_error{"sketch file not recognized"};
+    }
+
+    sketch_reader reader{filename};
+    const auto& sk = reader.sketching();
+    if (sk.kmerlen != sketching.kmerlen || sk.sketchlen != sketching.sketchlen ||
+        sk.winlen != sketching.winlen || sk.winstride != sketching.winstride)
+    {
+        throw std::runtime_error{"sketching options inconsistent after reading"};
+    }
+
+    const auto targets = read_test_targets(filename);
+
+    if (targets.size() != expected.size()) {
+        throw std::runtime_error{"number of targets inconsistent after reading"};
+    }
+    for (std::size_t i = 0; i < targets.size(); ++i) {
+        const auto& tgt = targets[i];
+        const auto& exp = expected[i];
+        if (tgt.name != exp.name || tgt.parentTaxid != exp.parentTaxid ||
+            tgt.source.filename != exp.source.filename ||
+            tgt.source.index != exp.source.index ||
+            tgt.source.windows != exp.windows.size() ||
+            tgt.window_count() != exp.windows.size())
+        {
+            throw std::runtime_error{"target metadata inconsistent after reading"};
+        }
+        std::size_t w = 0;
+        tgt.for_each_sketch([&] (auto first, auto last) {
+            if (!std::equal(first, last, exp.windows[w].begin(),
+                                         exp.windows[w].end()))
+            {
+                throw std::runtime_error{"sketch inconsistent after reading"};
+            }
+            ++w;
+        });
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+bool sketch_file_rejected(const std::string& filename)
+{
+    try {
+        read_test_targets(filename);
+    }
+    catch (io_format_error&) {
+        return true;
+    }
+    return false;
+}
+
+
+
+//-------------------------------------------------------------------
+void sketch_file_check_damaged_input(const std::string& filename)
+{
+    std::string content;
+    {
+        std::ifstream is {filename, std::ios::binary};
+        content.assign(std::istreambuf_iterator<char>{is},
+                       std::istreambuf_iterator<char>{});
+    }
+
+    const std::string damaged = filename + ".damaged";
+
+    // every proper prefix of a sketch file must be rejected
+    for (std::size_t n = 0; n < content.size(); ++n) {
+        {
+            std::ofstream os {damaged, std::ios::binary};
+            os.write(content.data(), n);
+        }
+        if (is_sketch_file(damaged) && !sketch_file_rejected(damaged)) {
+            std::remove(damaged.c_str());
+            throw std::runtime_error{
+                "truncated sketch file with " + std::to_string(n) +
+                " of " + std::to_string(content.size()) + " bytes not rejected"};
+        }
+    }
+
+    // wrong magic string
+    {
+        auto corrupted = content;
+        corrupted[8] = 'X';
+        std::ofstream os {damaged, std::ios::binary};
+        os.write(corrupted.data(), corrupted.size());
+    }
+    if (is_sketch_file(damaged) || !sketch_file_rejected(damaged)) {
+        std::remove(damaged.c_str());
+        throw std::runtime_error{"sketch file with wrong magic not rejected"};
+    }
+
+    // huge magic string length
+    {
+        auto corrupted = content;
+        corrupted[7] = char(0x7f);
+        std::ofstream os {damaged, std::ios::binary};
+        os.write(corrupted.data(), corrupted.size());
+    }
+    if (is_sketch_file(damaged) || !sketch_file_rejected(damaged)) {
+        std::remove(damaged.c_str());
+        throw std::runtime_error{"sketch file with wrong magic length not rejected"};
+    }
+
+    // trailing garbage instead of end-of-file marker
+    {
+        std::ofstream os {damaged, std::ios::binary};
+        os.write(content.data(), content.size() - 1);
+        os.put('X');
+    }
+    if (!sketch_file_rejected(damaged)) {
+        std::remove(damaged.c_str());
+        throw std::runtime_error{"sketch file with garbage at end not rejected"};
+    }
+
+    std::remove(damaged.c_str());
+}
+
+
+
+//-------------------------------------------------------------------
+int main()
+{
+    const std::string filename = "test.sketches";
+    try {
+        sketch_file_check_round_trip(filename);
+        sketch_file_check_damaged_input(filename);
+        std::remove(filename.c_str());
+
+        std::cout << "sketch file tests passed" << std::endl;
+        return 0;
+    }
+    catch (std::exception& e) {
+        std::remove(filename.c_str());
+        std::cout << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,186 @@
+
+#include "../src/taxonomy.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+
+using namespace mc;
+
+
+//-------------------------------------------------------------------
+taxonomy make_test_taxonomy()
+{
+    using rank = taxonomy::rank;
+    using file_source = taxonomy::file_source;
+
+    taxonomy tax;
+    tax.emplace_non_target_taxon(1, 1, "root", rank::root);
+    tax.emplace_non_target_taxon(2, 1, "Bacteria", rank::Domain);
+    tax.emplace_non_target_taxon(561, 2, "Escherichia", rank::Genus);
+    tax.emplace_non_target_taxon(562, 561, "Escherichia coli", rank::Species);
+    tax.emplace_non_target_taxon(1280, 2, "Staphylococcus aureus", rank::Species);
+    // taxon without name
+    tax.emplace_non_target_taxon(10, 2, "", rank::none);
+
+    tax.emplace_target_taxon(-1, 562, "NC_000913.3", file_source{"ecoli.fa", 0, 40000});
+    tax.emplace_target_taxon(-2, 562, "NC_002695.2", file_source{"ecoli.fa", 1, 50000});
+    tax.emplace_target_taxon(-3, 1280, "NC_007795.1", file_source{"saureus.fa", 0, 25000});
+    // target without source file
+    tax.emplace_target_taxon(-4, 1280, "NC_007796.1");
+    return tax;
+}
+
+
+
+//-------------------------------------------------------------------
+using taxon_tuple = std::tuple<taxon_id,taxon_id,std::string,int,
+                               std::string,std::uint64_t,std::uint64_t>;
+
+std::vector<taxon_tuple>
+taxa_of(const taxonomy& tax)
+{
+    std::vector<taxon_tuple> all;
+    const auto add = [&] (const taxonomy::taxon& t) {
+        all.emplace_back(t.id(), t.parent_id(), t.name(), int(t.rank()),
+                         t.source().filename,
+                         std::uint64_t(t.source().index),
+                         std::uint64_t(t.source().windows));
+    };
+    for (const auto& t : tax.non_target_taxa()) add(t);
+    for (const auto& t : tax.target_taxa())     add(t);
+    std::sort(all.begin(), all.end());
+    return all;
+}
+
+
+
+//-------------------------------------------------------------------
+std::string snapshot_of(const taxonomy& tax)
+{
+    std::ostringstream os;
+    write_snapshot(os, tax);
+    return os.str();
+}
+
+
+
+//-------------------------------------------------------------------
+bool snapshot_rejected(const std::string& snapshot)
+{
+    // memory-mapped snapshots are 8-byte aligned
+    std::vector<std::uint64_t> buf ((snapshot.size() + 7) / 8);
+    if (!snapshot.empty()) std::memcpy(buf.data(), snapshot.data(), snapshot.size());
+    const char* beg = reinterpret_cast<const char*>(buf.data());
+
+    taxonomy tax;
+    const bool mapped = read_snapshot(beg, beg + snapshot.size(), tax);
+
+    std::istringstream is {snapshot};
+    taxonomy tax2;
+    const bool streamed = read_snapshot(is, tax2);
+
+    return !mapped && !streamed;
+}
+
+
+
+//-------------------------------------------------------------------
+void taxonomy_snapshot_check_round_trip()
+{
+    const auto tax = make_test_taxonomy();
+    const auto snapshot = snapshot_of(tax);
+
+    if (snapshot.size() % 8 != 0) {
+        throw std::runtime_error{"snapshot size is not a multiple of 8"};
+    }
+
+    std::istringstream is {snapshot};
+    taxonomy tax2;
+    if (!read_snapshot(is, tax2)) {
+        throw std::runtime_error{"valid snapshot rejected"};
+    }
+    if (taxa_of(tax) != taxa_of(tax2)) {
+        throw std::runtime_error{"taxa inconsistent after reading snapshot"};
+    }
+
+    // empty taxonomy
+    std::istringstream isEmpty {snapshot_of(taxonomy{})};
+    if (!read_snapshot(isEmpty, tax2) || !taxa_of(tax2).empty()) {
+        throw std::runtime_error{"empty snapshot inconsistent after reading"};
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+void taxonomy_snapshot_check_damaged_input()
+{
+    const auto snapshot = snapshot_of(make_test_taxonomy());
+
+    // every proper prefix must be rejected
+    for (std::size_t n = 0; n < snapshot.size(); ++n) {
+        if (!snapshot_rejected(snapshot.substr(0, n))) {
+            throw std::runtime_error{
+                "truncated snapshot with " + std::to_string(n) +
+                " of " + std::to_string(snapshot.size()) + " bytes not rejected"};
+        }
+    }
+
+    const auto corrupted = [&] (std::size_t offset, std::uint64_t value) {
+        auto s = snapshot;
+        std::memcpy(&s[offset], &value, sizeof(value));
+        return s;
+    };
+
+    // header: magic, total size, number of taxa, number of files, pool size
+    auto wrongMagic = snapshot;
+    wrongMagic[0] = 'X';
+    if (!snapshot_rejected(wrongMagic)) {
+        throw std::runtime_error{"snapshot with wrong magic not rejected"};
+    }
+    if (!snapshot_rejected(corrupted(8, snapshot.size() + 8))) {
+        throw std::runtime_error{"snapshot with wrong size not rejected"};
+    }
+    for (std::size_t field = 2; field < 5; ++field) {
+        for (std::uint64_t value : {std::uint64_t(1) << 61, ~std::uint64_t(0)}) {
+            if (!snapshot_rejected(corrupted(8 * field, value))) {
+                throw std::runtime_error{"snapshot with corrupted header field #" +
+                                         std::to_string(field) + " not rejected"};
+            }
+        }
+    }
+
+    // name offsets (must be increasing and within the string pool)
+    std::uint64_t n = 0;
+    std::memcpy(&n, &snapshot[16], sizeof(n));
+    const std::size_t nameOffs = 5 * 8 + 4 * 8 * n;
+    if (!snapshot_rejected(corrupted(nameOffs + 8, ~std::uint64_t(0)))) {
+        throw std::runtime_error{"snapshot with corrupted name offset not rejected"};
+    }
+}
+
+
+
+//-------------------------------------------------------------------
+int main()
+{
+    try {
+        taxonomy_snapshot_check_round_trip();
+        taxonomy_snapshot_check_damaged_input();
+
+        std::cout << "taxonomy snapshot tests passed" << std::endl;
+        return 0;
+    }
+    catch (std::exception& e) {
+        std::cout << "ERROR: " << e.what() << std::endl;
+        return 1;
+    }
+}